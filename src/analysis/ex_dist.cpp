@@ -1,6 +1,7 @@
 #include "def.h"
 #include "common/VortexTransition.h"
 #include "common/VortexLine.h"
+#include "common/VortexFrameStore.h"
 #include "io/GLGPU_IO_Helper.h"
 #include <vector>
 #include <string>
@@ -51,17 +52,20 @@ static bool LoadTimesteps(const std::string& dataname)
 
 static float Dist(const std::string& dataname, int frame, int lvid0, int lvid1)
 {
-  std::stringstream ss;
-  ss << dataname << ".vlines." << frame;
-  const std::string filename = ss.str();
+  // consecutive calls mostly hit the same or neighboring frames, whose
+  // lines keep their trees while cached
+  static VortexFrameStore store;
+  static std::string store_dataname;
+  if (store_dataname != dataname) {
+    store.SetDataName(dataname);
+    store_dataname = dataname;
+  }
 
-  std::string info_bytes;
-  std::vector<VortexLine> vortex_liness;
-  diy::unserializeFromFile(filename, vortex_liness);
-  // if (!::LoadVortexLines(vortex_liness, info_bytes, filename))
-  //   return DBL_MAX;
+  VortexFrameStore::FramePtr vortex_liness = store.Get(frame);
+  if (!vortex_liness)
+    return DBL_MAX;
 
-  return MinimumDist(vortex_liness[lvid0], vortex_liness[lvid1]);
+  return vortex_liness->MinimumDist(lvid0, lvid1);
 }
 
 int main(int argc, char **argv)
@@ -2,25 +2,29 @@
 #include "common/VortexTransition.h"
 #include "common/VortexEvents.h"
 #include "common/VortexLine.h"
+#include "common/VortexFrameStore.h"
 #include <cstdio>
 #include <cfloat>
 #include <sstream>
 
 static float CrossingPoint(const std::string& dataname, int frame, int lvid0, int lvid1, float X[3])
 {
-  std::stringstream ss;
-  ss << dataname << ".vlines." << frame;
-  const std::string filename = ss.str();
+  // frames and the trees of their lines are reused across events
+  static VortexFrameStore store;
+  static std::string store_dataname;
+  if (store_dataname != dataname) {
+    store.SetDataName(dataname);
+    store_dataname = dataname;
+  }
 
-  std::string info_bytes;
-  std::vector<VortexLine> vortex_liness;
-  if (!::LoadVortexLines(vortex_liness, info_bytes, filename)) {
-    fprintf(stderr, "cannot load vlines %s\n", filename.c_str());
+  VortexFrameStore::FramePtr vortex_liness = store.Get(frame);
+  if (!vortex_liness) {
+    fprintf(stderr, "cannot load vlines of frame %d\n", frame);
     return FLT_MAX;
   }
 
-  return CrossingPoint(vortex_liness[lvid0], vortex_liness[lvid1], X);
-  // return MinimumDist(vortex_liness[lvid0], vortex_liness[lvid1]);
+  return vortex_liness->CrossingPoint(lvid0, lvid1, X);
+  // return MinimumDist((*vortex_liness)[lvid0], (*vortex_liness)[lvid1]);
 }
 
 int main(int argc, char **argv)
@@ -3,7 +3,7 @@
 #include <vector>
 #include <getopt.h>
 #include "io/GLGPU2DDataset.h"
-#include "extractor/Extractor.h"
+#include "extractor/Extractor2D.h"
 
 static std::string filename_in, filename_out;
 static int nogauge = 0,  
@@ -92,18 +92,16 @@ int main(int argc, char **argv)
   ds.BuildMeshGraph();
   ds.PrintInfo();
  
-  VortexExtractor extractor;
+  VortexExtractor2D extractor;
   extractor.SetDataset(&ds);
   extractor.SetGaugeTransformation(!nogauge);
   
-  extractor.ExtractFaces(0);
-  extractor.TraceOverSpace(0);
+  extractor.ExtractPoints(0);
   extractor.SaveVortexLines(0);
   for (int t=T0+span; t<T0+T; t+=span){
     ds.LoadTimeStep(t, 1);
     ds.PrintInfo(1);
-    extractor.ExtractFaces(1);
-    extractor.TraceOverSpace(1);
+    extractor.ExtractPoints(1);
     extractor.ExtractEdges();
     extractor.TraceOverTime();
     extractor.SaveVortexLines(1);
@@ -1,11 +1,19 @@
 #include <iostream>
 #include <cstdio>
 #include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 #include <getopt.h>
 #include "io/GLGPU3DDataset.h"
 #include "extractor/Extractor.h"
+#include "common/Profiler.h"
+#include "common/Inclusions.h"
+#include "common/RegionOfInterest.h"
 
-static std::string filename_in;
+static std::string filename_in, filename_profile;
 static int nogauge = 0,  
            verbose = 0, 
            benchmark = 0, 
@@ -13,9 +21,13 @@ static int nogauge = 0,
            gpu = 0,
            nthreads = 0, 
            tet = 0,
-           cond = 0; // calculate condition number
+           cond = 0, // calculate condition number
+           resume = 0,
+           pipeline = 1; // number of frames extracted concurrently
 static int T0=0, T=1; // start and length of timesteps
 static int span=1;
+static int checkpoint_interval=10; // in number of timesteps, 0 disables checkpoints
+static RegionOfInterest roi;
 
 static struct option longopts[] = {
   {"verbose", no_argument, &verbose, 1},  
@@ -25,12 +37,19 @@ static struct option longopts[] = {
   {"gpu", no_argument, &gpu, 1}, 
   {"tet", no_argument, &tet, 1},
   {"cond", no_argument, &cond, 1},
+  {"resume", no_argument, &resume, 1},
   {"input", required_argument, 0, 'i'},
   {"output", required_argument, 0, 'o'},
   {"time", required_argument, 0, 't'}, 
   {"length", required_argument, 0, 'l'},
   {"span", required_argument, 0, 's'},
   {"concurrent", required_argument, 0, 'c'},
+  {"checkpoint", required_argument, 0, 'k'},
+  {"pipeline", required_argument, 0, 'p'},
+  {"profile", required_argument, 0, 'P'},
+  {"roi", required_argument, 0, 'r'},
+  {"roi-inclusions", required_argument, 0, 'I'},
+  {"halo", required_argument, 0, 'H'},
   {0, 0, 0, 0} 
 };
 
@@ -40,7 +59,7 @@ static bool parse_arg(int argc, char **argv)
 
   while (1) {
     int option_index = 0;
-    c = getopt_long(argc, argv, "i:t:l:s:c", longopts, &option_index); 
+    c = getopt_long(argc, argv, "i:t:l:s:c:k:p:P:r:I:H:", longopts, &option_index); 
     if (c == -1) break;
 
     switch (c) {
@@ -49,6 +68,25 @@ static bool parse_arg(int argc, char **argv)
     case 'l': T = atoi(optarg); break;
     case 's': span = atoi(optarg); break;
     case 'c': nthreads = atoi(optarg); break;
+    case 'k': checkpoint_interval = atoi(optarg); break;
+    case 'p': pipeline = std::max(1, atoi(optarg)); break;
+    case 'P': filename_profile = optarg; break;
+    case 'r': 
+      if (!roi.ParseFromString(optarg)) {
+        fprintf(stderr, "FATAL: cannot parse the region of interest.\n");
+        return false;
+      }
+      break;
+    case 'I': {
+      Inclusions inc;
+      if (!inc.ParseFromTextFile(optarg)) {
+        fprintf(stderr, "FATAL: cannot read inclusions from %s.\n", optarg);
+        return false;
+      }
+      roi.AddInclusions(inc, 0);
+      break;
+    }
+    case 'H': roi.SetHalo(atof(optarg)); break;
     default: break; 
     }
   }
@@ -81,10 +119,124 @@ static void print_help(int argc, char **argv)
   fprintf(stderr, "\t--verbose   verbose output\n"); 
   fprintf(stderr, "\t--benchmark Enable benchmark\n"); 
   fprintf(stderr, "\t--nogauge   Disable gauge transformation\n"); 
+  fprintf(stderr, "\t--checkpoint <n>  Save tracking state every n timesteps (default 10, 0 disables)\n"); 
+  fprintf(stderr, "\t--resume    Resume from the last checkpoint\n"); 
+  fprintf(stderr, "\t--pipeline <k>  Extract faces of up to k frames ahead of tracking in parallel\n"); 
+  fprintf(stderr, "\t--profile <file>  Write per-timestep timings and counters as JSON lines (- for stderr)\n"); 
+  fprintf(stderr, "\t--roi <x0,y0,z0,x1,y1,z1[;...]>  Extract only in these boxes\n"); 
+  fprintf(stderr, "\t--roi-inclusions <file>  Extract only in boxes around the inclusions\n"); 
+  fprintf(stderr, "\t--halo <h>  Grow the boxes of the region by h (default 0)\n"); 
   fprintf(stderr, "\n");
 }
 
 
+/////////////////
+// pipelined extraction: workers load frames and trace them over space, 
+// while the main thread tracks consecutive frames in order
+struct frame_result_t {
+  GLGPU3DDataset ds; // field data only, swapped out of the worker's dataset
+  std::map<FaceIdType, PuncturedFace> pfs;
+  std::vector<VortexObject> vobjs;
+};
+
+static std::mutex pipeline_mutex;
+static std::condition_variable pipeline_cond;
+static std::map<int, frame_result_t*> pipeline_results;
+static int pipeline_next, // next timestep to be extracted
+           pipeline_tracked; // last timestep taken by the tracker
+
+static void setup_extractor(VortexExtractor& extractor, int nthreads)
+{
+  extractor.SetGaugeTransformation(!nogauge);
+
+  if (nthreads != 0) 
+    extractor.SetNumberOfThreads(nthreads);
+
+  if (archive)
+    extractor.SetArchive(true);
+
+  if (gpu)
+    extractor.SetGPU(true);
+
+  if (cond) 
+    extractor.SetCond(true);
+}
+
+static void pipeline_worker(const VortexExtractor *tracker, int nthreads)
+{
+  GLGPU3DDataset ds;
+  ds.OpenDataFile(filename_in);
+  ds.SetMeshType(tet ? GLGPU3D_MESH_TET : GLGPU3D_MESH_HEX);
+  ds.SetRegionOfInterest(roi);
+
+  VortexExtractor extractor;
+#if WITH_ROCKSDB
+  extractor.SetDB(tracker->DB());
+#endif
+  setup_extractor(extractor, nthreads);
+
+  while (1) {
+    int t;
+    {
+      std::unique_lock<std::mutex> lock(pipeline_mutex);
+      // bounded buffering: stay within the window ahead of the tracker
+      while (pipeline_next < T0+T && pipeline_next >= pipeline_tracked + pipeline*span) 
+        pipeline_cond.wait(lock);
+      if (pipeline_next >= T0+T) return;
+
+      t = pipeline_next;
+      pipeline_next += span;
+    }
+
+    ds.LoadTimeStep(t, 0);
+    if (ds.MeshGraph() == NULL) {
+      ds.BuildMeshGraph();
+      extractor.SetDataset(&ds);
+      extractor.SetRegionOfInterest(roi);
+    }
+
+    extractor.Clear();
+    extractor.ExtractFaces(0);
+    extractor.TraceOverSpace(0);
+
+    frame_result_t *r = new frame_result_t;
+    r->ds.SwapTimeStep(ds, 0, 0);
+    r->pfs = extractor.GetPuncturedFaces(0);
+    r->vobjs = extractor.GetVortexObjects(0);
+
+    std::unique_lock<std::mutex> lock(pipeline_mutex);
+    pipeline_results[t] = r;
+    pipeline_cond.notify_all();
+  }
+}
+
+// extract timestep t into the given slot, or take it from the pipeline
+static void extract_frame(GLGPU3DDataset& ds, VortexExtractor& extractor, int t, int slot)
+{
+  if (pipeline <= 1) {
+    ds.LoadTimeStep(t, slot);
+    extractor.ExtractFaces(slot);
+    extractor.TraceOverSpace(slot);
+    return;
+  }
+
+  frame_result_t *r;
+  {
+    std::unique_lock<std::mutex> lock(pipeline_mutex);
+    while (pipeline_results.find(t) == pipeline_results.end()) 
+      pipeline_cond.wait(lock);
+    r = pipeline_results[t];
+    pipeline_results.erase(t);
+    pipeline_tracked = t;
+    pipeline_cond.notify_all();
+  }
+
+  ds.SwapTimeStep(r->ds, slot, 0);
+  extractor.SetPuncturedFaces(r->pfs, slot);
+  extractor.SetVortexObjects(r->vobjs, slot);
+  delete r;
+}
+
 int main(int argc, char **argv)
 {
   if (!parse_arg(argc, argv)) {
@@ -92,8 +244,17 @@ int main(int argc, char **argv)
     return EXIT_FAILURE;
   }
 
+  FILE *fp_profile = NULL;
+  if (!filename_profile.empty()) {
+    if (filename_profile != "-") 
+      fp_profile = fopen(filename_profile.c_str(), "w");
+    Profiler::SetOutput(fp_profile);
+    Profiler::SetEnabled(true);
+  }
+
   GLGPU3DDataset ds;
   ds.OpenDataFile(filename_in);
+  ds.SetRegionOfInterest(roi);
   // ds.SetPrecomputeSupercurrent(true);
   ds.LoadTimeStep(T0, 0);
   if (tet) ds.SetMeshType(GLGPU3D_MESH_TET);
@@ -103,34 +264,65 @@ int main(int argc, char **argv)
  
   VortexExtractor extractor;
   extractor.SetDataset(&ds);
-  extractor.SetGaugeTransformation(!nogauge);
+  extractor.SetRegionOfInterest(roi);
+  setup_extractor(extractor, nthreads);
 
-  if (nthreads != 0) 
-    extractor.SetNumberOfThreads(nthreads);
+  int t_start = T0;
+  const bool resumed = resume && extractor.LoadCheckpoint(t_start) 
+      && t_start >= T0 && t_start < T0+T && (t_start-T0) % span == 0;
+  if (resumed) {
+    fprintf(stderr, "resuming after timestep %d\n", t_start);
+    if (t_start != T0) 
+      ds.LoadTimeStep(t_start, 0); // field data is needed for space-time edges
+  } else 
+    t_start = T0;
 
-  if (archive)
-    extractor.SetArchive(true);
+  if (gpu) pipeline = 1; // one device context
+  std::vector<std::thread> workers;
+  if (pipeline > 1) {
+    pipeline_next = resumed ? t_start+span : T0;
+    pipeline_tracked = t_start;
+    
+    // share the cores between the frames in flight
+    const int nthreads_per_worker = nthreads != 0 ? nthreads : 
+      std::max(1, (int)std::thread::hardware_concurrency() / pipeline);
+    for (int i=0; i<pipeline; i++) 
+      workers.push_back(std::thread(pipeline_worker, &extractor, nthreads_per_worker));
+  }
 
-  if (gpu)
-    extractor.SetGPU(true);
+  if (!resumed) {
+    extractor.Clear(); // drops a checkpoint that does not match the run
+    if (pipeline > 1) 
+      extract_frame(ds, extractor, T0, 0);
+    else { // T0 is loaded already
+      extractor.ExtractFaces(0);
+      extractor.TraceOverSpace(0);
+    }
+    extractor.SaveVortexLines(0);
+    if (checkpoint_interval > 0) 
+      extractor.SaveCheckpoint();
+    Profiler::EndFrame(T0);
+  }
 
-  if (cond) 
-    extractor.SetCond(true);
- 
-  extractor.ExtractFaces(0);
-  extractor.TraceOverSpace(0);
-  extractor.SaveVortexLines(0);
-  for (int t=T0+span; t<T0+T; t+=span){
-    ds.LoadTimeStep(t, 1);
+  int nsteps = 0;
+  for (int t=t_start+span; t<T0+T; t+=span){
+    extract_frame(ds, extractor, t, 1);
     // ds.PrintInfo(1);
-    extractor.ExtractFaces(1);
-    extractor.TraceOverSpace(1);
     extractor.ExtractEdges();
     extractor.TraceOverTime();
     extractor.SaveVortexLines(1);
     extractor.RotateTimeSteps();
     ds.RotateTimeSteps();
+
+    if (checkpoint_interval > 0 && (++nsteps % checkpoint_interval == 0 || t+span >= T0+T))
+      extractor.SaveCheckpoint();
+    Profiler::EndFrame(t);
   }
 
+  for (int i=0; i<workers.size(); i++)
+    workers[i].join();
+
+  if (fp_profile) fclose(fp_profile);
+
   return EXIT_SUCCESS; 
 }
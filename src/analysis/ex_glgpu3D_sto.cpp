@@ -4,15 +4,19 @@
 #include <getopt.h>
 #include "io/GLGPU3DDataset.h"
 #include "extractor/StochasticExtractor.h"
+#include "common/Profiler.h"
 
-static std::string filename_in;
+static std::string filename_in, filename_profile;
 static int nogauge = 0,  
            verbose = 0, 
            benchmark = 0, 
            archive = 0,
-           gpu = 1,
+           gpu = 0,
            nthreads = 0, 
+           nruns = 256,
            tet = 1;
+static float pertubation = 0.04,
+             kernel_size = 0.5;
 static int T0=0, T=1; // start and length of timesteps
 static int span=1;
 
@@ -29,6 +33,10 @@ static struct option longopts[] = {
   {"length", required_argument, 0, 'l'},
   {"span", required_argument, 0, 's'},
   {"concurrent", required_argument, 0, 'c'},
+  {"runs", required_argument, 0, 'n'},
+  {"pertubation", required_argument, 0, 'p'},
+  {"kernel", required_argument, 0, 'k'},
+  {"profile", required_argument, 0, 'P'},
   {0, 0, 0, 0} 
 };
 
@@ -38,7 +46,7 @@ static bool parse_arg(int argc, char **argv)
 
   while (1) {
     int option_index = 0;
-    c = getopt_long(argc, argv, "i:t:l:s:c", longopts, &option_index); 
+    c = getopt_long(argc, argv, "i:t:l:s:c:n:p:k:P:", longopts, &option_index); 
     if (c == -1) break;
 
     switch (c) {
@@ -47,6 +55,10 @@ static bool parse_arg(int argc, char **argv)
     case 'l': T = atoi(optarg); break;
     case 's': span = atoi(optarg); break;
     case 'c': nthreads = atoi(optarg); break;
+    case 'n': nruns = atoi(optarg); break;
+    case 'p': pertubation = atof(optarg); break;
+    case 'k': kernel_size = atof(optarg); break;
+    case 'P': filename_profile = optarg; break;
     default: break; 
     }
   }
@@ -79,6 +91,11 @@ static void print_help(int argc, char **argv)
   fprintf(stderr, "\t--verbose   verbose output\n"); 
   fprintf(stderr, "\t--benchmark Enable benchmark\n"); 
   fprintf(stderr, "\t--nogauge   Disable gauge transformation\n"); 
+  fprintf(stderr, "\t--gpu       Run the ensemble on the GPU\n"); 
+  fprintf(stderr, "\t--runs <n>  Number of perturbed runs (default 256)\n"); 
+  fprintf(stderr, "\t--pertubation <p>  Std dev of the noise added to the order parameter (default 0.04)\n"); 
+  fprintf(stderr, "\t--kernel <k>  Std dev of the Gaussian kernel of the puncture density (default 0.5)\n"); 
+  fprintf(stderr, "\t--profile <file>  Write timings and counters as JSON lines (- for stderr)\n"); 
   fprintf(stderr, "\n");
 }
 
@@ -90,6 +107,14 @@ int main(int argc, char **argv)
     return EXIT_FAILURE;
   }
 
+  FILE *fp_profile = NULL;
+  if (!filename_profile.empty()) {
+    if (filename_profile != "-") 
+      fp_profile = fopen(filename_profile.c_str(), "w");
+    Profiler::SetOutput(fp_profile);
+    Profiler::SetEnabled(true);
+  }
+
   GLGPU3DDataset ds;
   ds.OpenDataFile(filename_in);
   // ds.SetPrecomputeSupercurrent(true);
@@ -102,10 +127,29 @@ int main(int argc, char **argv)
   StochasticVortexExtractor ex;
   ex.SetDataset(&ds);
   ex.SetExtentThreshold(1e38);
-  ex.SetGPU(true);
+  ex.SetGPU(gpu);
+  ex.SetGaugeTransformation(!nogauge);
+  ex.SetNumberOfRuns(nruns);
+  ex.SetPertubation(pertubation);
+  ex.SetKernelSize(kernel_size);
+  if (nthreads != 0) 
+    ex.SetNumberOfThreads(nthreads);
 
   ex.ExtractDeterministicVortices();
   ex.ExtractStochasticVortices();
+  Profiler::EndFrame(T0);
+
+  if (ex.Density() != NULL) {
+    const GLHeader &h = ds.GetHeader(0);
+    const std::string filename = filename_in + ".density";
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (fp) {
+      fwrite(ex.Density(), sizeof(float), h.dims[0]*h.dims[1]*h.dims[2], fp);
+      fclose(fp);
+      fprintf(stderr, "density written to %s\n", filename.c_str());
+    }
+  }
 
+  if (fp_profile) fclose(fp_profile);
   return EXIT_SUCCESS; 
 }
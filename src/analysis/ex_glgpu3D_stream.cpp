@@ -4,15 +4,21 @@
 #include <cstring>
 #include <vector>
 #include <queue>
+#include <cstdlib>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <tbb/mutex.h>
-#include <tbb/flow_graph.h>
-#include <tbb/concurrent_unordered_map.h>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <tbb/task_group.h>
+#include <tbb/task_arena.h>
+#include <tbb/enumerable_thread_specific.h>
 #include "io/GLGPU3DDataset.h"
 #include "extractor/Extractor.h"
+#include "common/VortexLineBVH.h"
 
 #if WITH_ROCKSDB
 #include <rocksdb/db.h>
@@ -62,19 +68,56 @@ typedef struct {
   float V; // voltage
 } vfgpu_hdr_t;
 
-tbb::concurrent_unordered_map<int, vfgpu_hdr_t> hdrs_all;
-tbb::concurrent_unordered_map<int, std::vector<vfgpu_pf_t> > pfs_all;
-tbb::concurrent_unordered_map<int, std::vector<VortexObject> > vobjs_all;
-tbb::concurrent_unordered_map<int, std::vector<VortexLine> > vlines_all;
-tbb::concurrent_unordered_map<std::pair<int, int>, std::vector<vfgpu_pe_t> > pes_all; // released on exit
-std::map<int, tbb::flow::continue_node<tbb::flow::continue_msg>* > extract_tasks; 
-std::map<std::pair<int, int>, tbb::flow::continue_node<tbb::flow::continue_msg>* > track_tasks;
-VortexTransition vt;
+struct frame_data_t {
+  vfgpu_hdr_t hdr;
+  std::vector<vfgpu_pf_t> pfs;
+  std::vector<VortexObject> vobjs;
+  std::vector<VortexLine> vlines;
+  bool extracted;
+  int nrefs; // number of tasks (its extraction and intervals) that still need this frame
+  std::vector<std::pair<int, int> > waiting; // intervals waiting for its extraction
+};
+
+struct interval_data_t {
+  std::vector<vfgpu_pe_t> pes;
+  int ndeps; // number of frames of the interval not yet extracted
+};
 
-tbb::concurrent_unordered_map<int, int> frame_counter;  // used to count how many times a frame is referenced by trackers
-// tbb::concurrent_unordered_map<int, tbb::mutex> frame_mutexes;
-static const int max_buffered_frames = 256;
-static int num_buffered_frames = 0;
+// frames and intervals in flight; entries are released once tracked.
+// std::map keeps references valid while other entries come and go.
+static std::map<int, frame_data_t> frames_all;
+static std::map<std::pair<int, int>, interval_data_t> intervals_all;
+static std::mutex data_mutex;
+static std::condition_variable data_cond; // frames released or tasks finished
+static int max_buffered_frames = 256;
+static int num_tasks = 0; // queued or running
+
+static tbb::task_group *tasks = NULL;
+
+// per-thread dataset (mesh graph) and extractor, reused across tasks
+struct context_t {
+  GLGPU3DDataset *ds;
+  VortexExtractor *ex;
+
+  context_t() : ds(NULL), ex(NULL) {}
+  context_t(const context_t&) : ds(NULL), ex(NULL) {} // built lazily by each thread
+  ~context_t() {delete ex; delete ds;}
+
+  void Reset(const GLHeader& h, int meshtype) {
+    if (ds == NULL) { // the mesh only depends on cfg, which is fixed for the stream
+      ds = new GLGPU3DDataset;
+      ds->SetHeader(h);
+      ds->SetMeshType(meshtype);
+      ds->BuildMeshGraph();
+
+      ex = new VortexExtractor;
+      ex->SetDataset(ds);
+    }
+    ex->Clear();
+  }
+};
+static tbb::enumerable_thread_specific<context_t> contexts;
+VortexTransition vt;
 
 static vfgpu_cfg_t cfg;
 static std::string infile;
@@ -98,31 +141,31 @@ static void write_vlines(int frame, std::vector<VortexLine>& vlines)
 {
 #if WITH_ROCKSDB
 #if 0
-  for (int i=0; i<vlines.size(); i++) {
-    vlines[i].RemoveInvalidPoints();
-    vlines[i].Simplify(0.1);
-    vlines[i].ToBezier(0.01);
-  }
+  VortexLineProcessing p;
+  p.remove_invalid_points = true;
+  p.simplify_tolerance = 0.1;
+  p.bezier_error_bound = 0.01;
+  ProcessVortexLines(vlines, p);
 #endif
 
+  const VortexLineSet set(vlines);
   std::stringstream ss;
   std::string buf;
-  diy::serialize(vlines, buf);
+  diy::serialize(set, buf);
   ss << "v." << frame;
   db->Put(rocksdb::WriteOptions(), ss.str(), buf);
 
-#if 0
-  // compute distance
+  // distances between the lines, for the MDS view of the viewer; the 
+  // tasks already run in parallel
+  float L[3];
+  for (int k=0; k<3; k++) 
+    L[k] = cfg.pbc[k] ? cfg.lengths[k] : 0;
   std::vector<float> dist;
-  for (int i=0; i<vlines.size(); i++) 
-    for (int j=0; j<vlines.size(); j++) 
-      if (i==j) dist.push_back(0);
-      else dist.push_back(MinimumDist(vlines[i], vlines[j]));
-  ss.clear();
+  MinimumDistMatrix(set, dist, L, 1);
+  ss.str("");
   ss << "d." << frame;
   diy::serialize(dist, buf);
   db->Put(rocksdb::WriteOptions(), ss.str(), buf);
-#endif
 #else 
   std::stringstream ss;
   ss << infile << ".v." << frame;
@@ -130,26 +173,6 @@ static void write_vlines(int frame, std::vector<VortexLine>& vlines)
 #endif
 }
 
-static void compute_moving_speed(
-    int f0, int f1, 
-    std::vector<VortexLine>& vlines0, // moving speed will be written in vlines
-    const std::vector<VortexLine>& vlines1,
-    const VortexTransitionMatrix& mat)
-{
-  int event; 
-  std::set<int> lhs, rhs;
-  for (int i=0; i<mat.NModules(); i++) {
-    mat.GetModule(i, lhs, rhs, event);
-    if (event != VORTEX_EVENT_DUMMY) continue; // cannot compute moving speed for events
-
-    const int llvid = *lhs.begin(), rlvid = *rhs.begin();
-    const float A = AreaL(vlines0[llvid], vlines1[rlvid]);
-    vlines0[llvid].moving_speed = A;
-    // fprintf(stderr, "f0=%d, f1=%d, llvid=%d, rlvid=%d, A=%f\n", 
-    //     f0, f1, llvid, rlvid, A);
-  }
-}
-
 static void write_mat(int f0, int f1, const VortexTransitionMatrix& mat)
 {
 #if WITH_ROCKSDB
@@ -165,48 +188,41 @@ static void write_mat(int f0, int f1, const VortexTransitionMatrix& mat)
 #endif
 }
 
-/////////////////
-struct extract {
-  int frame;
-  extract(int frame_) : frame(frame_) {}
-
-  void operator()(tbb::flow::continue_msg) const {
-    const vfgpu_hdr_t& hdr = hdrs_all[frame];
-    const std::vector<vfgpu_pf_t>& pfs = pfs_all[frame];
-    GLHeader h = conv_hdr(cfg, hdrs_all[frame]);
-
-    GLGPU3DDataset *ds = new GLGPU3DDataset;
-    ds->SetHeader(h);
-    ds->SetMeshType(cfg.meshtype); 
-    ds->BuildMeshGraph();
-
-    VortexExtractor *ex = new VortexExtractor;
-    ex->SetDataset(ds);
-    
-    ex->Clear();
-    for (int i=0; i<pfs.size(); i++) {
-      const vfgpu_pf_t &pf = pfs[i];
-      int chirality = pf.fid_and_chirality & 0x80000000 ? 1 : -1;
-      int fid = pf.fid_and_chirality & 0x7fffffff;
-      ex->AddPuncturedFace(fid, 0, chirality, pf.pos);
-    }
-    ex->TraceOverSpace(0);
+static void add_punctured_faces(VortexExtractor *ex, const std::vector<vfgpu_pf_t>& pfs, int slot)
+{
+  for (int i=0; i<pfs.size(); i++) {
+    const vfgpu_pf_t &pf = pfs[i];
+    int chirality = pf.fid_and_chirality & 0x80000000 ? 1 : -1;
+    int fid = pf.fid_and_chirality & 0x7fffffff;
+    ex->AddPuncturedFace(fid, slot, chirality, pf.pos);
+  }
+}
 
-    vobjs_all[hdr.frame] = ex->GetVortexObjects(0);
+static void release_frame(int frame) // requires data_mutex
+{
+  std::map<int, frame_data_t>::iterator it = frames_all.find(frame);
+  if (it == frames_all.end()) return;
+  if (-- it->second.nrefs > 0) return;
 
-    std::vector<VortexLine> vlines = ex->GetVortexLines();
-    vlines_all[hdr.frame] = vlines;
-    
-    // write_vlines(hdr.frame, vlines);
+  frames_all.erase(it);
+  data_cond.notify_all();
+}
 
-    delete ds;
-    delete ex;
-    
-    __sync_fetch_and_sub(&num_buffered_frames, 1);
-    fprintf(stderr, "frame=%d, #pfs=%d, #vlines=%d\n", 
-        hdr.frame, (int)pfs.size(), (int)vlines.size());
+template <typename Task>
+static void launch(const Task& task)
+{
+  {
+    std::unique_lock<std::mutex> lock(data_mutex);
+    num_tasks ++;
+    data_cond.notify_all();
   }
-}; 
+  tasks->run([task]() {
+    task();
+    std::unique_lock<std::mutex> lock(data_mutex);
+    num_tasks --;
+    data_cond.notify_all();
+  });
+}
 
 /////////////////
 struct track {
@@ -214,40 +230,28 @@ struct track {
   const int f0, f1;
   track(const std::pair<int, int> f) : interval(f), f0(f.first), f1(f.second) {}
 
-  void operator()(tbb::flow::continue_msg) const {
-    const vfgpu_hdr_t& hdr0 = hdrs_all[f0], 
-                       hdr1 = hdrs_all[f1];
-    GLHeader h0 = conv_hdr(cfg, hdr0), 
-             h1 = conv_hdr(cfg, hdr1);
-    const std::vector<vfgpu_pf_t>& pfs0 = pfs_all[f0], 
-                                   pfs1 = pfs_all[f1];
-    const std::vector<vfgpu_pe_t>& pes = pes_all[interval];
-    const std::vector<VortexObject>& vobjs0 = vobjs_all[f0],
-                                     vobjs1 = vobjs_all[f1];
-    std::vector<VortexLine>& vlines0 = vlines_all[f0], 
-                             vlines1 = vlines_all[f1];
-
-    GLGPU3DDataset *ds = new GLGPU3DDataset;
-    ds->SetHeader(h0);
-    ds->SetMeshType(cfg.meshtype);
-    ds->BuildMeshGraph();
-
-    VortexExtractor *ex = new VortexExtractor;
-    ex->SetDataset(ds);
-    
-    for (int i=0; i<pfs0.size(); i++) {
-      const vfgpu_pf_t &pf = pfs0[i];
-      int chirality = pf.fid_and_chirality & 0x80000000 ? 1 : -1;
-      int fid = pf.fid_and_chirality & 0x7fffffff;
-      ex->AddPuncturedFace(fid, 0, chirality, pf.pos);
+  void operator()() const {
+    frame_data_t *fd0, *fd1;
+    interval_data_t *id;
+    {
+      std::unique_lock<std::mutex> lock(data_mutex);
+      fd0 = &frames_all[f0];
+      fd1 = &frames_all[f1];
+      id = &intervals_all[interval];
     }
+    const std::vector<vfgpu_pf_t>& pfs0 = fd0->pfs, 
+                                   &pfs1 = fd1->pfs;
+    const std::vector<vfgpu_pe_t>& pes = id->pes;
+    const std::vector<VortexObject>& vobjs0 = fd0->vobjs,
+                                     &vobjs1 = fd1->vobjs;
+    std::vector<VortexLine>& vlines0 = fd0->vlines;
+
+    context_t &ctx = contexts.local();
+    ctx.Reset(conv_hdr(cfg, fd0->hdr), cfg.meshtype);
+    VortexExtractor *ex = ctx.ex;
     
-    for (int i=0; i<pfs1.size(); i++) {
-      const vfgpu_pf_t &pf = pfs1[i];
-      int chirality = pf.fid_and_chirality & 0x80000000 ? 1 : -1;
-      int fid = pf.fid_and_chirality & 0x7fffffff;
-      ex->AddPuncturedFace(fid, 1, chirality, pf.pos);
-    }
+    add_punctured_faces(ex, pfs0, 0);
+    add_punctured_faces(ex, pfs1, 1);
 
     for (int i=0; i<pes.size(); i++) {
       const vfgpu_pe_t &pe = pes[i];
@@ -258,15 +262,11 @@ struct track {
 
     ex->SetVortexObjects(vobjs0, 0);
     ex->SetVortexObjects(vobjs1, 1);
-    VortexTransitionMatrix mat = ex->TraceOverTime();
-    mat.SetInterval(interval);
-    mat.Modularize();
+    VortexTransitionMatrix mat = ex->TransitionMatrix(); // the sequences are kept by vt
+    mat.SetInterval(interval); // already modularized
     vt.AddMatrix(mat);
-
-    delete ex;
-    delete ds;
+    vt.UpdateSequence(); // global ids and events follow the stream
     
-    // compute_moving_speed(f0, f1, vlines0, vlines1, mat);
     write_mat(f0, f1, mat);
     write_vlines(f0, vlines0);
     
@@ -274,31 +274,88 @@ struct track {
         interval.first, interval.second, (int)pfs0.size(), (int)pfs1.size(), (int)pes.size());
     
     // release resources
-    pes_all[interval].clear();
-    int &fc0 = frame_counter[f0], 
-        &fc1 = frame_counter[f1];
-    __sync_fetch_and_add(&fc0, 1);
-    __sync_fetch_and_add(&fc1, 1);
-    if (fc0 == 2) {
-      pfs_all[fc0] = std::vector<vfgpu_pf_t>();
-      vobjs_all[fc0] = std::vector<VortexObject>();
-      vlines_all[fc0] = std::vector<VortexLine>();
-    }
-    if (fc1 == 2) {
-      pfs_all[fc1] = std::vector<vfgpu_pf_t>();
-      vobjs_all[fc1] = std::vector<VortexObject>();
-      vlines_all[fc1] = std::vector<VortexLine>();
+    std::unique_lock<std::mutex> lock(data_mutex);
+    intervals_all.erase(interval);
+    release_frame(f0);
+    release_frame(f1);
+  }
+};
+
+/////////////////
+struct extract {
+  int frame;
+  extract(int frame_) : frame(frame_) {}
+
+  void operator()() const {
+    frame_data_t *fd;
+    {
+      std::unique_lock<std::mutex> lock(data_mutex);
+      fd = &frames_all[frame];
     }
+    const vfgpu_hdr_t& hdr = fd->hdr;
+    const std::vector<vfgpu_pf_t>& pfs = fd->pfs;
+    context_t &ctx = contexts.local();
+    ctx.Reset(conv_hdr(cfg, hdr), cfg.meshtype);
+    VortexExtractor *ex = ctx.ex;
+    
+    add_punctured_faces(ex, pfs, 0);
+    ex->TraceOverSpace(0);
+
+    fd->vobjs = ex->GetVortexObjects(0);
+    fd->vlines = ex->GetVortexLines();
     
-    __sync_fetch_and_sub(&num_buffered_frames, 1);
+    fprintf(stderr, "frame=%d, #pfs=%d, #vlines=%d\n", 
+        hdr.frame, (int)pfs.size(), (int)fd->vlines.size());
+
+    if (!cfg.tracking) {
+      write_vlines(frame, fd->vlines);
+      std::unique_lock<std::mutex> lock(data_mutex);
+      release_frame(frame);
+      return;
+    }
+
+    // launch the intervals that were waiting for this frame
+    std::vector<std::pair<int, int> > ready;
+    {
+      std::unique_lock<std::mutex> lock(data_mutex);
+      fd->extracted = true;
+      for (int i=0; i<fd->waiting.size(); i++) 
+        if (-- intervals_all[fd->waiting[i]].ndeps == 0) 
+          ready.push_back(fd->waiting[i]);
+      fd->waiting.clear();
+      release_frame(frame); // the intervals hold their own references
+    }
+    for (int i=0; i<ready.size(); i++) 
+      launch(track(ready[i]));
   }
-};
+}; 
+
+/////////////////
+// blocks the reader while the buffer is full, until a task releases a frame 
+// (requires data_mutex).  Frames that only wait for intervals not read yet 
+// cannot be released, so when no task is left the buffer grows instead.
+static void wait_for_buffer(std::unique_lock<std::mutex>& lock)
+{
+  while ((int)frames_all.size() >= max_buffered_frames && num_tasks > 0) {
+    if (tbb::this_task_arena::max_concurrency() > 1) 
+      data_cond.wait(lock);
+    else { // no worker threads; the reader has to run the tasks
+      lock.unlock();
+      tasks->wait();
+      lock.lock();
+    }
+  }
+}
 
 /////////////////
 int main(int argc, char **argv)
 {
-  if (argc < 2) return 1;
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <input> [max_buffered_frames=256]\n", argv[0]);
+    return 1;
+  }
   infile = argv[1];
+  if (argc >= 3) max_buffered_frames = std::max(2, atoi(argv[2]));
   
   FILE *fp = fopen(infile.c_str(), "rb");
   if (!fp) return 1;
@@ -315,26 +372,21 @@ int main(int argc, char **argv)
   assert(status.ok());
 #endif
 
-  using namespace tbb::flow;
-  graph g;
+  tbb::task_group task_group;
+  tasks = &task_group;
 
   int type_msg;
   vfgpu_hdr_t hdr;
   int pfcount, pecount;
   const int max_frames = 5000; // INT_MAX;
   int frame_count = 0;
-  std::vector<int> frames;
   std::vector<vfgpu_hdr_t> hdrs;
 
   fread(&cfg, sizeof(vfgpu_cfg_t), 1, fp);
+  vt.SetKeepMatrices(false); // matrices are stored as separate records
 
   while (!feof(fp)) {
     if (frame_count ++ > max_frames) break;
-    
-    // simple flow control
-    __sync_fetch_and_add(&num_buffered_frames, 1);
-    while (num_buffered_frames >= max_buffered_frames) 
-      usleep(100000);
 
     size_t count = fread(&type_msg, sizeof(int), 1, fp);
     if (count != 1) break;
@@ -343,39 +395,67 @@ int main(int argc, char **argv)
       fread(&hdr, sizeof(vfgpu_hdr_t), 1, fp);
       fread(&pfcount, sizeof(int), 1, fp);
       
-      hdrs_all[hdr.frame] = hdr;
-      std::vector<vfgpu_pf_t> &pfs = pfs_all[hdr.frame];
-      pfs.resize(pfcount);
+      std::vector<vfgpu_pf_t> pfs(pfcount);
       fread(pfs.data(), sizeof(vfgpu_pf_t), pfcount, fp);
-      
-      continue_node<continue_msg> *e = new continue_node<continue_msg>(g, extract(hdr.frame));
-      e->try_put(continue_msg());
-      extract_tasks[hdr.frame] = e;
+
+      {
+        std::unique_lock<std::mutex> lock(data_mutex);
+        wait_for_buffer(lock);
+
+        frame_data_t &fd = frames_all[hdr.frame];
+        fd.hdr = hdr;
+        fd.pfs.swap(pfs);
+        fd.extracted = false;
+        // the extraction, and the intervals: interior frames are shared by 
+        // two, the first one has one.  The last frame is released once more 
+        // when the stream ends.
+        fd.nrefs = 1 + (cfg.tracking ? (hdrs.empty() ? 1 : 2) : 0); 
+      }
+      launch(extract(hdr.frame));
 
       hdrs.push_back(hdr);
-      frames.push_back(hdr.frame);
+      vt.AddFrame(hdr.frame);
       // fprintf(stderr, "pushed frame %d\n", hdr.frame);
     } else if (type_msg == VFGPU_MSG_PE) {
       std::pair<int, int> interval;
       fread(&interval, sizeof(int), 2, fp);
       fread(&pecount, sizeof(int), 1, fp);
 
-      std::vector<vfgpu_pe_t> &pes = pes_all[interval];
-      pes.resize(pecount);
+      std::vector<vfgpu_pe_t> pes(pecount);
       fread(pes.data(), sizeof(vfgpu_pe_t), pecount, fp);
     
-      continue_node<continue_msg> *t = new continue_node<continue_msg>(g, track(interval));
-      track_tasks[interval] = t;
-     
-      make_edge(*extract_tasks[interval.first], *t);
-      make_edge(*extract_tasks[interval.second], *t);
+      bool ready;
+      {
+        std::unique_lock<std::mutex> lock(data_mutex);
+        std::map<int, frame_data_t>::iterator it0 = frames_all.find(interval.first), 
+                                              it1 = frames_all.find(interval.second);
+        if (it0 == frames_all.end() || it1 == frames_all.end()) {
+          fprintf(stderr, "interval={%d, %d} refers to unknown frames, skipped\n", 
+              interval.first, interval.second);
+          continue;
+        }
+
+        interval_data_t &id = intervals_all[interval];
+        id.pes.swap(pes);
+        id.ndeps = 0;
+        if (!it0->second.extracted) {it0->second.waiting.push_back(interval); id.ndeps ++;}
+        if (!it1->second.extracted) {it1->second.waiting.push_back(interval); id.ndeps ++;}
+        ready = id.ndeps == 0;
+      }
+      if (ready) launch(track(interval));
       // fprintf(stderr, "pushed interval {%d, %d}\n", interval.first, interval.second);
     }
   }
 
   fclose(fp);
 
-  g.wait_for_all();
+  if (cfg.tracking && !hdrs.empty()) {
+    std::unique_lock<std::mutex> lock(data_mutex);
+    release_frame(hdrs.back().frame);
+  }
+  task_group.wait();
+  frames_all.clear();
+  intervals_all.clear();
   
 #if WITH_ROCKSDB
   std::string buf;
@@ -387,8 +467,7 @@ int main(int argc, char **argv)
   db->Put(rocksdb::WriteOptions(), "hdrs", buf);
 
   fprintf(stderr, "constructing sequences...\n");
-  vt.SetFrames(frames);
-  vt.ConstructSequence();
+  vt.UpdateSequence();
   vt.PrintSequence();
   diy::serialize(vt, buf);
   db->Put(rocksdb::WriteOptions(), "trans", buf);
@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <getopt.h>
+#include "io/GLGPUSynthetic.h"
+
+static std::string prefix = "synth";
+static int dims[3] = {64, 64, 64};
+static float lengths[3] = {32, 32, 32};
+static int nframes = 8,
+           nstraight = 4,
+           nhelices = 2,
+           npairs = 2,
+           seed = 1;
+static float speed = 0.5,
+             dt = 1;
+
+static struct option longopts[] = {
+  {"output", required_argument, 0, 'o'},
+  {"dims", required_argument, 0, 'd'},
+  {"lengths", required_argument, 0, 'L'},
+  {"frames", required_argument, 0, 'n'},
+  {"dt", required_argument, 0, 't'},
+  {"straight", required_argument, 0, 'a'},
+  {"helices", required_argument, 0, 'b'},
+  {"pairs", required_argument, 0, 'p'},
+  {"speed", required_argument, 0, 'v'},
+  {"seed", required_argument, 0, 's'},
+  {0, 0, 0, 0}
+};
+
+// "n" or "nx,ny,nz"
+template <typename T>
+static void parse_triple(const char *arg, T v[3])
+{
+  std::stringstream ss(arg);
+  std::string tok;
+  int i = 0;
+  while (i < 3 && std::getline(ss, tok, ','))
+    v[i++] = atof(tok.c_str());
+  for (; i<3; i++) v[i] = v[i-1];
+}
+
+static bool parse_arg(int argc, char **argv)
+{
+  int c;
+
+  while (1) {
+    int option_index = 0;
+    c = getopt_long(argc, argv, "o:d:L:n:t:a:b:p:v:s:", longopts, &option_index);
+    if (c == -1) break;
+
+    switch (c) {
+    case 'o': prefix = optarg; break;
+    case 'd': parse_triple(optarg, dims); break;
+    case 'L': parse_triple(optarg, lengths); break;
+    case 'n': nframes = atoi(optarg); break;
+    case 't': dt = atof(optarg); break;
+    case 'a': nstraight = atoi(optarg); break;
+    case 'b': nhelices = atoi(optarg); break;
+    case 'p': npairs = atoi(optarg); break;
+    case 'v': speed = atof(optarg); break;
+    case 's': seed = atoi(optarg); break;
+    default: return false;
+    }
+  }
+
+  return true;
+}
+
+static void print_help(int argc, char **argv)
+{
+  fprintf(stderr, "USAGE:\n");
+  fprintf(stderr, "%s [-o prefix] [options]\n", argv[0]);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Writes <prefix>.<frame>.bdat and the file list <prefix>.list\n");
+  fprintf(stderr, "\t--dims <n|nx,ny,nz>     Grid size (default 64)\n");
+  fprintf(stderr, "\t--lengths <l|lx,ly,lz>  Domain size (default 32)\n");
+  fprintf(stderr, "\t--frames <n>   Number of frames (default 8)\n");
+  fprintf(stderr, "\t--dt <t>       Time between frames (default 1)\n");
+  fprintf(stderr, "\t--straight <n> Number of straight vortex lines (default 4)\n");
+  fprintf(stderr, "\t--helices <n>  Number of helical vortex lines (default 2)\n");
+  fprintf(stderr, "\t--pairs <n>    Number of reconnecting pairs (default 2)\n");
+  fprintf(stderr, "\t--speed <v>    Speed of the vortices (default 0.5)\n");
+  fprintf(stderr, "\t--seed <s>     Random seed for the placement (default 1)\n");
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+  if (!parse_arg(argc, argv)) {
+    print_help(argc, argv);
+    return EXIT_FAILURE;
+  }
+
+  GLGPUSynthetic syn(dims, lengths);
+  syn.AddRandom(nstraight, nhelices, npairs, speed, seed);
+
+  const std::string filename_list = prefix + ".list";
+  FILE *fp = fopen(filename_list.c_str(), "w");
+  if (!fp) return EXIT_FAILURE;
+
+  for (int f=0; f<nframes; f++) {
+    std::ostringstream os;
+    os << prefix << "." << std::setw(4) << std::setfill('0') << f << ".bdat";
+    if (!syn.WriteBDAT(os.str(), f*dt)) {
+      fprintf(stderr, "failed to write %s\n", os.str().c_str());
+      return EXIT_FAILURE;
+    }
+    fprintf(fp, "%s\n", os.str().c_str());
+    fprintf(stderr, "frame=%d, t=%f, nlines=%d\n", f, f*dt, syn.NumLines(f*dt));
+  }
+
+  fclose(fp);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,331 @@
+#include "Isosurface.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cmath>
+#include <cfloat>
+#include <stdint.h>
+
+static const int brick_size = 8; // cells along each edge of a brick
+
+// corner c of a cube is at (c&1, (c>>1)&1, (c>>2)&1); edge e is along axis
+// e/4 and starts at corner edge_corners[e][0]
+static const int edge_corners[12][2] = {
+  {0, 1}, {2, 3}, {4, 5}, {6, 7}, // x
+  {0, 2}, {1, 3}, {4, 6}, {5, 7}, // y
+  {0, 4}, {1, 5}, {2, 6}, {3, 7}  // z
+};
+
+// corners of the faces, counterclockwise seen from outside the cube
+static const int face_corners[6][4] = {
+  {0, 4, 6, 2}, {1, 3, 7, 5}, // x=0, x=1
+  {0, 1, 5, 4}, {2, 6, 7, 3}, // y=0, y=1
+  {0, 2, 3, 1}, {4, 5, 7, 6}  // z=0, z=1
+};
+
+struct mc_table_t {
+  int ntris[256];
+  signed char tris[256][36]; // edges, three per triangle
+};
+
+// Builds the triangles of every case by walking the crossings around the faces.
+// A corner is inside if its value is below the isovalue.  On each face, walking
+// counterclockwise, every crossing into the inside is connected to the next
+// crossing out of it; this separates the inside corners of ambiguous faces,
+// the same way on both cubes sharing the face, so the surface is closed.  The
+// connections form closed loops over the cube edges, which are triangulated
+// as fans, counterclockwise seen from the outside (larger values).
+static mc_table_t build_mc_table()
+{
+  mc_table_t t;
+  int edge_of[8][8];
+  for (int e=0; e<12; e++) {
+    edge_of[edge_corners[e][0]][edge_corners[e][1]] = e;
+    edge_of[edge_corners[e][1]][edge_corners[e][0]] = e;
+  }
+
+  bool coplanar[12][12] = {{false}}; // edges on a common face
+  for (int f=0; f<6; f++)
+    for (int k=0; k<4; k++)
+      for (int l=0; l<4; l++)
+        coplanar[edge_of[face_corners[f][k]][face_corners[f][(k+1)%4]]]
+                [edge_of[face_corners[f][l]][face_corners[f][(l+1)%4]]] = true;
+
+  for (int c=0; c<256; c++) {
+    int next[12];
+    std::fill(next, next+12, -1);
+
+    for (int f=0; f<6; f++) {
+      int edges[4];
+      bool in[4];
+      for (int k=0; k<4; k++) {
+        in[k] = (c >> face_corners[f][k]) & 1;
+        edges[k] = edge_of[face_corners[f][k]][face_corners[f][(k+1)%4]];
+      }
+      for (int k=0; k<4; k++) {
+        if (in[k] || !in[(k+1)%4]) continue; // not a crossing into the inside
+        for (int l=1; l<4; l++) {
+          const int m = (k+l)%4;
+          if (in[m] && !in[(m+1)%4]) {
+            next[edges[k]] = edges[m];
+            break;
+          }
+        }
+      }
+    }
+
+    t.ntris[c] = 0;
+    bool visited[12] = {false};
+    for (int e0=0; e0<12; e0++) {
+      if (next[e0] < 0 || visited[e0]) continue;
+      std::vector<int> loop;
+      for (int e=e0; !visited[e]; e=next[e]) {
+        visited[e] = true;
+        loop.push_back(e);
+      }
+
+      // fan from a vertex none of whose diagonals lies on a face, where it
+      // could coincide with a segment of the neighboring cube
+      const int n = loop.size();
+      int apex = 0;
+      for (int a=0; a<n; a++) {
+        bool ok = true;
+        for (int k=2; k<n-1; k++)
+          ok = ok && !coplanar[loop[a]][loop[(a+k)%n]];
+        if (ok) {apex = a; break;}
+      }
+      for (int k=1; k<n-1; k++) {
+        signed char *tri = t.tris[c] + 3*t.ntris[c]++;
+        tri[0] = loop[apex];
+        tri[1] = loop[(apex+k)%n];
+        tri[2] = loop[(apex+k+1)%n];
+      }
+    }
+  }
+
+  return t;
+}
+
+static const mc_table_t& mc_table()
+{
+  static const mc_table_t t = build_mc_table();
+  return t;
+}
+
+static const uint32_t borrowed_bit = 0x80000000u;
+
+struct brick_output_t {
+  std::vector<float> vertices, normals;
+  std::vector<std::pair<uint64_t, uint32_t> > owned; // edge key -> local vertex, sorted by key
+  std::vector<uint64_t> borrowed; // edge keys of vertices owned by neighboring bricks
+  std::vector<uint32_t> indices; // local vertex, or borrowed_bit | index into borrowed
+};
+
+namespace {
+
+struct isosurface_ctx_t {
+  int dims[3], nb[3];
+  const float *origins, *cell_lengths, *field;
+  float isovalue;
+
+  size_t nid(int i, int j, int k) const {return i + dims[0] * (j + (size_t)dims[1] * k);}
+  uint64_t key(int axis, int i, int j, int k) const {
+    return (((uint64_t)axis * dims[2] + k) * dims[1] + j) * dims[0] + i;
+  }
+  void unkey(uint64_t key, int &axis, int idx[3]) const {
+    idx[0] = key % dims[0]; key /= dims[0];
+    idx[1] = key % dims[1]; key /= dims[1];
+    idx[2] = key % dims[2];
+    axis = key / dims[2];
+  }
+  int brick_of(const int idx[3]) const { // bricks past the last cells own the last nodes
+    int b[3];
+    for (int a=0; a<3; a++) b[a] = std::min(idx[a] / brick_size, nb[a] - 1);
+    return b[0] + nb[0] * (b[1] + nb[1] * b[2]);
+  }
+  void gradient(int i, int j, int k, float g[3]) const {
+    const int idx[3] = {i, j, k};
+    for (int a=0; a<3; a++) {
+      int lo[3] = {i, j, k}, hi[3] = {i, j, k};
+      if (idx[a] > 0) lo[a] --;
+      if (idx[a] < dims[a]-1) hi[a] ++;
+      g[a] = hi[a] == lo[a] ? 0 :
+        (field[nid(hi[0], hi[1], hi[2])] - field[nid(lo[0], lo[1], lo[2])]) / ((hi[a] - lo[a]) * cell_lengths[a]);
+    }
+  }
+
+  void brick_range(int b, float &lo, float &hi) const;
+  void process_brick(int b, brick_output_t& out) const;
+};
+
+}
+
+void isosurface_ctx_t::brick_range(int b, float &lo, float &hi) const
+{
+  const int bx = b % nb[0], by = (b / nb[0]) % nb[1], bz = b / (nb[0] * nb[1]);
+  lo = FLT_MAX;
+  hi = -FLT_MAX;
+  for (int k = bz*brick_size; k <= std::min((bz+1)*brick_size, dims[2]-1); k++)
+    for (int j = by*brick_size; j <= std::min((by+1)*brick_size, dims[1]-1); j++) {
+      const float *p = field + nid(bx*brick_size, j, k);
+      const int n = std::min((bx+1)*brick_size, dims[0]-1) - bx*brick_size + 1;
+      for (int i=0; i<n; i++) {
+        lo = std::min(lo, p[i]);
+        hi = std::max(hi, p[i]);
+      }
+    }
+}
+
+void isosurface_ctx_t::process_brick(int b, brick_output_t& out) const
+{
+  const mc_table_t &table = mc_table();
+  const int B1 = brick_size + 1;
+  const int o[3] = {(b % nb[0]) * brick_size, ((b / nb[0]) % nb[1]) * brick_size, (b / (nb[0] * nb[1])) * brick_size};
+  const int n[3] = {
+    std::min(brick_size, dims[0]-1 - o[0]),
+    std::min(brick_size, dims[1]-1 - o[1]),
+    std::min(brick_size, dims[2]-1 - o[2])};
+
+  // vertex of each edge of the brick, by axis and lower node
+  std::vector<uint32_t> vid(3 * B1*B1*B1, UINT32_MAX);
+
+  for (int k=0; k<n[2]; k++)
+    for (int j=0; j<n[1]; j++)
+      for (int i=0; i<n[0]; i++) {
+        const int I = o[0]+i, J = o[1]+j, K = o[2]+k;
+        float v[8];
+        int c = 0;
+        for (int m=0; m<8; m++) {
+          v[m] = field[nid(I + (m&1), J + ((m>>1)&1), K + ((m>>2)&1))];
+          if (v[m] < isovalue) c |= 1 << m;
+        }
+        if (c == 0 || c == 255) continue;
+
+        for (int t=0; t<3*table.ntris[c]; t++) {
+          const int e = table.tris[c][t], axis = e/4, c0 = edge_corners[e][0], c1 = edge_corners[e][1];
+          const int l[3] = {i + (c0&1), j + ((c0>>1)&1), k + ((c0>>2)&1)};
+          uint32_t &id = vid[axis * B1*B1*B1 + l[0] + B1 * (l[1] + B1 * l[2])];
+
+          if (id == UINT32_MAX) {
+            const int g[3] = {o[0]+l[0], o[1]+l[1], o[2]+l[2]};
+            const uint64_t key = this->key(axis, g[0], g[1], g[2]);
+            if (brick_of(g) != b) {
+              id = borrowed_bit | out.borrowed.size();
+              out.borrowed.push_back(key);
+            } else {
+              id = out.vertices.size() / 3;
+              out.owned.push_back(std::make_pair(key, id));
+
+              const float s = (isovalue - v[c0]) / (v[c1] - v[c0]);
+              float g0[3], g1[3], N[3];
+              int g1idx[3] = {g[0], g[1], g[2]};
+              g1idx[axis] ++;
+              gradient(g[0], g[1], g[2], g0);
+              gradient(g1idx[0], g1idx[1], g1idx[2], g1);
+              for (int a=0; a<3; a++) {
+                out.vertices.push_back(origins[a] + (g[a] + (a == axis ? s : 0.f)) * cell_lengths[a]);
+                N[a] = (1-s) * g0[a] + s * g1[a];
+              }
+              const float len = sqrt(N[0]*N[0] + N[1]*N[1] + N[2]*N[2]);
+              for (int a=0; a<3; a++)
+                out.normals.push_back(len > 0 ? N[a]/len : 0.f);
+            }
+          }
+          out.indices.push_back(id);
+        }
+      }
+
+  std::sort(out.owned.begin(), out.owned.end());
+}
+
+template <typename F>
+static void parallel_for(int n, int nthreads, F f)
+{
+  std::atomic<int> next(0);
+  std::vector<std::thread> threads;
+  for (int t=0; t<nthreads; t++)
+    threads.push_back(std::thread([&]() {
+      for (int i = next++; i < n; i = next++) f(i);
+    }));
+  for (int t=0; t<nthreads; t++)
+    threads[t].join();
+}
+
+void ExtractIsosurface(const int dims[3], const float origins[3], const float cell_lengths[3],
+    const float *field, float isovalue,
+    std::vector<float>& vertices, std::vector<float>& normals, std::vector<unsigned int>& indices,
+    int nthreads)
+{
+  vertices.clear();
+  normals.clear();
+  indices.clear();
+  if (dims[0] < 2 || dims[1] < 2 || dims[2] < 2) return;
+
+  if (nthreads <= 0) nthreads = std::thread::hardware_concurrency();
+  if (nthreads <= 0) nthreads = 1;
+
+  isosurface_ctx_t ctx;
+  for (int a=0; a<3; a++) {
+    ctx.dims[a] = dims[a];
+    ctx.nb[a] = (dims[a] - 1 + brick_size - 1) / brick_size;
+  }
+  ctx.origins = origins;
+  ctx.cell_lengths = cell_lengths;
+  ctx.field = field;
+  ctx.isovalue = isovalue;
+  mc_table(); // built before the threads start
+
+  // bricks whose value range contains the isovalue
+  const int nbricks = ctx.nb[0] * ctx.nb[1] * ctx.nb[2];
+  std::vector<char> active(nbricks);
+  parallel_for(nbricks, nthreads, [&](int b) {
+    float lo, hi;
+    ctx.brick_range(b, lo, hi);
+    active[b] = lo < isovalue && hi >= isovalue;
+  });
+
+  std::vector<int> bricks;
+  std::vector<int> slot(nbricks, -1);
+  for (int b=0; b<nbricks; b++)
+    if (active[b]) {
+      slot[b] = bricks.size();
+      bricks.push_back(b);
+    }
+
+  std::vector<brick_output_t> outs(bricks.size());
+  parallel_for(bricks.size(), nthreads, [&](int i) {ctx.process_brick(bricks[i], outs[i]);});
+
+  // global numbering in brick order
+  std::vector<size_t> voffsets(bricks.size()+1, 0), ioffsets(bricks.size()+1, 0);
+  for (int i=0; i<bricks.size(); i++) {
+    voffsets[i+1] = voffsets[i] + outs[i].vertices.size()/3;
+    ioffsets[i+1] = ioffsets[i] + outs[i].indices.size();
+  }
+  vertices.resize(voffsets.back()*3);
+  normals.resize(voffsets.back()*3);
+  indices.resize(ioffsets.back());
+
+  parallel_for(bricks.size(), nthreads, [&](int i) {
+    const brick_output_t &out = outs[i];
+    std::copy(out.vertices.begin(), out.vertices.end(), vertices.begin() + voffsets[i]*3);
+    std::copy(out.normals.begin(), out.normals.end(), normals.begin() + voffsets[i]*3);
+
+    for (size_t j=0; j<out.indices.size(); j++) {
+      const uint32_t id = out.indices[j];
+      if (!(id & borrowed_bit)) {
+        indices[ioffsets[i] + j] = voffsets[i] + id;
+        continue;
+      }
+
+      // the owner is active as well, since both ends of the edge are among its nodes
+      const uint64_t key = out.borrowed[id & ~borrowed_bit];
+      int axis, idx[3];
+      ctx.unkey(key, axis, idx);
+      const int owner = slot[ctx.brick_of(idx)];
+      const std::vector<std::pair<uint64_t, uint32_t> > &owned = outs[owner].owned;
+      const std::vector<std::pair<uint64_t, uint32_t> >::const_iterator it =
+        std::lower_bound(owned.begin(), owned.end(), std::make_pair(key, (uint32_t)0));
+      indices[ioffsets[i] + j] = voffsets[owner] + it->second;
+    }
+  });
+}
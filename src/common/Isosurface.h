@@ -0,0 +1,18 @@
+#ifndef _ISOSURFACE_H
+#define _ISOSURFACE_H
+
+#include <vector>
+
+// Marching cubes isosurface of a scalar field on the nodes of a regular grid
+// (x fastest).  Vertices are shared between adjacent triangles and cubes, and
+// normals are the interpolated central-difference gradients, pointing towards
+// larger values.  The grid is split into bricks of cells; bricks whose value
+// range does not contain the isovalue are skipped, and the others are
+// processed in threads (nthreads<=0: all cores).  The output does not depend
+// on the number of threads.
+void ExtractIsosurface(const int dims[3], const float origins[3], const float cell_lengths[3],
+    const float *field, float isovalue,
+    std::vector<float>& vertices, std::vector<float>& normals, std::vector<unsigned int>& indices,
+    int nthreads=0);
+
+#endif
@@ -1,4 +1,5 @@
 #include "MeshGraph.h"
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <cstdio>
@@ -77,6 +78,46 @@ void MeshGraph::Clear()
   edges.clear();
   faces.clear();
   cells.clear();
+  edge_nodes.clear();
+  face_node_offsets.clear();
+  face_nodes.clear();
+}
+
+void MeshGraph::BuildCSR()
+{
+  edge_nodes.resize(edges.size()*2);
+  for (size_t i=0; i<edges.size(); i++) {
+    edge_nodes[i*2] = edges[i].node0;
+    edge_nodes[i*2+1] = edges[i].node1;
+  }
+
+  face_node_offsets.resize(faces.size()+1);
+  face_node_offsets[0] = 0;
+  for (size_t i=0; i<faces.size(); i++)
+    face_node_offsets[i+1] = face_node_offsets[i] + faces[i].nodes.size();
+
+  face_nodes.resize(face_node_offsets.back());
+  for (size_t i=0; i<faces.size(); i++)
+    std::copy(faces[i].nodes.begin(), faces[i].nodes.end(), face_nodes.begin() + face_node_offsets[i]);
+}
+
+CEdge MeshGraph::Edge(EdgeIdType i, bool nodes_only) const
+{
+  if (!nodes_only || edge_nodes.empty()) return edges[i];
+
+  CEdge e;
+  e.node0 = edge_nodes[i*2];
+  e.node1 = edge_nodes[i*2+1];
+  return e;
+}
+
+CFace MeshGraph::Face(FaceIdType i, bool nodes_only) const
+{
+  if (!nodes_only || face_nodes.empty()) return faces[i];
+
+  CFace f;
+  f.nodes.assign(face_nodes.begin() + face_node_offsets[i], face_nodes.begin() + face_node_offsets[i+1]);
+  return f;
 }
 
 void MeshGraph::SerializeToString(std::string &str) const
@@ -198,6 +239,8 @@ bool MeshGraph::ParseFromString(const std::string& str)
 
     cells.push_back(cell);
   }
+
+  BuildCSR();
   return true;
 #else
   return false;
@@ -104,17 +104,23 @@ protected:
   std::vector<CFace> faces;
   std::vector<CCell> cells;
 
+  // nodes of edges and faces in compressed rows, for nodes_only queries
+  std::vector<NodeIdType> edge_nodes; // two per edge
+  std::vector<size_t> face_node_offsets;
+  std::vector<NodeIdType> face_nodes;
+
 public:
   ~MeshGraph();
   
   void Clear();
+  void BuildCSR(); // called once the graph is built or parsed
 
   virtual EdgeIdType NEdges() const {return edges.size();}
   virtual FaceIdType NFaces() const {return faces.size();}
   virtual CellIdType NCells() const {return cells.size();}
 
-  virtual CEdge Edge(EdgeIdType i, bool nodes_only=false) const {return edges[i];}
-  virtual CFace Face(FaceIdType i, bool nodes_only=false) const {return faces[i];} // second arg for acceleration
+  virtual CEdge Edge(EdgeIdType i, bool nodes_only=false) const;
+  virtual CFace Face(FaceIdType i, bool nodes_only=false) const; // second arg for acceleration
   virtual CCell Cell(CellIdType i, bool nodes_only=false) const {return cells[i];}
 
   void SerializeToString(std::string &str) const;
@@ -138,7 +144,7 @@ protected:
 class MeshGraphBuilder_Tet : public MeshGraphBuilder {
 public:
   explicit MeshGraphBuilder_Tet(int ncells, MeshGraph& mg);
-  ~MeshGraphBuilder_Tet() {}
+  ~MeshGraphBuilder_Tet() {_mg.BuildCSR();}
 
   void AddCell(
       CellIdType c, 
@@ -21,7 +21,7 @@ CCell MeshGraphRegular2D::Cell(CellIdType id, bool nodes_only) const
   // nodes
   const int nodes_idx[4][2] = {{i, j}, {i+1, j}, {i+1, j+1}, {i, j+1}};
   for (int p=0; p<4; p++) // don't worry about modIdx here. automatically done in idx2id()
-    cell.nodes.push_back(nidx2nid(nodes_idx[i]));
+    cell.nodes.push_back(nidx2nid(nodes_idx[p]));
   if (nodes_only) return cell;
 
   // faces
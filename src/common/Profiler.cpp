@@ -0,0 +1,85 @@
+#include "Profiler.h"
+#include <mutex>
+#include <vector>
+
+bool Profiler::_enabled = false;
+
+static std::mutex prof_mutex;
+static std::vector<Profiler::Slot*> prof_slots, prof_free_slots;
+static uint64_t prof_last_ns[PROF_NPHASES], prof_last_counters[PROF_NCOUNTERS];
+static FILE *prof_fp = NULL;
+
+// slots hold running totals, so the slot of a finished thread is kept and
+// handed to the next new thread instead of being freed
+struct prof_slot_holder_t {
+  Profiler::Slot *slot;
+
+  prof_slot_holder_t() {
+    std::lock_guard<std::mutex> lock(prof_mutex);
+    if (!prof_free_slots.empty()) {
+      slot = prof_free_slots.back();
+      prof_free_slots.pop_back();
+    } else {
+      slot = new Profiler::Slot;
+      for (int i=0; i<PROF_NPHASES; i++) slot->ns[i] = 0;
+      for (int i=0; i<PROF_NCOUNTERS; i++) slot->counters[i] = 0;
+      prof_slots.push_back(slot);
+    }
+  }
+
+  ~prof_slot_holder_t() {
+    std::lock_guard<std::mutex> lock(prof_mutex);
+    prof_free_slots.push_back(slot);
+  }
+};
+
+Profiler::Slot& Profiler::LocalSlot()
+{
+  static thread_local prof_slot_holder_t holder;
+  return *holder.slot;
+}
+
+void Profiler::SetOutput(FILE *fp)
+{
+  std::lock_guard<std::mutex> lock(prof_mutex);
+  prof_fp = fp;
+}
+
+const char* Profiler::PhaseName(int phase)
+{
+  static const char *names[PROF_NPHASES] = {
+    "load", "faces", "edges", "trace_space", "trace_time", "relate", "save", "ensemble", "density"};
+  return names[phase];
+}
+
+const char* Profiler::CounterName(int counter)
+{
+  static const char *names[PROF_NCOUNTERS] = {
+    "faces_tested", "edges_tested", "punctures", "bytes_read", "db_bytes_written"};
+  return names[counter];
+}
+
+void Profiler::EndFrame(int timestep)
+{
+  if (!_enabled) return;
+  std::lock_guard<std::mutex> lock(prof_mutex);
+
+  uint64_t ns[PROF_NPHASES] = {0}, counters[PROF_NCOUNTERS] = {0};
+  for (int j=0; j<prof_slots.size(); j++) {
+    for (int i=0; i<PROF_NPHASES; i++) ns[i] += prof_slots[j]->ns[i].load(std::memory_order_relaxed);
+    for (int i=0; i<PROF_NCOUNTERS; i++) counters[i] += prof_slots[j]->counters[i].load(std::memory_order_relaxed);
+  }
+
+  FILE *fp = prof_fp ? prof_fp : stderr;
+  fprintf(fp, "{\"timestep\":%d", timestep);
+  for (int i=0; i<PROF_NPHASES; i++) {
+    fprintf(fp, ",\"t_%s\":%.6f", PhaseName(i), (ns[i] - prof_last_ns[i]) * 1e-9);
+    prof_last_ns[i] = ns[i];
+  }
+  for (int i=0; i<PROF_NCOUNTERS; i++) {
+    fprintf(fp, ",\"%s\":%llu", CounterName(i), (unsigned long long)(counters[i] - prof_last_counters[i]));
+    prof_last_counters[i] = counters[i];
+  }
+  fprintf(fp, "}\n");
+  fflush(fp);
+}
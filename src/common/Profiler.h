@@ -0,0 +1,95 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdint.h>
+
+enum {
+  PROF_LOAD = 0, // reading a timestep
+  PROF_FACES, // extracting punctured faces
+  PROF_EDGES, // extracting punctured space-time edges
+  PROF_TRACE_SPACE,
+  PROF_TRACE_TIME,
+  PROF_RELATE,
+  PROF_SAVE, // vortex lines, archives and checkpoints
+  PROF_ENSEMBLE, // stochastic runs
+  PROF_DENSITY,
+  PROF_NPHASES
+};
+
+enum {
+  PROF_FACES_TESTED = 0,
+  PROF_EDGES_TESTED,
+  PROF_PUNCTURES,
+  PROF_BYTES_READ,
+  PROF_DB_BYTES_WRITTEN,
+  PROF_NCOUNTERS
+};
+
+/*
+ * \class   Profiler
+ * \brief   Per-phase timers and event counters.  Each thread accumulates
+ *          into its own slot, so recording never takes a lock; when the
+ *          profiler is disabled (the default) every call returns after a
+ *          single test of a global flag.  EndFrame() writes the totals
+ *          since the previous frame as one JSON object per line.  Times
+ *          of nested phases are included in the enclosing ones, and
+ *          times of concurrent threads add up; work done ahead by other
+ *          threads is reported with the frame during which it finished.
+*/
+class Profiler
+{
+public:
+  static void SetEnabled(bool b) {_enabled = b;}
+  static bool Enabled() {return _enabled;}
+  static void SetOutput(FILE *fp); // stderr by default
+
+  static void Count(int counter, uint64_t n=1) {
+    if (_enabled) Add(LocalSlot().counters[counter], n);
+  }
+  static void AddTime(int phase, uint64_t ns) {
+    if (_enabled) Add(LocalSlot().ns[phase], ns);
+  }
+
+  // totals over all threads since the last frame, written with the given timestep
+  static void EndFrame(int timestep);
+
+  static const char* PhaseName(int phase);
+  static const char* CounterName(int counter);
+
+public:
+  struct Slot {
+    std::atomic<uint64_t> ns[PROF_NPHASES], counters[PROF_NCOUNTERS];
+  };
+
+private:
+  // only the owning thread writes its slot, so a relaxed load and store suffice
+  static void Add(std::atomic<uint64_t>& v, uint64_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  static Slot& LocalSlot();
+
+  static bool _enabled;
+};
+
+// times the enclosing scope as the given phase
+class ProfileScope
+{
+public:
+  explicit ProfileScope(int phase) : _phase(Profiler::Enabled() ? phase : -1) {
+    if (_phase >= 0) _t0 = clock::now();
+  }
+  ~ProfileScope() {
+    if (_phase >= 0)
+      Profiler::AddTime(_phase, std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - _t0).count());
+  }
+
+private:
+  typedef std::chrono::steady_clock clock;
+  int _phase;
+  clock::time_point _t0;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "RegionOfInterest.h"
+#include "Inclusions.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+
+void RegionOfInterest::AddBox(const float LB[3], const float UB[3])
+{
+  for (int k=0; k<3; k++)
+    _boxes.push_back(std::min(LB[k], UB[k]));
+  for (int k=0; k<3; k++)
+    _boxes.push_back(std::max(LB[k], UB[k]));
+}
+
+void RegionOfInterest::AddInclusions(const Inclusions& inc, float margin)
+{
+  const float r = inc.Radius() + margin;
+  for (int i=0; i<inc.Count(); i++) {
+    const float LB[3] = {inc.x(i) - r, inc.y(i) - r, inc.z(i) - r},
+                UB[3] = {inc.x(i) + r, inc.y(i) + r, inc.z(i) + r};
+    AddBox(LB, UB);
+  }
+}
+
+bool RegionOfInterest::ParseFromString(const std::string& str)
+{
+  size_t p = 0;
+  while (p < str.size()) {
+    size_t q = str.find(';', p);
+    if (q == std::string::npos) q = str.size();
+
+    float b[6];
+    if (sscanf(str.substr(p, q-p).c_str(), "%f,%f,%f,%f,%f,%f", 
+          &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) 
+      return false;
+    AddBox(b, b+3);
+    p = q+1;
+  }
+  return !Empty();
+}
+
+bool RegionOfInterest::Contains(const float X[3]) const
+{
+  for (size_t i=0; i<_boxes.size(); i+=6) {
+    const float *LB = &_boxes[i], *UB = &_boxes[i+3];
+    if (X[0] >= LB[0] - _halo && X[0] <= UB[0] + _halo && 
+        X[1] >= LB[1] - _halo && X[1] <= UB[1] + _halo && 
+        X[2] >= LB[2] - _halo && X[2] <= UB[2] + _halo)
+      return true;
+  }
+  return false;
+}
+
+void RegionOfInterest::Bounds(float LB[3], float UB[3]) const
+{
+  for (int k=0; k<3; k++) {
+    LB[k] = FLT_MAX;
+    UB[k] = -FLT_MAX;
+  }
+  for (size_t i=0; i<_boxes.size(); i+=6)
+    for (int k=0; k<3; k++) {
+      LB[k] = std::min(LB[k], _boxes[i+k] - _halo);
+      UB[k] = std::max(UB[k], _boxes[i+3+k] + _halo);
+    }
+}
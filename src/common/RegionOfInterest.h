@@ -0,0 +1,37 @@
+#ifndef _REGION_OF_INTEREST_H
+#define _REGION_OF_INTEREST_H
+
+#include <vector>
+#include <string>
+
+class Inclusions;
+
+/*
+ * \class   RegionOfInterest
+ * \brief   Union of axis-aligned boxes in domain coordinates, each grown by
+ *          a halo.  Boxes do not wrap around periodic boundaries.
+*/
+class RegionOfInterest {
+public:
+  RegionOfInterest() : _halo(0) {}
+
+  void AddBox(const float LB[3], const float UB[3]);
+  void AddInclusions(const Inclusions&, float margin); // a cube around each inclusion
+  void SetHalo(float halo) {_halo = halo;}
+  void Clear() {_boxes.clear();}
+
+  bool ParseFromString(const std::string& str); // "x0,y0,z0,x1,y1,z1[;...]"
+
+  bool Empty() const {return _boxes.empty();}
+  int NBoxes() const {return _boxes.size()/6;}
+  float Halo() const {return _halo;}
+
+  bool Contains(const float X[3]) const; // in any box grown by the halo
+  void Bounds(float LB[3], float UB[3]) const; // of the grown boxes
+
+private:
+  std::vector<float> _boxes; // LB and UB of each box
+  float _halo;
+};
+
+#endif
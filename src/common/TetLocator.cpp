@@ -0,0 +1,163 @@
+#include "TetLocator.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const float tolerance = 1e-6; // of barycentric coordinates
+static const int max_walk = 64; // steps before falling back to the grid
+
+void TetLocator::Clear()
+{
+  _tets.clear();
+  _neighbors.clear();
+  _bucket_offsets.clear();
+  _bucket_tets.clear();
+}
+
+void TetLocator::Build(int nnodes, const float *X, int ntets, const unsigned int *tets,
+    const unsigned int *neighbors)
+{
+  Clear();
+
+  for (int k=0; k<3; k++) {
+    _LB[k] = FLT_MAX;
+    _UB[k] = -FLT_MAX;
+  }
+  for (int i=0; i<nnodes; i++)
+    for (int k=0; k<3; k++) {
+      _LB[k] = std::min(_LB[k], X[i*3+k]);
+      _UB[k] = std::max(_UB[k], X[i*3+k]);
+    }
+
+  _tets.resize(ntets);
+  _neighbors.assign(ntets*4, UINT_MAX);
+
+  for (int t=0; t<ntets; t++) {
+    const unsigned int *n = tets + t*4;
+    Tet &tet = _tets[t];
+    std::fill(tet.M, tet.M+9, NAN);
+    if (n[0] == UINT_MAX) continue;
+
+    // invert the matrix whose columns are the edges from node 0
+    double E[3][3];
+    for (int k=0; k<3; k++) {
+      tet.O[k] = X[n[0]*3+k];
+      for (int j=0; j<3; j++)
+        E[k][j] = (double)X[n[j+1]*3+k] - X[n[0]*3+k];
+    }
+    const double det =
+      E[0][0] * (E[1][1]*E[2][2] - E[1][2]*E[2][1]) -
+      E[0][1] * (E[1][0]*E[2][2] - E[1][2]*E[2][0]) +
+      E[0][2] * (E[1][0]*E[2][1] - E[1][1]*E[2][0]);
+    if (det == 0) continue;
+
+    for (int r=0; r<3; r++)
+      for (int c=0; c<3; c++) {
+        const int r1 = (c+1)%3, r2 = (c+2)%3, c1 = (r+1)%3, c2 = (r+2)%3;
+        tet.M[r*3+c] = (E[r1][c1]*E[r2][c2] - E[r1][c2]*E[r2][c1]) / det;
+      }
+
+    for (int i=0; i<4; i++) {
+      const unsigned int nb = neighbors[t*4+i];
+      if (nb == UINT_MAX || tets[nb*4] == UINT_MAX) continue;
+      for (int j=0; j<4; j++) // the node not shared with the neighbor
+        if (std::find(tets + nb*4, tets + nb*4 + 4, n[j]) == tets + nb*4 + 4) {
+          _neighbors[t*4+j] = nb;
+          break;
+        }
+    }
+  }
+
+  // about one bucket per tet
+  double volume = 1;
+  for (int k=0; k<3; k++)
+    volume *= std::max(_UB[k] - _LB[k], FLT_MIN);
+  const double h = cbrt(volume / std::max(ntets, 1));
+  for (int k=0; k<3; k++) {
+    _gdims[k] = std::max(1, std::min(1024, (int)ceil((_UB[k] - _LB[k]) / h)));
+    _gscale[k] = _UB[k] > _LB[k] ? _gdims[k] / (_UB[k] - _LB[k]) : 0;
+  }
+
+  const auto bucket_range = [&](int t, int lo[3], int hi[3]) {
+    const unsigned int *n = tets + t*4;
+    for (int k=0; k<3; k++) {
+      float l = FLT_MAX, u = -FLT_MAX;
+      for (int j=0; j<4; j++) {
+        l = std::min(l, X[n[j]*3+k]);
+        u = std::max(u, X[n[j]*3+k]);
+      }
+      lo[k] = std::min(_gdims[k]-1, (int)((l - _LB[k]) * _gscale[k]));
+      hi[k] = std::min(_gdims[k]-1, (int)((u - _LB[k]) * _gscale[k]));
+    }
+  };
+
+  const size_t nbuckets = (size_t)_gdims[0] * _gdims[1] * _gdims[2];
+  _bucket_offsets.assign(nbuckets+1, 0);
+  for (int pass=0; pass<2; pass++) {
+    std::vector<unsigned int> fill;
+    if (pass == 1) {
+      for (size_t b=0; b<nbuckets; b++)
+        _bucket_offsets[b+1] += _bucket_offsets[b];
+      _bucket_tets.resize(_bucket_offsets[nbuckets]);
+      fill.assign(_bucket_offsets.begin(), _bucket_offsets.end()-1);
+    }
+
+    for (int t=0; t<ntets; t++) {
+      if (std::isnan(_tets[t].M[0])) continue;
+      int lo[3], hi[3];
+      bucket_range(t, lo, hi);
+      for (int z=lo[2]; z<=hi[2]; z++)
+        for (int y=lo[1]; y<=hi[1]; y++)
+          for (int x=lo[0]; x<=hi[0]; x++) {
+            const size_t b = x + _gdims[0] * (y + (size_t)_gdims[1] * z);
+            if (pass == 0) _bucket_offsets[b+1] ++;
+            else _bucket_tets[fill[b]++] = t;
+          }
+    }
+  }
+}
+
+bool TetLocator::Barycentric(unsigned int t, const float X[3], float lambda[4]) const
+{
+  const Tet &tet = _tets[t];
+  const float d[3] = {X[0] - tet.O[0], X[1] - tet.O[1], X[2] - tet.O[2]};
+  for (int i=0; i<3; i++)
+    lambda[i+1] = tet.M[i*3] * d[0] + tet.M[i*3+1] * d[1] + tet.M[i*3+2] * d[2];
+  lambda[0] = 1 - lambda[1] - lambda[2] - lambda[3];
+  return !std::isnan(lambda[0]);
+}
+
+unsigned int TetLocator::Locate(const float X[3], unsigned int &hint) const
+{
+  float lambda[4];
+
+  unsigned int t = hint < _tets.size() ? hint : UINT_MAX;
+  for (int step=0; t != UINT_MAX && step<max_walk; step++) {
+    if (!Barycentric(t, X, lambda)) break;
+    const int j = std::min_element(lambda, lambda+4) - lambda;
+    if (lambda[j] >= -tolerance) {
+      hint = t;
+      return t;
+    }
+    t = _neighbors[t*4+j]; // UINT_MAX if the walk leaves the mesh
+  }
+
+  if (_tets.empty()) return UINT_MAX;
+  int g[3];
+  for (int k=0; k<3; k++) {
+    if (!(X[k] >= _LB[k] && X[k] <= _UB[k])) return UINT_MAX;
+    g[k] = std::min(_gdims[k]-1, (int)((X[k] - _LB[k]) * _gscale[k]));
+  }
+
+  const size_t b = g[0] + _gdims[0] * (g[1] + (size_t)_gdims[1] * g[2]);
+  for (unsigned int i=_bucket_offsets[b]; i<_bucket_offsets[b+1]; i++) {
+    t = _bucket_tets[i];
+    Barycentric(t, X, lambda);
+    if (*std::min_element(lambda, lambda+4) >= -tolerance) {
+      hint = t;
+      return t;
+    }
+  }
+
+  return UINT_MAX;
+}
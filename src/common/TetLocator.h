@@ -0,0 +1,54 @@
+#ifndef _TET_LOCATOR_H
+#define _TET_LOCATOR_H
+
+#include <vector>
+#include <climits>
+
+/*
+ * \class   TetLocator
+ * \brief   Point location in a tetrahedral mesh.  A query first walks from
+ *          a hint tet towards the point across the faces of negative
+ *          barycentric coordinates, and falls back to a uniform grid of
+ *          buckets over the bounding box.  The locator is immutable after
+ *          Build(), so queries from several threads are safe as long as
+ *          each thread keeps its own hint.
+*/
+class TetLocator
+{
+public:
+  TetLocator() {}
+
+  // tets: four node ids per tet, or UINT_MAX for missing tets; neighbors:
+  // four tet ids per tet in any order, UINT_MAX on the boundary
+  void Build(int nnodes, const float *coords, int ntets, const unsigned int *tets,
+      const unsigned int *neighbors);
+  void Clear();
+
+  bool Empty() const {return _tets.empty();}
+  const float* LB() const {return _LB;} // bounding box of the nodes
+  const float* UB() const {return _UB;}
+
+  // returns the tet containing X, or UINT_MAX; hint is the tet of the
+  // previous query of the caller (UINT_MAX if none) and is updated
+  unsigned int Locate(const float X[3], unsigned int &hint) const;
+  unsigned int Locate(const float X[3]) const {unsigned int hint = UINT_MAX; return Locate(X, hint);}
+
+  // barycentric coordinates of X in tet t; false for degenerate tets
+  bool Barycentric(unsigned int t, const float X[3], float lambda[4]) const;
+
+private:
+  struct Tet {
+    float O[3]; // node 0
+    float M[9]; // maps X-O to the barycentric coordinates of nodes 1-3, row major
+  };
+
+  std::vector<Tet> _tets;
+  std::vector<unsigned int> _neighbors; // the i-th is across the face opposite to node i
+
+  float _LB[3], _UB[3];
+  int _gdims[3];
+  float _gscale[3]; // buckets per unit length
+  std::vector<unsigned int> _bucket_offsets, _bucket_tets; // tets overlapping each bucket
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "VortexFrameStore.h"
+#include <sstream>
+#include <cstdio>
+#include <algorithm>
+
+VortexFrameStore::VortexFrameStore() :
+#if WITH_ROCKSDB
+  _db(NULL),
+#endif
+  _capacity(512*1024*1024), // 512 MB
+  _bytes(0),
+  _read_ahead(2),
+  _stop(false)
+{
+}
+
+VortexFrameStore::~VortexFrameStore()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cond_read_ahead.notify_all();
+
+  if (_read_ahead_thread.joinable())
+    _read_ahead_thread.join();
+}
+
+#if WITH_ROCKSDB
+void VortexFrameStore::SetDB(rocksdb::DB* db)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  Reset(lock);
+  _db = db;
+}
+#endif
+
+void VortexFrameStore::SetDataName(const std::string& dataname)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  Reset(lock);
+  _dataname = dataname;
+}
+
+void VortexFrameStore::SetFrames(const std::vector<int>& frames)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _frames = frames;
+  _frame_index.clear();
+  for (int i=0; i<frames.size(); i++)
+    _frame_index[frames[i]] = i;
+}
+
+void VortexFrameStore::SetCapacity(size_t bytes)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _capacity = bytes;
+  Evict();
+}
+
+void VortexFrameStore::SetReadAhead(int n)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _read_ahead = std::max(0, n);
+}
+
+void VortexFrameStore::SetPostProcessor(const PostProcessor& pp)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  Reset(lock); // cached frames were processed differently
+  _post_processor = pp;
+}
+
+void VortexFrameStore::Clear()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  Reset(lock);
+}
+
+void VortexFrameStore::Reset(std::unique_lock<std::mutex>& lock)
+{
+  // wait for in-flight decoding, which may still use the old source
+  _read_ahead_queue.clear();
+  while (!_loading.empty())
+    _cond_loaded.wait(lock);
+
+  _cache.clear();
+  _lru.clear();
+  _bytes = 0;
+}
+
+size_t VortexFrameStore::Bytes() const
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _bytes;
+}
+
+int VortexFrameStore::NFrames() const
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _cache.size();
+}
+
+VortexFrameStore::FramePtr VortexFrameStore::Get(int frame)
+{
+  FramePtr ptr = Acquire(frame);
+  ScheduleReadAhead(frame);
+  return ptr;
+}
+
+void VortexFrameStore::Prefetch(int frame)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (_cache.find(frame) != _cache.end() || _loading.find(frame) != _loading.end())
+    return;
+
+  _read_ahead_queue.push_back(frame);
+  if (!_read_ahead_thread.joinable())
+    _read_ahead_thread = std::thread(&VortexFrameStore::ReadAheadThread, this);
+  _cond_read_ahead.notify_one();
+}
+
+VortexFrameStore::FramePtr VortexFrameStore::Acquire(int frame)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+
+  while (1) {
+    std::map<int, Entry>::iterator it = _cache.find(frame);
+    if (it != _cache.end()) { // hit
+      _lru.splice(_lru.begin(), _lru, it->second.lru);
+      return it->second.ptr;
+    }
+
+    if (_loading.find(frame) == _loading.end()) break;
+    _cond_loaded.wait(lock); // another reader is decoding the same frame
+  }
+
+  _loading.insert(frame);
+  lock.unlock();
+
+  FramePtr ptr = Load(frame);
+
+  lock.lock();
+  _loading.erase(frame);
+  if (ptr) Insert(frame, ptr);
+  _cond_loaded.notify_all();
+
+  return ptr;
+}
+
+VortexFrameStore::FramePtr VortexFrameStore::Load(int frame) const
+{
+  std::string buf;
+
+#if WITH_ROCKSDB
+  if (_db != NULL) {
+    std::stringstream ss;
+    ss << "v." << frame;
+    rocksdb::Status s = _db->Get(rocksdb::ReadOptions(), ss.str(), &buf);
+    if (!s.ok() || buf.empty()) return FramePtr();
+  }
+#endif
+
+  std::shared_ptr<Frame> vlines(new Frame);
+
+  if (!buf.empty())
+    diy::unserialize(buf, *vlines);
+  else {
+    std::stringstream ss;
+    ss << _dataname << ".vlines." << frame;
+    const std::string filename = ss.str();
+
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp) return FramePtr();
+    fclose(fp);
+
+    diy::unserializeFromFile(filename, *vlines);
+  }
+
+  if (_post_processor) {
+    std::vector<VortexLine> lines;
+    vlines->ToVortexLines(lines);
+    _post_processor(lines);
+    *vlines = VortexLineSet(lines);
+  }
+
+  return vlines;
+}
+
+void VortexFrameStore::Insert(int frame, const FramePtr& ptr)
+{
+  if (_cache.find(frame) != _cache.end()) return;
+
+  Entry e;
+  e.ptr = ptr;
+  e.bytes = ptr->Bytes();
+  _lru.push_front(frame);
+  e.lru = _lru.begin();
+
+  _cache[frame] = e;
+  _bytes += e.bytes;
+
+  Evict();
+}
+
+void VortexFrameStore::Evict()
+{
+  while (_bytes > _capacity && _lru.size() > 1) { // always keep the most recent frame
+    const int frame = _lru.back();
+    std::map<int, Entry>::iterator it = _cache.find(frame);
+    _bytes -= it->second.bytes;
+    _cache.erase(it);
+    _lru.pop_back();
+  }
+}
+
+void VortexFrameStore::ScheduleReadAhead(int frame)
+{
+  std::vector<int> neighbors;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_read_ahead == 0) return;
+
+    std::map<int, int>::const_iterator it = _frame_index.find(frame);
+    for (int k=1; k<=_read_ahead; k++) {
+      if (it != _frame_index.end()) {
+        const int i = it->second;
+        if (i+k < _frames.size()) neighbors.push_back(_frames[i+k]);
+        if (i-k >= 0) neighbors.push_back(_frames[i-k]);
+      } else if (_frames.empty()) {
+        neighbors.push_back(frame+k);
+        if (frame-k >= 0) neighbors.push_back(frame-k);
+      }
+    }
+  }
+
+  for (int i=0; i<neighbors.size(); i++)
+    Prefetch(neighbors[i]);
+}
+
+void VortexFrameStore::ReadAheadThread()
+{
+  while (1) {
+    int frame;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (!_stop && _read_ahead_queue.empty())
+        _cond_read_ahead.wait(lock);
+      if (_stop) return;
+
+      frame = _read_ahead_queue.front();
+      _read_ahead_queue.pop_front();
+    }
+
+    Acquire(frame);
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef _VORTEX_FRAME_STORE_H
+#define _VORTEX_FRAME_STORE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "def.h"
+#include "common/VortexLine.h"
+#include "common/VortexLineSet.h"
+
+#if WITH_ROCKSDB
+#include <rocksdb/db.h>
+#endif
+
+/*
+ * \class   VortexFrameStore
+ * \brief   Random-access reader of per-frame vortex lines ("v.<frame>" in
+ *          the DB, or <dataname>.vlines.<frame> on disk), keeping a
+ *          size-bounded LRU cache of decoded and post-processed frames and
+ *          reading neighboring frames ahead in the background.  Frames are
+ *          kept as line sets, whose trees are reused while cached.  Safe
+ *          for concurrent readers.
+*/
+class VortexFrameStore
+{
+public:
+  typedef VortexLineSet Frame;
+  typedef std::shared_ptr<const Frame> FramePtr;
+  typedef std::function<void(std::vector<VortexLine>&)> PostProcessor;
+
+  VortexFrameStore();
+  ~VortexFrameStore();
+
+#if WITH_ROCKSDB
+  void SetDB(rocksdb::DB* db);
+#endif
+  void SetDataName(const std::string& dataname); // used if no DB is set
+  void SetFrames(const std::vector<int>& frames); // frame ids in order, for read-ahead
+  void SetCapacity(size_t bytes);
+  void SetReadAhead(int n); // number of frames to read ahead in both directions; 0 disables
+  void SetPostProcessor(const PostProcessor& pp); // applied once per frame before caching, on unpacked lines
+
+  FramePtr Get(int frame); // returns NULL if the frame cannot be loaded
+  void Prefetch(int frame);
+  void Clear();
+
+  size_t Bytes() const;
+  int NFrames() const;
+
+private:
+  void Reset(std::unique_lock<std::mutex>& lock); // drops all frames once no decoding is in flight
+  FramePtr Acquire(int frame);
+  FramePtr Load(int frame) const;
+  void Insert(int frame, const FramePtr& ptr); // requires _mutex
+  void Evict(); // requires _mutex
+  void ScheduleReadAhead(int frame);
+  void ReadAheadThread();
+
+private:
+#if WITH_ROCKSDB
+  rocksdb::DB *_db;
+#endif
+  std::string _dataname;
+  std::vector<int> _frames;
+  std::map<int, int> _frame_index; // frame id -> index in _frames
+  PostProcessor _post_processor;
+
+  size_t _capacity, _bytes;
+  int _read_ahead;
+
+  struct Entry {
+    FramePtr ptr;
+    size_t bytes;
+    std::list<int>::iterator lru;
+  };
+  std::map<int, Entry> _cache;
+  std::list<int> _lru; // most recently used first
+  std::set<int> _loading;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cond_loaded;
+
+  std::deque<int> _read_ahead_queue;
+  std::condition_variable _cond_read_ahead;
+  std::thread _read_ahead_thread;
+  bool _stop;
+};
+
+#endif
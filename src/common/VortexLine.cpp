@@ -1,11 +1,14 @@
 #include "VortexLine.h"
 #include "common/Utils.hpp"
+#include "common/VortexLineBVH.h"
 #include "fitCurves/fitCurves.hpp"
 #include "fitCurves/psimpl.h"
 #include <climits>
 #include <cfloat>
 #include <cassert>
 #include <cmath>
+#include <atomic>
+#include <thread>
 
 #if WITH_VTK
 #include <vtkSmartPointer.h>
@@ -36,27 +39,40 @@ void VortexLine::Print() const {
         at(i*3), at(i*3+1), at(i*3+2));
 }
 
-void VortexLine::Simplify(float tolorance)
+// scratch buffers of the post-processing steps, reused across lines
+struct vortex_line_scratch_t {
+  std::vector<float> buf;
+  std::vector<FitCurves::Point<3> > pts, pts1;
+};
+
+static void simplify_line(VortexLine& l, float tolorance, vortex_line_scratch_t& s)
 {
-  if (is_bezier) return;
+  if (l.is_bezier) return;
 
-  std::vector<float> R;
-  psimpl::simplify_reumann_witkam<3>(begin(), end(), tolorance, std::back_inserter(R));
-  // psimpl::simplify_douglas_peucker<3>(begin(), end(), tolorance, std::back_inserter(R));
+  s.buf.clear();
+  psimpl::simplify_reumann_witkam<3>(l.begin(), l.end(), tolorance, std::back_inserter(s.buf));
+  // psimpl::simplify_douglas_peucker<3>(l.begin(), l.end(), tolorance, std::back_inserter(s.buf));
   
-  const int n0 = size()/3, n1 = R.size()/3;
-  swap(R);
-  // fprintf(stderr, "n0=%d, n1=%d\n", n0, n1);
+  l.swap(s.buf);
+  l.InvalidateCaches();
+}
+
+void VortexLine::Simplify(float tolorance)
+{
+  vortex_line_scratch_t s;
+  simplify_line(*this, tolorance, s);
 }
 
-void VortexLine::RemoveInvalidPoints() {
-  if (is_bezier) return;
+static void remove_invalid_points(VortexLine& l, vortex_line_scratch_t& s)
+{
+  if (l.is_bezier) return;
 
-  std::vector<float> R;
+  std::vector<float> &R = s.buf;
+  R.clear();
   float lastPt[3];
 
-  for (int i=0; i<size()/3; i++) {
-    float currentPt[3] = {at(i*3), at(i*3+1), at(i*3+2)};
+  for (int i=0; i<l.size()/3; i++) {
+    float currentPt[3] = {l[i*3], l[i*3+1], l[i*3+2]};
 
     bool valid = true;
     for (int j=0; j<3; j++) if (std::isnan(currentPt[j]) || std::isinf(currentPt[j])) valid = false;
@@ -74,40 +90,52 @@ void VortexLine::RemoveInvalidPoints() {
     R.push_back(currentPt[1]);
     R.push_back(currentPt[2]);
   }
-  swap(R);
+  l.swap(R);
+  l.InvalidateCaches();
 }
 
-void VortexLine::ToBezier(float error_bound)
+void VortexLine::RemoveInvalidPoints() 
+{
+  vortex_line_scratch_t s;
+  remove_invalid_points(*this, s);
+}
+
+static void bezier_line(VortexLine& l, float error_bound, vortex_line_scratch_t& s)
 {
   using namespace FitCurves;
   typedef Point<3> Pt;
   float tot_error;
 
-  if (is_bezier) return;
+  if (l.is_bezier) return;
 
-  int npts = size()/3;
-  Pt *pts = (Pt*)malloc(npts*3*sizeof(Pt));
+  int npts = l.size()/3;
+  s.pts.resize(npts*3+1); // fit_curves may read past the last point
+  s.pts1.resize(npts*4+1);
+  Pt *pts = s.pts.data(), *pts1 = s.pts1.data();
 
   for (int i=0; i<npts; i++) {
-    pts[i][0] = this->at(i*3);
-    pts[i][1] = this->at(i*3+1);
-    pts[i][2] = this->at(i*3+2);
+    pts[i][0] = l[i*3];
+    pts[i][1] = l[i*3+1];
+    pts[i][2] = l[i*3+2];
   }
 
-  Pt *pts1 = (Pt*)malloc(npts*4*sizeof(Pt));
   const int npts1 = fit_curves(npts, pts, error_bound, pts1, tot_error);
 
-  clear();
+  l.clear();
   for (int i=0; i<npts1; i++) {
-    push_back(pts1[i][0]);
-    push_back(pts1[i][1]);
-    push_back(pts1[i][2]);
+    l.push_back(pts1[i][0]);
+    l.push_back(pts1[i][1]);
+    l.push_back(pts1[i][2]);
   }
 
-  free(pts);
-  free(pts1);
+  l.is_bezier = true;
+  l.InvalidateCaches();
+}
 
-  is_bezier = true;
+void VortexLine::ToBezier(float error_bound)
+{
+  vortex_line_scratch_t s;
+  bezier_line(*this, error_bound, s);
 }
 
 float VortexLine::Length() const
@@ -209,19 +237,55 @@ bool VortexLine::Bezier(float t, float X[3]) const // t \in [0, 1]
   return true;
 }
 
-void VortexLine::ToRegular(int N)
+// samples N points uniformly in the curve parameter; same arithmetic as 
+// Bezier() and FitCurves::bezier(), without allocating per sample
+static void regular_line(VortexLine& l, int N, vortex_line_scratch_t& s)
 {
-  length_seg.clear(); 
-  length_acc.clear();
+  l.length_seg.clear(); 
+  l.length_acc.clear();
+  if (!l.is_bezier) return;
 
+  const int npts = l.size()/3;
+  const int nbs = npts/4;
+  const float *P = l.data();
   const float delta = 1.f / (N - 1);
-  std::vector<float> L;
+
+  s.buf.resize(N*3);
+  float *out = s.buf.data();
+
   for (int i=0; i<N; i++) {
-    float X[3];
-    Bezier(i*delta, X);
-    L.push_back(X[0]); L.push_back(X[1]); L.push_back(X[2]);
+    const float t = i*delta;
+    float *X = out + i*3;
+
+    if (t <= 0) {
+      X[0] = P[0]; X[1] = P[1]; X[2] = P[2]; continue;
+    } else if (t >= 1) {
+      X[0] = P[npts*3-3]; X[1] = P[npts*3-2]; X[2] = P[npts*3-1]; continue;
+    }
+
+    const int kInterval = t * nbs;
+    const float tt = t * nbs - kInterval;
+
+    float V[4][3]; // de Casteljau
+    for (int j=0; j<4; j++) 
+      for (int d=0; d<3; d++) 
+        V[j][d] = P[(kInterval*4+j)*3+d];
+    for (int k=1; k<=3; k++) 
+      for (int j=0; j<=3-k; j++) 
+        for (int d=0; d<3; d++) 
+          V[j][d] = (1. - tt) * V[j][d] + tt * V[j+1][d];
+
+    X[0] = V[0][0]; X[1] = V[0][1]; X[2] = V[0][2];
   }
-  swap(L);
+
+  l.swap(s.buf);
+  l.InvalidateCaches();
+}
+
+void VortexLine::ToRegular(int N)
+{
+  vortex_line_scratch_t s;
+  regular_line(*this, N, s);
 }
 
 void VortexLine::ToRegularL(int N)
@@ -234,6 +298,41 @@ void VortexLine::ToRegularL(int N)
     L.push_back(X[0]); L.push_back(X[1]); L.push_back(X[2]);
   }
   swap(L);
+  InvalidateCaches();
+}
+
+VortexLineProcessing::VortexLineProcessing() :
+  O(NULL), L(NULL), 
+  remove_invalid_points(false),
+  simplify_tolerance(0),
+  bezier_error_bound(0), 
+  regular_npts(0)
+{
+}
+
+void ProcessVortexLines(std::vector<VortexLine>& lines, const VortexLineProcessing& p, int nthreads)
+{
+  const int n = lines.size();
+  if (nthreads <= 0) nthreads = std::thread::hardware_concurrency();
+  nthreads = std::max(1, std::min(nthreads, n));
+
+  std::atomic<int> next(0);
+  auto process = [&]() {
+    vortex_line_scratch_t s;
+    for (int i = next++; i < n; i = next++) {
+      VortexLine &l = lines[i];
+      if (p.O && p.L) l.Flattern(p.O, p.L);
+      if (p.remove_invalid_points) remove_invalid_points(l, s);
+      if (p.simplify_tolerance > 0) simplify_line(l, p.simplify_tolerance, s);
+      if (p.bezier_error_bound > 0) bezier_line(l, p.bezier_error_bound, s);
+      if (p.regular_npts > 0) regular_line(l, p.regular_npts, s);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int k=1; k<nthreads; k++) threads.push_back(std::thread(process));
+  process();
+  for (int k=0; k<threads.size(); k++) threads[k].join();
 }
 
 void VortexLine::Flattern(const float O[3], const float L[3])
@@ -268,6 +367,7 @@ void VortexLine::Flattern(const float O[3], const float L[3])
 
   clear();
   swap(line);
+  InvalidateCaches();
 }
 
 void VortexLine::Unflattern(const float O[3], const float L[3])
@@ -286,45 +386,48 @@ void VortexLine::Unflattern(const float O[3], const float L[3])
 
   clear();
   swap(line);
+  InvalidateCaches();
+}
+
+std::shared_ptr<const VortexLineBVH> VortexLine::BVH() const
+{
+  std::shared_ptr<const VortexLineBVH> tree = std::atomic_load(&bvh_cache.tree);
+  if (!tree || !tree->Covers(data(), size()/3)) {
+    // concurrent first uses may both build it; either tree is fine
+    tree = std::make_shared<VortexLineBVH>(*this);
+    std::atomic_store(&bvh_cache.tree, tree);
+  }
+  return tree;
+}
+
+void VortexLine::InvalidateCaches() const
+{
+  length_seg.clear();
+  length_acc.clear();
+
+  std::atomic_store(&bvh_cache.tree, std::shared_ptr<const VortexLineBVH>());
 }
 
 float MinimumDist(const VortexLine& l0, const VortexLine& l1)
 {
-  float minDist = DBL_MAX;
-  const int n0 = l0.size()/3, n1 = l1.size()/3;
-
-  for (int i=0; i<n0; i++) 
-    for (int j=0; j<n1; j++) {
-      const float d[3] = {l0[i*3] - l1[j*3], l0[i*3+1] - l1[j*3+1], l0[i*3+2] - l1[j*3+2]};
-      const float dist = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
-      minDist = std::min(minDist, dist);
-    }
+  return MinimumDist(l0, l1, NULL);
+}
 
-  return minDist;
+float MinimumDist(const VortexLine& l0, const VortexLine& l1, const float L[3])
+{
+  float X[3];
+  return CrossingPoint(l0, l1, X, L);
 }
 
 float CrossingPoint(const VortexLine& l0, const VortexLine& l1, float X[3])
 {
-  float minDist = DBL_MAX;
-  const int n0 = l0.size()/3, n1 = l1.size()/3;
-  int i0, j0;
-
-  for (int i=0; i<n0; i++) 
-    for (int j=0; j<n1; j++) {
-      const float d[3] = {l0[i*3] - l1[j*3], l0[i*3+1] - l1[j*3+1], l0[i*3+2] - l1[j*3+2]};
-      const float dist = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
-      if (minDist > dist) {
-        i0 = i;
-        j0 = j;
-        minDist = dist;
-      }
-    }
-
-  X[0] = l0[i0*3] + l1[j0*3];
-  X[1] = l0[i0*3+1] + l1[j0*3+1];
-  X[2] = l0[i0*3+2] + l1[j0*3+2];
+  return CrossingPoint(l0, l1, X, NULL);
+}
 
-  return minDist;
+float CrossingPoint(const VortexLine& l0, const VortexLine& l1, float X[3], const float L[3])
+{
+  const std::shared_ptr<const VortexLineBVH> b0 = l0.BVH(), b1 = l1.BVH();
+  return b0->CrossingPoint(*b1, X, L);
 }
 
 float AreaL(const VortexLine& l0, const VortexLine& l1) 
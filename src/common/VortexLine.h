@@ -5,9 +5,12 @@
 #include <list>
 #include <vector>
 #include <sstream>
+#include <memory>
 #include "def.h"
 #include "common/diy-ext.hpp"
 
+class VortexLineBVH;
+
 /* 
  * \class   VortexLine
  * \author  Hanqi Guo
@@ -36,6 +39,11 @@ struct VortexLine : public std::vector<float>
   void BoundingBox(float LB[3], float UB[3]) const;
   float MaxExtent() const;
 
+  // tree over the points, built on first use and reused by MinimumDist and
+  // CrossingPoint; the methods above that edit points drop it
+  std::shared_ptr<const VortexLineBVH> BVH() const;
+  void InvalidateCaches() const; // lengths and tree; call after editing points directly
+
   friend float MinimumDist(const VortexLine& l0, const VortexLine& l1);
   friend float CrossingPoint(const VortexLine& l0, const VortexLine& l1, float X[3]);
   friend float Area(const VortexLine& l0, const VortexLine& l1);
@@ -54,6 +62,19 @@ struct VortexLine : public std::vector<float>
   mutable std::vector<float> length_seg;
   mutable std::vector<float> length_acc;
 
+  // not copied with the line, since the tree points into its buffer; 
+  // accessed with std::atomic_load and std::atomic_store
+  struct BVHCache {
+    std::shared_ptr<const VortexLineBVH> tree;
+    BVHCache() {}
+    BVHCache(const BVHCache&) {}
+    BVHCache& operator=(const BVHCache&) {
+      std::atomic_store(&tree, std::shared_ptr<const VortexLineBVH>());
+      return *this;
+    }
+  };
+  mutable BVHCache bvh_cache;
+
   unsigned char r, g, b;
 };
 
@@ -85,6 +106,24 @@ namespace diy {
   };
 }
 
+// steps of ProcessVortexLines, applied in this order to every line
+struct VortexLineProcessing {
+  VortexLineProcessing();
+
+  const float *O, *L; // if both set, Flattern(O, L)
+  bool remove_invalid_points;
+  float simplify_tolerance; // Simplify() if >0
+  float bezier_error_bound; // ToBezier() if >0
+  int regular_npts; // ToRegular() of bezier lines if >0
+};
+
+// post-processes lines in parallel; results are identical to calling the steps one by one
+void ProcessVortexLines(std::vector<VortexLine>& lines, const VortexLineProcessing& p, int nthreads=0);
+
+// minimum point-to-point distance in a periodic domain with lengths L (L[k]<=0: not periodic)
+float MinimumDist(const VortexLine& l0, const VortexLine& l1, const float L[3]);
+float CrossingPoint(const VortexLine& l0, const VortexLine& l1, float X[3], const float L[3]);
+
 bool SaveVortexLinesVTK(const std::vector<VortexLine>& lines, const std::string& filename);
 bool SaveVortexLinesBinary(const std::vector<VortexLine>& lines, const std::string& filename);
 bool SaveVortexLinesAscii(const std::vector<VortexLine>& lines, const std::string& filename);
@@ -0,0 +1,189 @@
+#include "VortexLineBVH.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cfloat>
+#include <cmath>
+
+static const int leaf_size = 8;
+
+// distance between intervals [a0, a1] and [b0, b1], over all periodic images of the latter
+static inline float axis_gap(float a0, float a1, float b0, float b1, float L)
+{
+  if (L <= 0)
+    return std::max(0.f, std::max(b0 - a1, a0 - b1));
+
+  const float lo = a0 - b1, hi = a1 - b0; // shifts of b that overlap a
+  const float s = floor(hi/L)*L;
+  if (s >= lo) return 0;
+  else return std::min(lo - s, s + L - hi);
+}
+
+void VortexLineBVH::Build(const float *points, int n)
+{
+  _points = points;
+  _npoints = n;
+  _nodes.clear();
+
+  if (n > 0) {
+    _nodes.reserve(2*n/leaf_size + 1);
+    BuildNode(0, n);
+  }
+}
+
+int VortexLineBVH::BuildNode(int first, int count)
+{
+  const int id = _nodes.size();
+  _nodes.push_back(Node());
+
+  Node node;
+  node.first = first;
+  node.count = count;
+  node.left = node.right = -1;
+  for (int k=0; k<3; k++) {
+    node.LB[k] = FLT_MAX;
+    node.UB[k] = -FLT_MAX;
+  }
+
+  for (int i=first; i<first+count; i++)
+    for (int k=0; k<3; k++) {
+      node.LB[k] = std::min(node.LB[k], _points[i*3+k]);
+      node.UB[k] = std::max(node.UB[k], _points[i*3+k]);
+    }
+
+  if (count > leaf_size) { // points along the line are coherent, so split by index
+    const int half = count/2;
+    node.left = BuildNode(first, half);
+    node.right = BuildNode(first + half, count - half);
+  }
+
+  _nodes[id] = node;
+  return id;
+}
+
+float VortexLineBVH::BoxDist2(const Node& n0, const Node& n1, const float *L)
+{
+  float d2 = 0;
+  for (int k=0; k<3; k++) {
+    const float g = axis_gap(n0.LB[k], n0.UB[k], n1.LB[k], n1.UB[k], L ? L[k] : 0);
+    d2 += g*g;
+  }
+  return d2;
+}
+
+void VortexLineBVH::Query(int n0, const VortexLineBVH& other, int n1, const float *L,
+    float &best, int &i0, int &j0) const
+{
+  const Node &a = _nodes[n0], &b = other._nodes[n1];
+  if (BoxDist2(a, b, L) >= best) return;
+
+  if (a.left < 0 && b.left < 0) {
+    for (int i=a.first; i<a.first+a.count; i++)
+      for (int j=b.first; j<b.first+b.count; j++) {
+        float d2 = 0;
+        for (int k=0; k<3; k++) {
+          float d = _points[i*3+k] - other._points[j*3+k];
+          if (L && L[k] > 0) d -= L[k] * round(d/L[k]);
+          d2 += d*d;
+        }
+        if (d2 < best) {
+          best = d2;
+          i0 = i;
+          j0 = j;
+        }
+      }
+    return;
+  }
+
+  // descend into the larger node, nearer child first
+  if (b.left < 0 || (a.left >= 0 && a.count >= b.count)) {
+    int c0 = a.left, c1 = a.right;
+    if (BoxDist2(_nodes[c1], b, L) < BoxDist2(_nodes[c0], b, L)) std::swap(c0, c1);
+    Query(c0, other, n1, L, best, i0, j0);
+    Query(c1, other, n1, L, best, i0, j0);
+  } else {
+    int c0 = b.left, c1 = b.right;
+    if (BoxDist2(a, other._nodes[c1], L) < BoxDist2(a, other._nodes[c0], L)) std::swap(c0, c1);
+    Query(n0, other, c0, L, best, i0, j0);
+    Query(n0, other, c1, L, best, i0, j0);
+  }
+}
+
+float VortexLineBVH::MinimumDist(const VortexLineBVH& other, int &i, int &j, const float *L) const
+{
+  i = j = -1;
+  if (Empty() || other.Empty()) return DBL_MAX;
+
+  float best = FLT_MAX;
+  Query(0, other, 0, L, best, i, j);
+  return sqrt(best);
+}
+
+float VortexLineBVH::CrossingPoint(const VortexLineBVH& other, float X[3], const float *L) const
+{
+  int i, j;
+  const float minDist = MinimumDist(other, i, j, L);
+  if (i < 0) { // an empty line
+    X[0] = X[1] = X[2] = NAN;
+    return minDist;
+  }
+
+  // midpoint, with the point of the other line moved to its image closest to this one
+  for (int k=0; k<3; k++) {
+    float d = other._points[j*3+k] - _points[i*3+k];
+    if (L && L[k] > 0) d -= L[k] * round(d/L[k]);
+    X[k] = _points[i*3+k] + d/2;
+  }
+
+  return minDist;
+}
+
+// gets the trees with tree(i) and fills the matrix, both in threads
+template <typename Tree>
+static void minimum_dist_matrix(int n, const Tree& tree, std::vector<float>& dist,
+    const float *L, int nthreads)
+{
+  dist.assign(n*n, 0);
+
+  if (nthreads <= 0) nthreads = std::thread::hardware_concurrency();
+  nthreads = std::max(1, std::min(nthreads, n));
+
+  std::vector<std::shared_ptr<const VortexLineBVH> > bvhs(n);
+  std::atomic<int> next(0);
+  auto build = [&]() {
+    for (int i = next++; i < n; i = next++)
+      bvhs[i] = tree(i);
+  };
+
+  std::vector<std::thread> threads;
+  for (int k=1; k<nthreads; k++) threads.push_back(std::thread(build));
+  build();
+  for (int k=0; k<threads.size(); k++) threads[k].join();
+  threads.clear();
+
+  // rows are handed out dynamically, since their costs differ
+  next = 0;
+  auto query = [&]() {
+    for (int i = next++; i < n; i = next++)
+      for (int j=i+1; j<n; j++) {
+        int i0, j0;
+        dist[i*n+j] = dist[j*n+i] = bvhs[i]->MinimumDist(*bvhs[j], i0, j0, L);
+      }
+  };
+
+  for (int k=1; k<nthreads; k++) threads.push_back(std::thread(query));
+  query();
+  for (int k=0; k<threads.size(); k++) threads[k].join();
+}
+
+void MinimumDistMatrix(const std::vector<VortexLine>& lines, std::vector<float>& dist,
+    const float *L, int nthreads)
+{
+  minimum_dist_matrix(lines.size(), [&](int i) {return lines[i].BVH();}, dist, L, nthreads);
+}
+
+void MinimumDistMatrix(const VortexLineSet& lines, std::vector<float>& dist,
+    const float *L, int nthreads)
+{
+  minimum_dist_matrix(lines.NLines(), [&](int i) {return lines.BVH(i);}, dist, L, nthreads);
+}
@@ -0,0 +1,60 @@
+#ifndef _VORTEX_LINE_BVH_H
+#define _VORTEX_LINE_BVH_H
+
+#include <vector>
+#include "def.h"
+#include "common/VortexLine.h"
+#include "common/VortexLineSet.h"
+
+/*
+ * \class   VortexLineBVH
+ * \brief   Bounding volume hierarchy over the points of a vortex line.
+ *          Consecutive points are grouped into axis-aligned boxes, so
+ *          closest-point queries between two lines skip all pairs of
+ *          boxes that are farther apart than the best distance found.
+ *          If L is given, distances follow the minimum image convention
+ *          of a periodic domain with lengths L (L[k]<=0: not periodic).
+*/
+class VortexLineBVH
+{
+public:
+  VortexLineBVH() : _points(NULL), _npoints(0) {}
+  explicit VortexLineBVH(const VortexLine& l) {Build(l);}
+
+  void Build(const VortexLine& l) {Build(l.data(), l.size()/3);}
+  void Build(const float *points, int npts);
+  bool Empty() const {return _nodes.empty();}
+  bool Covers(const float *points, int npts) const {return _points == points && _npoints == npts;}
+
+  // minimum point-to-point distance; i and j are the closest points of this and the other line
+  float MinimumDist(const VortexLineBVH& other, int &i, int &j, const float *L=NULL) const;
+  // minimum distance, and the midpoint X of the closest points (NAN if either line is empty)
+  float CrossingPoint(const VortexLineBVH& other, float X[3], const float *L=NULL) const;
+
+private:
+  struct Node {
+    float LB[3], UB[3];
+    int first, count; // range of points
+    int left, right; // children, -1 for leaves
+  };
+
+  int BuildNode(int first, int count);
+  void Query(int n0, const VortexLineBVH& other, int n1, const float *L,
+      float &best, int &i, int &j) const;
+
+  static float BoxDist2(const Node& n0, const Node& n1, const float *L);
+
+private:
+  const float *_points; // points of the line, which must outlive the tree
+  int _npoints;
+  std::vector<Node> _nodes;
+};
+
+// n by n matrix of minimum distances between all pairs of lines, row major; 
+// uses and fills the trees cached by the lines
+void MinimumDistMatrix(const std::vector<VortexLine>& lines, std::vector<float>& dist,
+    const float *L=NULL, int nthreads=0);
+void MinimumDistMatrix(const VortexLineSet& lines, std::vector<float>& dist,
+    const float *L=NULL, int nthreads=0); // uses and fills the trees cached by the set
+
+#endif
@@ -0,0 +1,160 @@
+#include "VortexLineSet.h"
+#include "VortexLineBVH.h"
+
+VortexLineSet::VortexLineSet()
+{
+  Clear();
+}
+
+VortexLineSet::VortexLineSet(const std::vector<VortexLine>& lines)
+{
+  Clear();
+
+  size_t npoints = 0;
+  for (int i=0; i<lines.size(); i++)
+    npoints += lines[i].size()/3;
+  Reserve(lines.size(), npoints);
+
+  for (int i=0; i<lines.size(); i++)
+    Add(lines[i]);
+}
+
+void VortexLineSet::Clear()
+{
+  _points.clear();
+  _offsets.assign(1, 0);
+  _cond.clear();
+  _cond_offsets.assign(1, 0);
+
+  _id.clear();
+  _gid.clear();
+  _timestep.clear();
+  _time.clear();
+  _moving_speed.clear();
+  _flags.clear();
+  _rgb.clear();
+  _tree_cache.trees.clear();
+}
+
+void VortexLineSet::Reserve(int nlines, size_t npoints)
+{
+  _points.reserve(npoints*3);
+  _offsets.reserve(nlines+1);
+  _cond_offsets.reserve(nlines+1);
+
+  _id.reserve(nlines);
+  _gid.reserve(nlines);
+  _timestep.reserve(nlines);
+  _time.reserve(nlines);
+  _moving_speed.reserve(nlines);
+  _flags.reserve(nlines);
+  _rgb.reserve(nlines*3);
+  _tree_cache.trees.reserve(nlines);
+}
+
+int VortexLineSet::Add(const VortexLine& l)
+{
+  const size_t npoints = l.size()/3;
+  _points.insert(_points.end(), l.begin(), l.begin() + npoints*3);
+  _offsets.push_back(_offsets.back() + npoints);
+  _cond.insert(_cond.end(), l.cond.begin(), l.cond.end());
+  _cond_offsets.push_back(_cond.size());
+
+  _id.push_back(l.id);
+  _gid.push_back(l.gid);
+  _timestep.push_back(l.timestep);
+  _time.push_back(l.time);
+  _moving_speed.push_back(l.moving_speed);
+  _flags.push_back((l.is_bezier ? FLAG_BEZIER : 0) | (l.is_loop ? FLAG_LOOP : 0));
+  _rgb.push_back(l.r);
+  _rgb.push_back(l.g);
+  _rgb.push_back(l.b);
+  _tree_cache.trees.push_back(std::shared_ptr<const VortexLineBVH>());
+
+  return _id.size() - 1;
+}
+
+size_t VortexLineSet::Bytes() const
+{
+  return sizeof(VortexLineSet)
+    + _points.capacity()*sizeof(float) + _offsets.capacity()*sizeof(size_t)
+    + _cond.capacity()*sizeof(float) + _cond_offsets.capacity()*sizeof(size_t)
+    + (_id.capacity() + _gid.capacity() + _timestep.capacity())*sizeof(int)
+    + (_time.capacity() + _moving_speed.capacity())*sizeof(float)
+    + _flags.capacity() + _rgb.capacity();
+}
+
+VortexLineSet::View VortexLineSet::Line(int i) const
+{
+  View v;
+  v.points = _points.data() + _offsets[i]*3;
+  v.npoints = _offsets[i+1] - _offsets[i];
+  v.cond = _cond_offsets[i+1] > _cond_offsets[i] ? _cond.data() + _cond_offsets[i] : NULL;
+  v.id = _id[i];
+  v.gid = _gid[i];
+  v.timestep = _timestep[i];
+  v.time = _time[i];
+  v.moving_speed = _moving_speed[i];
+  v.is_bezier = _flags[i] & FLAG_BEZIER;
+  v.is_loop = _flags[i] & FLAG_LOOP;
+  v.r = _rgb[i*3];
+  v.g = _rgb[i*3+1];
+  v.b = _rgb[i*3+2];
+  return v;
+}
+
+VortexLine VortexLineSet::ToVortexLine(int i) const
+{
+  const View v = Line(i);
+
+  VortexLine l;
+  l.assign(v.begin(), v.end());
+  l.cond.assign(_cond.begin() + _cond_offsets[i], _cond.begin() + _cond_offsets[i+1]);
+  l.id = v.id;
+  l.gid = v.gid;
+  l.timestep = v.timestep;
+  l.time = v.time;
+  l.moving_speed = v.moving_speed;
+  l.is_bezier = v.is_bezier;
+  l.is_loop = v.is_loop;
+  l.r = v.r;
+  l.g = v.g;
+  l.b = v.b;
+  return l;
+}
+
+void VortexLineSet::ToVortexLines(std::vector<VortexLine>& lines) const
+{
+  lines.resize(NLines());
+  for (int i=0; i<NLines(); i++)
+    lines[i] = ToVortexLine(i);
+}
+
+std::shared_ptr<const VortexLineBVH> VortexLineSet::BVH(int i) const
+{
+  std::shared_ptr<const VortexLineBVH> &slot = _tree_cache.trees[i];
+  const float *points = _points.data() + _offsets[i]*3;
+  const int npoints = _offsets[i+1] - _offsets[i];
+
+  std::shared_ptr<const VortexLineBVH> tree = std::atomic_load(&slot);
+  if (!tree || !tree->Covers(points, npoints)) { // new, or moved by Add
+    // concurrent first uses may both build it; either tree is fine
+    std::shared_ptr<VortexLineBVH> t = std::make_shared<VortexLineBVH>();
+    t->Build(points, npoints);
+    tree = t;
+    std::atomic_store(&slot, tree);
+  }
+  return tree;
+}
+
+float VortexLineSet::MinimumDist(int i, int j, const float L[3]) const
+{
+  float X[3];
+  return CrossingPoint(i, j, X, L);
+}
+
+float VortexLineSet::CrossingPoint(int i, int j, float X[3], const float L[3]) const
+{
+  const std::shared_ptr<const VortexLineBVH> b0 = BVH(i), b1 = BVH(j);
+  return b0->CrossingPoint(*b1, X, L);
+}
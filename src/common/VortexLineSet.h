@@ -0,0 +1,149 @@
+#ifndef _VORTEX_LINE_SET_H
+#define _VORTEX_LINE_SET_H
+
+#include <vector>
+#include <memory>
+#include "def.h"
+#include "common/VortexLine.h"
+#include "common/diy-ext.hpp"
+
+class VortexLineBVH;
+
+/*
+ * \class   VortexLineSet
+ * \brief   Vortex lines of a frame in structure-of-arrays layout: points of
+ *          all lines in one array with per-line offsets, and one column per
+ *          line attribute.  Lines are accessed through views that point
+ *          into the arrays; the set serializes as a few flat arrays.  This
+ *          is the frame format of "v.<frame>" and of the frame store.
+*/
+class VortexLineSet
+{
+  friend struct diy::Serialization<VortexLineSet>;
+public:
+  // read-only view of a line, valid until the set is modified
+  struct View {
+    const float *points, *cond; // cond is NULL if the line has no condition numbers
+    int npoints;
+    int id, gid, timestep;
+    float time, moving_speed;
+    bool is_bezier, is_loop;
+    unsigned char r, g, b;
+
+    size_t size() const {return npoints*3;} // number of floats, as VortexLine::size()
+    bool empty() const {return npoints == 0;}
+    const float* data() const {return points;}
+    const float* begin() const {return points;}
+    const float* end() const {return points + npoints*3;}
+    float operator[](size_t i) const {return points[i];}
+  };
+
+  VortexLineSet();
+  explicit VortexLineSet(const std::vector<VortexLine>& lines);
+
+  void Clear();
+  void Reserve(int nlines, size_t npoints);
+  int Add(const VortexLine& line); // returns the index of the line
+
+  int NLines() const {return _id.size();}
+  size_t NPoints() const {return _points.size()/3;}
+  size_t Bytes() const;
+
+  View Line(int i) const;
+  VortexLine ToVortexLine(int i) const;
+  void ToVortexLines(std::vector<VortexLine>& lines) const;
+
+  const std::vector<float>& Points() const {return _points;}
+  const std::vector<size_t>& Offsets() const {return _offsets;}
+
+  // tree over the points of line i, built on first use and kept with the set
+  std::shared_ptr<const VortexLineBVH> BVH(int i) const;
+
+  // as the functions of the same names on VortexLine, for lines i and j
+  float MinimumDist(int i, int j, const float L[3]=NULL) const;
+  float CrossingPoint(int i, int j, float X[3], const float L[3]=NULL) const;
+
+private:
+  enum {FLAG_BEZIER = 1, FLAG_LOOP = 2};
+
+  std::vector<float> _points;
+  std::vector<size_t> _offsets; // in points, NLines()+1 entries
+  std::vector<float> _cond;
+  std::vector<size_t> _cond_offsets;
+
+  std::vector<int> _id, _gid, _timestep;
+  std::vector<float> _time, _moving_speed;
+  std::vector<unsigned char> _flags, _rgb;
+
+  // one slot per line; trees point into _points, so copies start empty.
+  // Slots are accessed with std::atomic_load and std::atomic_store
+  struct TreeCache {
+    std::vector<std::shared_ptr<const VortexLineBVH> > trees;
+    TreeCache() {}
+    TreeCache(const TreeCache& c) : trees(c.trees.size()) {}
+    TreeCache& operator=(const TreeCache& c) {
+      trees.assign(c.trees.size(), std::shared_ptr<const VortexLineBVH>());
+      return *this;
+    }
+  };
+  mutable TreeCache _tree_cache;
+};
+
+namespace diy {
+  // frames written as std::vector<VortexLine> start with the number of
+  // lines, which is never the magic number of the set
+  template <> struct Serialization<VortexLineSet> {
+    static const size_t magic = 0x5445534c58545256ull;
+    static const int version = 1;
+
+    static void save(diy::BinaryBuffer& bb, const VortexLineSet& m) {
+      const size_t head = magic;
+      const int v = version;
+      diy::save(bb, head);
+      diy::save(bb, v);
+      diy::save(bb, m._points);
+      diy::save(bb, m._offsets);
+      diy::save(bb, m._cond);
+      diy::save(bb, m._cond_offsets);
+      diy::save(bb, m._id);
+      diy::save(bb, m._gid);
+      diy::save(bb, m._timestep);
+      diy::save(bb, m._time);
+      diy::save(bb, m._moving_speed);
+      diy::save(bb, m._flags);
+      diy::save(bb, m._rgb);
+    }
+
+    static void load(diy::BinaryBuffer& bb, VortexLineSet& m) {
+      size_t head;
+      diy::load(bb, head);
+
+      if (head != magic) { // std::vector<VortexLine> of head lines
+        m.Clear();
+        for (size_t i=0; i<head; i++) {
+          VortexLine l;
+          diy::load(bb, l);
+          m.Add(l);
+        }
+        return;
+      }
+
+      int v; // format version, 1 so far
+      diy::load(bb, v);
+      diy::load(bb, m._points);
+      diy::load(bb, m._offsets);
+      diy::load(bb, m._cond);
+      diy::load(bb, m._cond_offsets);
+      diy::load(bb, m._id);
+      diy::load(bb, m._gid);
+      diy::load(bb, m._timestep);
+      diy::load(bb, m._time);
+      diy::load(bb, m._moving_speed);
+      diy::load(bb, m._flags);
+      diy::load(bb, m._rgb);
+      m._tree_cache.trees.assign(m.NLines(), std::shared_ptr<const VortexLineBVH>());
+    }
+  };
+}
+
+#endif
@@ -3,8 +3,10 @@
 
 #include <set>
 #include <list>
+#include <vector>
 #include <climits>
 #include "def.h"
+#include "common/diy-ext.hpp"
 
 struct VortexObject {
   int gid, id; // gid: global id; id: local (time) id
@@ -18,4 +20,35 @@ struct VortexObject {
   VortexObject() : id(INT_MAX), gid(INT_MAX), loop(false) {}
 };
 
+namespace diy {
+  template <> struct Serialization<VortexObject> {
+    static void save(diy::BinaryBuffer& bb, const VortexObject& m) {
+      diy::save(bb, m.gid);
+      diy::save(bb, m.id);
+      diy::save(bb, m.timestep);
+      diy::save(bb, m.loop);
+      diy::save(bb, m.faces);
+
+      std::vector<std::vector<FaceIdType> > traces;
+      for (size_t i=0; i<m.traces.size(); i++) 
+        traces.push_back(std::vector<FaceIdType>(m.traces[i].begin(), m.traces[i].end()));
+      diy::save(bb, traces);
+    }
+
+    static void load(diy::BinaryBuffer& bb, VortexObject& m) {
+      diy::load(bb, m.gid);
+      diy::load(bb, m.id);
+      diy::load(bb, m.timestep);
+      diy::load(bb, m.loop);
+      diy::load(bb, m.faces);
+
+      std::vector<std::vector<FaceIdType> > traces;
+      diy::load(bb, traces);
+      m.traces.clear();
+      for (size_t i=0; i<traces.size(); i++) 
+        m.traces.push_back(std::list<FaceIdType>(traces[i].begin(), traces[i].end()));
+    }
+  };
+}
+
 #endif
@@ -8,9 +8,14 @@
 #include "common/diy-ext.hpp"
 #include "random_color.h"
 #include "graph_color.h"
+#include "Profiler.h"
 #include "def.h"
 
-VortexTransition::VortexTransition()
+VortexTransition::VortexTransition() :
+  _seq_tree_dirty(false),
+  _max_nvortices_per_frame(0),
+  _next_interval(0),
+  _keep_matrices(true)
 {
 }
 
@@ -19,12 +24,14 @@ VortexTransition::~VortexTransition()
 }
 
 #if WITH_ROCKSDB
+static const std::string key_trans = "trans";
+
 bool VortexTransition::LoadFromDB(rocksdb::DB* db)
 {
   std::string buf;
   rocksdb::Status s; 
 
-  s = db->Get(rocksdb::ReadOptions(), "trans", &buf);
+  s = db->Get(rocksdb::ReadOptions(), key_trans, &buf);
   if (s.ok()) {
     diy::unserialize(buf, *this);
   } else {
@@ -49,7 +56,8 @@ bool VortexTransition::LoadFromDB(rocksdb::DB* db)
 
     ConstructSequence();
     diy::serialize(*this, buf);
-    db->Put(rocksdb::WriteOptions(), "trans", buf);
+    db->Put(rocksdb::WriteOptions(), key_trans, buf);
+    Profiler::Count(PROF_DB_BYTES_WRITTEN, key_trans.size() + buf.size());
   }
 
   return true;
@@ -215,6 +223,27 @@ void VortexTransition::AddMatrix(const VortexTransitionMatrix& m)
   _matrices[m.GetInterval()] = m;
 }
 
+void VortexTransition::Clear()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _frames.clear();
+  _matrices.clear();
+  _seqs.clear();
+  _lvid2gvid.clear();
+  _seq_tree.clear();
+  _seq_tree_dirty = false;
+  _nvortices_per_frame.clear();
+  _max_nvortices_per_frame = 0;
+  _events.clear();
+  _next_interval = 0;
+}
+
+void VortexTransition::AddFrame(int frame)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _frames.push_back(frame);
+}
+
 int VortexTransition::NewVortexSequence(int its)
 {
   VortexSequence vs;
@@ -225,24 +254,107 @@ int VortexTransition::NewVortexSequence(int its)
   return _seqs.size() - 1;
 }
 
+void VortexTransition::SetGvid(int frame, int lid, int gid)
+{
+  if (frame >= _lvid2gvid.size()) _lvid2gvid.resize(frame+1);
+  std::vector<int> &gids = _lvid2gvid[frame];
+  if (lid >= gids.size()) gids.resize(lid+1, -1);
+  gids[lid] = gid;
+}
+
 int VortexTransition::lvid2gvid(int t, int lid) const
 {
-  std::pair<int, int> key = std::make_pair(t, lid);
-  std::map<std::pair<int,int>,int>::const_iterator it = _seqmap.find(key);
-  if (it == _seqmap.end())
+  if (t < 0 || t >= _lvid2gvid.size() || lid < 0 || lid >= _lvid2gvid[t].size())
     return -1;
   else 
-    return it->second;
+    return _lvid2gvid[t][lid];
 }
 
 int VortexTransition::gvid2lvid(int frame, int gvid) const
 {
-  std::pair<int, int> key = std::make_pair(frame, gvid);
-  std::map<std::pair<int, int>,int>::const_iterator it = _invseqmap.find(key);
-  if (it == _invseqmap.end())
+  if (gvid < 0 || gvid >= _seqs.size()) return -1;
+
+  const VortexSequence &s = _seqs[gvid];
+  if (frame < s.its || frame >= s.its + s.lids.size())
     return -1;
   else 
-    return it->second;
+    return s.lids[frame - s.its];
+}
+
+void VortexTransition::GetSeqMaps(SeqMap& seqmap, SeqMap& invseqmap) const
+{
+  seqmap.clear();
+  invseqmap.clear();
+  for (int t=0; t<_lvid2gvid.size(); t++) 
+    for (int lid=0; lid<_lvid2gvid[t].size(); lid++) {
+      const int gid = _lvid2gvid[t][lid];
+      if (gid < 0) continue;
+      seqmap[std::make_pair(t, lid)] = gid;
+      invseqmap[std::make_pair(t, gid)] = lid;
+    }
+}
+
+void VortexTransition::SetSeqMap(const SeqMap& seqmap)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  _lvid2gvid.clear();
+  for (SeqMap::const_iterator it = seqmap.begin(); it != seqmap.end(); it ++) 
+    SetGvid(it->first.first, it->first.second, it->second);
+  _seq_tree_dirty = true;
+}
+
+// segment tree over gids, holding the max last frame of each range; since 
+// sequences are created in order of their first frames, the sequences that 
+// start no later than f1 are a prefix of the gids.  Sequences change with 
+// every interval, so the tree is only rebuilt by the first query after a 
+// change, under _mutex
+void VortexTransition::BuildSequenceTree() const
+{
+  const int n = _seqs.size();
+  _seq_tree.assign(std::max(1, 4*n), -1);
+
+  struct Builder {
+    const std::vector<VortexSequence>& seqs;
+    std::vector<int>& tree;
+    int build(int node, int lo, int hi) { // [lo, hi)
+      if (hi - lo == 1) 
+        return tree[node] = seqs[lo].its + seqs[lo].itl - 1;
+      const int mid = (lo + hi) / 2;
+      return tree[node] = std::max(build(node*2+1, lo, mid), build(node*2+2, mid, hi));
+    }
+  } builder = {_seqs, _seq_tree};
+  if (n > 0) builder.build(0, 0, n);
+  _seq_tree_dirty = false;
+}
+
+void VortexTransition::QuerySequenceTree(int node, int lo, int hi, int n, int f0, std::vector<int>& gids) const
+{
+  if (lo >= n || _seq_tree[node] < f0) return;
+  if (hi - lo == 1) {
+    gids.push_back(lo);
+    return;
+  }
+  const int mid = (lo + hi) / 2;
+  QuerySequenceTree(node*2+1, lo, mid, n, f0, gids);
+  QuerySequenceTree(node*2+2, mid, hi, n, f0, gids);
+}
+
+void VortexTransition::SequencesAlive(int f0, int f1, std::vector<int>& gids) const
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  gids.clear();
+  if (_seqs.empty() || f0 > f1) return;
+  if (_seq_tree_dirty) BuildSequenceTree();
+
+  // number of sequences starting no later than f1
+  int lo = 0, hi = _seqs.size();
+  while (lo < hi) {
+    const int mid = (lo + hi) / 2;
+    if (_seqs[mid].its <= f1) lo = mid + 1;
+    else hi = mid;
+  }
+
+  QuerySequenceTree(0, 0, _seqs.size(), lo, f0, gids);
 }
 
 void VortexTransition::SequenceColor(int gid, unsigned char &r, unsigned char &g, unsigned char &b) const
@@ -252,64 +364,173 @@ void VortexTransition::SequenceColor(int gid, unsigned char &r, unsigned char &g
   b = _seqs[gid].b;
 }
 
+// records written before the counts were kept have none; they were 
+// sequenced up to the first missing matrix, and keep their matrices
+void VortexTransition::RecoverNextInterval()
+{
+  const int nintervals = std::max(0, (int)_frames.size()-1);
+  _next_interval = 0;
+
+  if (!_nvortices_per_frame.empty()) {
+    while (_next_interval < nintervals && 
+        _nvortices_per_frame.find(_next_interval+1) != _nvortices_per_frame.end())
+      _next_interval ++;
+  } else {
+    while (_next_interval < nintervals) {
+      const int i = _next_interval;
+      std::map<Interval, VortexTransitionMatrix>::const_iterator it = 
+        _matrices.find(Interval(_frames[i], _frames[i+1]));
+      if (it == _matrices.end() || !it->second.Valid()) break;
+      _nvortices_per_frame[i] = it->second.n0();
+      _nvortices_per_frame[i+1] = it->second.n1();
+      _max_nvortices_per_frame = std::max(_max_nvortices_per_frame, 
+          std::max(it->second.n0(), it->second.n1()));
+      _next_interval ++;
+    }
+  }
+}
+
 void VortexTransition::ConstructSequence()
 {
-  for (int i=0; i<_frames.size()-1; i++) {
+  _seqs.clear();
+  _lvid2gvid.clear();
+  _seq_tree.clear();
+  _seq_tree_dirty = false;
+  _nvortices_per_frame.clear();
+  _max_nvortices_per_frame = 0;
+  _events.clear();
+  _next_interval = 0;
+
+  UpdateSequence();
+  if (_next_interval < (int)_frames.size()-1)
+    fprintf(stderr, "WARNING: transition matrix missing for interval {%d, %d}\n", 
+        _frames[_next_interval], _frames[_next_interval+1]);
+
+  // RandomColorSchemes();
+  SequenceGraphColoring(); 
+}
+
+int VortexTransition::UpdateSequence()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  
+  int n = 0;
+  while (_next_interval < (int)_frames.size()-1) {
+    const int i = _next_interval;
     Interval I(_frames[i], _frames[i+1]);
     // fprintf(stderr, "processing interval {%d, %d}\n", I.first, I.second);
 
-    VortexTransitionMatrix &tm = Matrix(I);
-    assert(tm.Valid());
+    std::map<Interval, VortexTransitionMatrix>::iterator it = _matrices.find(I);
+    if (it == _matrices.end() || !it->second.Valid()) break; // not arrived yet
 
-    if (i == 0) { // initial
-      for (int k=0; k<tm.n0(); k++) {
-        int gid = NewVortexSequence(i);
-        _seqs[gid].itl ++;
-        _seqs[gid].lids.push_back(k);
-        _seqmap[std::make_pair(i, k)] = gid;
-        _invseqmap[std::make_pair(i, gid)] = k;
-      }
+    SequenceInterval(i, it->second);
+    if (!_keep_matrices) _matrices.erase(it);
+
+    _next_interval ++;
+    n ++;
+  }
+
+  if (n > 0) _seq_tree_dirty = true;
+  return n;
+}
+
+void VortexTransition::SequenceInterval(int i, const VortexTransitionMatrix& tm)
+{
+  _nvortices_per_frame[i] = tm.n0();
+  _nvortices_per_frame[i+1] = tm.n1();
+  _max_nvortices_per_frame = std::max(_max_nvortices_per_frame, std::max(tm.n0(), tm.n1()));
+
+  if (i == 0) { // initial
+    std::vector<int> gids;
+    for (int k=0; k<tm.n0(); k++) {
+      int gid = NewVortexSequence(i);
+      _seqs[gid].itl ++;
+      _seqs[gid].lids.push_back(k);
+      SetGvid(i, k, gid);
+      gids.push_back(gid);
     }
+    ColorNewSequences(i, gids, std::set<int>());
+  }
 
-    for (int k=0; k<tm.NModules(); k++) {
-      int event;
-      std::set<int> lhs, rhs;
-      tm.GetModule(k, lhs, rhs, event);
+  std::vector<std::vector<int> > born; // new sequences of each module
+  std::vector<std::set<int> > dead; // sequences ending in each module
+
+  for (int k=0; k<tm.NModules(); k++) {
+    int event;
+    std::set<int> lhs, rhs;
+    tm.GetModule(k, lhs, rhs, event);
+
+    if (lhs.size() == 1 && rhs.size() == 1) { // ordinary case
+      int l = *lhs.begin(), r = *rhs.begin();
+      int gid = lvid2gvid(i, l);
+      _seqs[gid].itl ++;
+      _seqs[gid].lids.push_back(r);
+      SetGvid(i+1, r, gid);
+    } else { // some events, need re-ID
+      born.push_back(std::vector<int>());
+      dead.push_back(std::set<int>());
+      for (std::set<int>::iterator it=lhs.begin(); it!=lhs.end(); it++) 
+        dead.back().insert(lvid2gvid(i, *it));
 
-      if (lhs.size() == 1 && rhs.size() == 1) { // ordinary case
-        int l = *lhs.begin(), r = *rhs.begin();
-        int gid = _seqmap[std::make_pair(i, l)];
+      for (std::set<int>::iterator it=rhs.begin(); it!=rhs.end(); it++) {
+        int r = *it; 
+        int gid = NewVortexSequence(i+1);
         _seqs[gid].itl ++;
         _seqs[gid].lids.push_back(r);
-        _seqmap[std::make_pair(i+1, r)] = gid;
-        _invseqmap[std::make_pair(i+1, gid)] = r;
-      } else { // some events, need re-ID
-        for (std::set<int>::iterator it=rhs.begin(); it!=rhs.end(); it++) {
-          int r = *it; 
-          int gid = NewVortexSequence(i+1);
-          _seqs[gid].itl ++;
-          _seqs[gid].lids.push_back(r);
-          _seqmap[std::make_pair(i+1, r)] = gid;
-          _invseqmap[std::make_pair(i+1, gid)] = r;
-        }
+        SetGvid(i+1, r, gid);
+        born.back().push_back(gid);
       }
+    }
 
-      // build events
-      // if (event >= VORTEX_EVENT_MERGE) {
-      if (event > VORTEX_EVENT_DUMMY) {
-        VortexEvent e;
-        e.if0 = i; 
-        e.if1 = i+1;
-        e.type = event;
-        e.lhs = lhs;
-        e.rhs = rhs;
-        _events.push_back(e);
-      }
+    // build events
+    // if (event >= VORTEX_EVENT_MERGE) {
+    if (event > VORTEX_EVENT_DUMMY) {
+      VortexEvent e;
+      e.if0 = i; 
+      e.if1 = i+1;
+      e.type = event;
+      e.lhs = lhs;
+      e.rhs = rhs;
+      _events.push_back(e);
     }
   }
 
-  // RandomColorSchemes();
-  SequenceGraphColoring(); 
+  // colors are assigned once all vortices in frame i+1 have their ids
+  for (int k=0; k<born.size(); k++) 
+    ColorNewSequences(i+1, born[k], dead[k]);
+}
+
+// greedy coloring on color ids (see generate_color): a new sequence gets the 
+// first id not used by the sequences alive in the same frame or by the 
+// sequences it originates from.  Ids of existing sequences are recovered from 
+// their colors; colors repeat once more than num_distinct_colors() ids are in use
+void VortexTransition::ColorNewSequences(int i, const std::vector<int>& gids, const std::set<int>& neighbors)
+{
+  if (gids.empty()) return;
+
+  std::set<int> gids1(gids.begin(), gids.end());
+  std::set<int> neighbors1(neighbors);
+  std::set<int> used; // color ids
+
+  if (i < _lvid2gvid.size()) 
+    for (int lid=0; lid<_lvid2gvid[i].size(); lid++) {
+      const int gid = _lvid2gvid[i][lid];
+      if (gid >= 0 && gids1.find(gid) == gids1.end()) 
+        neighbors1.insert(gid);
+    }
+  
+  for (std::set<int>::const_iterator it = neighbors1.begin(); it != neighbors1.end(); it ++) {
+    const VortexSequence &s = _seqs[*it];
+    used.insert(color_index(s.r, s.g, s.b)); // -1 for colors from other schemes
+  }
+
+  int c = 0;
+  for (int k=0; k<gids.size(); k++) {
+    while (used.find(c) != used.end()) c ++;
+    VortexSequence &s = _seqs[gids[k]];
+    generate_color(c, s.r, s.g, s.b);
+    used.insert(c);
+  }
 }
 
 void VortexTransition::PrintSequence() const
@@ -353,7 +574,7 @@ void VortexTransition::PrintSequence() const
 #if 0
       if (event >= VORTEX_EVENT_MERGE) { // FIXME: other events
         for (int u=0; u<lhs.size(); u++) {
-          const int lgid = _seqmap[std::make_tuple(i, lhs[u])];
+          const int lgid = lvid2gvid(i, lhs[u]);
           _seqs[lgid].rhs_event = event;
           _seqs[lgid].rhs_gids = rhs;
         }
@@ -394,47 +615,31 @@ void VortexTransition::SequenceGraphColoring()
 {
   using namespace std;
 
-  // 1. construct graph
+  // 1. construct graph: sequences are intervals of frames; concurrent 
+  // sequences are adjacent implicitly, sequences related by events explicitly
   const int n = _seqs.size();
-  bool **M;
-  malloc2D(M, n, n, bool);
-  memset(M[0], 0, sizeof(bool)*n*n);
-
-  // 1.1 concurrent vortices
-  map<int, std::set<int> > time_slots;
+  vector<int> start(n), end(n);
   for (int i=0; i<n; i++) {
-    for (int j=0; j<_seqs[i].itl; j++) {
-      time_slots[_seqs[i].its+j].insert(i);
-    }
-  }
-  for (map<int, std::set<int> >::iterator it=time_slots.begin(); it!=time_slots.end(); it++) {
-    const set<int> &concurrents = it->second;
-    for (set<int>::iterator it0=concurrents.begin(); it0!=concurrents.end(); it0++)
-      for (set<int>::iterator it1=concurrents.begin(); it1!=concurrents.end(); it1++)
-        if (it0!=it1) {
-          M[*it0][*it1] = M[*it1][*it0] = true;
-        }
+    start[i] = _seqs[i].its;
+    end[i] = _seqs[i].its + _seqs[i].itl - 1;
   }
 
-  // 1.2 events
-  for (int i=0; i<n; i++) {
-    int t = _seqs[i].its + _seqs[i].itl - 1;
-    if (t>=_frames.size()-1) continue; 
-    int lhs_lid = _seqs[i].lids.back();
-    Interval interval = std::make_pair(_frames[t], _frames[t+1]);
-    VortexTransitionMatrix &mat = _matrices[interval];
-    for (int k=0; k<mat.n1(); k++) {
-      if (mat(lhs_lid, k)) {
-        int rhs_lid = k;
-        int rgid = _seqmap[std::make_pair(t+1, k)];
-        M[i][rgid] = M[rgid][i] = true;
+  vector<vector<int> > adj(n);
+  for (int i=0; i<_events.size(); i++) {
+    const VortexEvent &e = _events[i];
+    for (set<int>::const_iterator it0 = e.lhs.begin(); it0 != e.lhs.end(); it0 ++) 
+      for (set<int>::const_iterator it1 = e.rhs.begin(); it1 != e.rhs.end(); it1 ++) {
+        const int lgid = lvid2gvid(e.if0, *it0), 
+                  rgid = lvid2gvid(e.if1, *it1);
+        if (lgid < 0 || rgid < 0) continue;
+        adj[lgid].push_back(rgid);
+        adj[rgid].push_back(lgid);
       }
-    }
   }
 
   // 2. graph coloring
-  int *cids = (int*)malloc(sizeof(int)*n);
-  int nc = welsh_powell(n, M, cids);
+  vector<int> cids(n);
+  int nc = interval_graph_color(n, start.data(), end.data(), adj, cids.data());
 
   // 3. generate colors
   // fprintf(stderr, "#color=%d\n", nc);
@@ -448,11 +653,6 @@ void VortexTransition::SequenceGraphColoring()
     _seqs[i].g = colors[c*3+1];
     _seqs[i].b = colors[c*3+2];
   }
-
-  // 4. release memory
-  free(M[0]);
-  free(M);
-  free(cids);
 }
 
 int VortexTransition::NVortices(int frame) const
@@ -5,6 +5,8 @@
 #include "common/VortexTransitionMatrix.h"
 #include "common/VortexSequence.h"
 #include <utility>
+#include <algorithm>
+#include <set>
 #include <mutex>
 
 #if WITH_ROCKSDB
@@ -34,18 +36,22 @@ public:
   // const std::map<int, VortexTransitionMatrix>& Matrices() const {return _matrices;}
   std::map<Interval, VortexTransitionMatrix>& Matrices() {return _matrices;}
 
+  void Clear();
   void ConstructSequence();
+  int UpdateSequence(); // sequences all newly available consecutive intervals; returns the number of intervals processed
+  void SetKeepMatrices(bool b) {_keep_matrices = b;} // if false, matrices are dropped once sequenced
   void PrintSequence() const;
   void SequenceGraphColoring();
   void SequenceColor(int gid, unsigned char &r, unsigned char &g, unsigned char &b) const;
 
-  int lvid2gvid(int frame, int lvid) const;
-  int gvid2lvid(int frame, int gvid) const;
+  int lvid2gvid(int frame, int lvid) const; // O(1); frame is the index of the frame
+  int gvid2lvid(int frame, int gvid) const; // O(1)
+  void SequencesAlive(int f0, int f1, std::vector<int>& gids) const; // gids of sequences overlapping frames [f0, f1]
 
   int MaxNVorticesPerFrame() const {return _max_nvortices_per_frame;}
   int NVortices(int frame) const;
 
-  const std::vector<struct VortexSequence> Sequences() const {return _seqs;}
+  const std::vector<struct VortexSequence>& Sequences() const {return _seqs;}
   void RandomColorSchemes();
   
   const std::vector<struct VortexEvent>& Events() const {return _events;}
@@ -54,10 +60,21 @@ public:
   int Frame(int i) const {return _frames[i];}
   int NTimesteps() const {return _frames.size();}
   void SetFrames(const std::vector<int> frames) {_frames = frames;}
+  void AddFrame(int frame);
   const std::vector<int>& Frames() const {return _frames;}
 
 private:
   int NewVortexSequence(int its);
+  void SequenceInterval(int i, const VortexTransitionMatrix& tm);
+  void ColorNewSequences(int i, const std::vector<int>& gids, const std::set<int>& neighbors);
+  void SetGvid(int frame, int lvid, int gid);
+  void BuildSequenceTree() const; // with _mutex held
+  void QuerySequenceTree(int node, int lo, int hi, int n, int f0, std::vector<int>& gids) const;
+
+  typedef std::map<std::pair<int, int>, int> SeqMap;
+  void GetSeqMaps(SeqMap& seqmap, SeqMap& invseqmap) const; // serialized form of _lvid2gvid
+  void SetSeqMap(const SeqMap& seqmap);
+  void RecoverNextInterval(); // from the loaded vortex counts, which are kept per sequenced frame
   std::string NodeToString(int i, int j) const;
 
 private:
@@ -65,14 +82,18 @@ private:
   std::vector<int> _frames; // frame IDs
   std::map<Interval, VortexTransitionMatrix> _matrices;
   std::vector<struct VortexSequence> _seqs;
-  std::map<std::pair<int, int>, int> _seqmap; // <time, lid>, gid
-  std::map<std::pair<int, int>, int> _invseqmap; // <time, gid>, lid
+  std::vector<std::vector<int> > _lvid2gvid; // [frame][lid] -> gid, -1 if none; gid -> lid goes through _seqs
+  mutable std::vector<int> _seq_tree; // max last frame of sequences over ranges of gids, which are sorted by first frame
+  mutable bool _seq_tree_dirty;
   std::map<int, int> _nvortices_per_frame;
   int _max_nvortices_per_frame;
 
   std::vector<struct VortexEvent> _events;
 
-  std::mutex _mutex;
+  int _next_interval; // index of the first interval not yet sequenced
+  bool _keep_matrices;
+
+  mutable std::mutex _mutex;
 };
 
 /////////
@@ -82,8 +103,11 @@ namespace diy {
       diy::save(bb, m._frames);
       diy::save(bb, m._matrices);
       diy::save(bb, m._seqs);
-      diy::save(bb, m._seqmap);
-      diy::save(bb, m._invseqmap);
+
+      VortexTransition::SeqMap seqmap, invseqmap;
+      m.GetSeqMaps(seqmap, invseqmap);
+      diy::save(bb, seqmap);
+      diy::save(bb, invseqmap);
       diy::save(bb, m._nvortices_per_frame);
       diy::save(bb, m._max_nvortices_per_frame);
       diy::save(bb, m._events);
@@ -93,11 +117,15 @@ namespace diy {
       diy::load(bb, m._frames);
       diy::load(bb, m._matrices);
       diy::load(bb, m._seqs);
-      diy::load(bb, m._seqmap);
-      diy::load(bb, m._invseqmap);
+
+      VortexTransition::SeqMap seqmap, invseqmap;
+      diy::load(bb, seqmap);
+      diy::load(bb, invseqmap);
+      m.SetSeqMap(seqmap);
       diy::load(bb, m._nvortices_per_frame);
       diy::load(bb, m._max_nvortices_per_frame);
       diy::load(bb, m._events);
+      m.RecoverNextInterval();
     }
   };
 }
@@ -5,6 +5,7 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <climits>
 #include "def.h"
 #include "common/diy-ext.hpp"
 #include "common/VortexEvents.h"
@@ -20,7 +21,7 @@ public:
 
 public: // IO
   void SetToDummy() {_n0 = _n1 = 0; _match.clear();}
-  bool Valid() const {return _match.size()>0;}
+  bool Valid() const {return _n0 != INT_MAX && _n1 != INT_MAX;} // empty frames give valid 0-by-n matrices
   void Print() const;
   void SaveAscii(const std::string& filename) const;
   
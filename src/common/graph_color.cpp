@@ -1,6 +1,8 @@
 #include "graph_color.h"
 #include <algorithm>
 #include <cstdlib>
+#include <queue>
+#include <set>
 
 typedef struct {
   int index; 
@@ -62,3 +64,49 @@ int welsh_powell(int n, bool **M, int *cid)
 
   return k-1;
 }
+
+int interval_graph_color(int n, const int *start, const int *end, 
+    const std::vector<std::vector<int> >& adj, int *cid)
+{
+  std::vector<int> order(n);
+  for (int i=0; i<n; i++) {
+    order[i] = i;
+    cid[i] = -1;
+  }
+  std::stable_sort(order.begin(), order.end(), 
+      [start](int i, int j) {return start[i] < start[j];});
+
+  typedef std::pair<int, int> End; // <end, index>
+  std::priority_queue<End, std::vector<End>, std::greater<End> > active;
+  std::set<int> free_colors;
+  int nc = 0;
+
+  for (int k=0; k<n; k++) {
+    const int i = order[k];
+
+    // release colors of intervals that ended before this one starts
+    while (!active.empty() && active.top().first < start[i]) {
+      free_colors.insert(cid[active.top().second]);
+      active.pop();
+    }
+
+    // colors of linked intervals that are already colored
+    std::set<int> used;
+    for (int j=0; j<adj[i].size(); j++) 
+      if (cid[adj[i][j]] >= 0) used.insert(cid[adj[i][j]]);
+
+    std::set<int>::iterator it = free_colors.begin();
+    while (it != free_colors.end() && used.find(*it) != used.end()) 
+      it ++;
+
+    if (it != free_colors.end()) {
+      cid[i] = *it;
+      free_colors.erase(it);
+    } else 
+      cid[i] = nc ++;
+
+    active.push(std::make_pair(end[i], i));
+  }
+
+  return nc;
+}
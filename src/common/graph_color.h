@@ -1,6 +1,14 @@
 #ifndef _GRAPH_COLOR_H
 #define _GRAPH_COLOR_H
 
+#include <vector>
+
 int welsh_powell(int n, bool **adj, int *cid);  
 
+// greedy sweep coloring of n intervals [start, end] (inclusive). overlapping 
+// intervals and intervals linked in adj get different colors; returns the 
+// number of colors.  O((n+E) log n)
+int interval_graph_color(int n, const int *start, const int *end, 
+    const std::vector<std::vector<int> >& adj, int *cid);
+
 #endif
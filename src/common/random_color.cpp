@@ -2,6 +2,8 @@
 #include "zcolor.h"
 #include <algorithm>
 #include <cstdlib>
+#include <map>
+#include <set>
 
 void generate_random_colors(int count, std::vector<unsigned char>& colors)
 {
@@ -10,7 +12,7 @@ void generate_random_colors(int count, std::vector<unsigned char>& colors)
 
   std::vector<double> hues(count), intensities(count);
   for (int i=0; i<count; i++) {
-    hues[i] = (double)i/(count-1);
+    hues[i] = (double)i/count; // hue is periodic; 1 would repeat 0
     intensities[i] = (double)i/(count-1)*0.1+0.4;
   }
 
@@ -51,7 +53,7 @@ void generate_colors(int count, std::vector<unsigned char>& colors)
 
   std::vector<double> hues(count);
   for (int i=0; i<count; i++) 
-    hues[i] = (double)i/(count-1);
+    hues[i] = (double)i/count; // hue is periodic; 1 would repeat 0
   
   for (int i=0; i<count; i++) {
     ZHSI hsi;
@@ -68,3 +70,68 @@ void generate_colors(int count, std::vector<unsigned char>& colors)
   }
 }
 
+
+// successive hues spaced by the golden ratio; quantized to 8 bits they 
+// repeat, so only the first occurrence of each color is kept
+static void golden_ratio_color(int i, unsigned char &r, unsigned char &g, unsigned char &b)
+{
+  const double golden_ratio_conjugate = 0.618033988749895;
+  double hue = i * golden_ratio_conjugate;
+  hue -= (long)hue;
+
+  ZHSI hsi;
+  hsi.hue = hue;
+  hsi.saturation = 0.7;
+  hsi.intensity = 0.5;
+
+  ZRGB rgb;
+  ZColor::HSI2RGB(&hsi, &rgb);
+
+  r = rgb.red * 255;
+  g = rgb.green * 255;
+  b = rgb.blue * 255;
+}
+
+static const std::vector<int>& color_palette() // packed rgb
+{
+  static const std::vector<int> palette = []() {
+    const int nprobes = 16384; // no new colors appear after the first ~5600 hues
+    std::vector<int> colors;
+    std::set<int> seen;
+    for (int i=0; i<nprobes; i++) {
+      unsigned char r, g, b;
+      golden_ratio_color(i, r, g, b);
+      const int rgb = (r << 16) | (g << 8) | b;
+      if (seen.insert(rgb).second) colors.push_back(rgb);
+    }
+    return colors;
+  }();
+  return palette;
+}
+
+int num_distinct_colors()
+{
+  return color_palette().size();
+}
+
+void generate_color(int i, unsigned char &r, unsigned char &g, unsigned char &b)
+{
+  const std::vector<int> &palette = color_palette();
+  const int rgb = palette[i % palette.size()];
+  r = rgb >> 16;
+  g = (rgb >> 8) & 0xff;
+  b = rgb & 0xff;
+}
+
+int color_index(unsigned char r, unsigned char g, unsigned char b)
+{
+  static const std::map<int, int> index = []() {
+    std::map<int, int> m;
+    const std::vector<int> &palette = color_palette();
+    for (int i=0; i<palette.size(); i++) 
+      m[palette[i]] = i;
+    return m;
+  }();
+  std::map<int, int>::const_iterator it = index.find((r << 16) | (g << 8) | b);
+  return it == index.end() ? -1 : it->second;
+}
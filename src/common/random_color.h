@@ -6,5 +6,8 @@
 
 void generate_random_colors(int count, std::vector<unsigned char>& colors);
 void generate_colors(int count, std::vector<unsigned char>& colors);
+void generate_color(int i, unsigned char &r, unsigned char &g, unsigned char &b); // i-th of a sequence of distinct colors, repeating after num_distinct_colors()
+int num_distinct_colors();
+int color_index(unsigned char r, unsigned char g, unsigned char b); // inverse of generate_color, -1 if not generated
 
 #endif
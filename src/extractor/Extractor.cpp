@@ -1,11 +1,15 @@
 #include "Extractor.h"
 #include "common/Utils.hpp"
 #include "common/VortexTransition.h"
+#include "common/VortexLineSet.h"
 #include "common/MeshGraphRegular3DTets.h"
+#include "common/Profiler.h"
 #include "io/GLDataset.h"
 #include "io/GLGPU3DDataset.h"
+#include "Philox.h"
 #include <pthread.h>
 #include <set>
+#include <algorithm>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
@@ -17,7 +21,6 @@
 #endif
 
 #include <thread>
-#include <chrono>
 
 typedef struct {
   VortexExtractor *extractor;
@@ -31,6 +34,7 @@ VortexExtractor::VortexExtractor() :
   _dataset(NULL), 
 #if WITH_ROCKSDB
   _db(NULL),
+  _own_db(false),
 #endif
   _gauge(false), 
   _vfgpu_ctx(NULL),
@@ -38,10 +42,14 @@ VortexExtractor::VortexExtractor() :
   _gpu(false),
   _cond(false),
   _pertubation(0),
+  _realization(0),
+  _seed(1234),
   _extent_threshold(0),
+  _roi(false),
   _interpolation_mode(INTERPOLATION_TRI_BARYCENTRIC | INTERPOLATION_QUAD_BILINEAR)
 {
   pthread_mutex_init(&_mutex, NULL);
+  _vortex_transition.SetKeepMatrices(false); // only sequences and events are kept
 
   // probe number of cores
   _nthreads = std::thread::hardware_concurrency();
@@ -59,7 +67,7 @@ VortexExtractor::~VortexExtractor()
 #endif
 
 #if WITH_ROCKSDB
-  if (_db != NULL)
+  if (_own_db && _db != NULL)
     delete _db;
 #endif
 }
@@ -80,20 +88,110 @@ void VortexExtractor::OpenDB(const std::string &name)
   options.compression = rocksdb::kBZip2Compression;
   rocksdb::Status status = rocksdb::DB::Open(options, dbname.c_str(), &_db);
   assert(status.ok());
+  _own_db = true;
 #else
   assert(false);
 #endif
 }
 
+#if WITH_ROCKSDB
+void VortexExtractor::SetDB(rocksdb::DB* db)
+{
+  if (_own_db && _db != NULL) 
+    delete _db;
+  _db = db;
+  _own_db = false;
+}
+#endif
+
 void VortexExtractor::SetDataset(const GLDatasetBase* ds)
 {
   _dataset = ds;
 
 #if WITH_ROCKSDB
-  OpenDB(ds->DataName());
+  if (_db == NULL)
+    OpenDB(ds->DataName());
 #endif
 }
 
+void VortexExtractor::SetRegionOfInterest(const RegionOfInterest& roi)
+{
+  const GLDataset *ds = (GLDataset*)_dataset;
+  const MeshGraph *mg = _dataset->MeshGraph();
+
+  _roi = !roi.Empty();
+  _roi_faces.clear();
+  _roi_edges.clear();
+  _roi_cells.clear();
+  if (!_roi) return;
+
+  // on regular grids the elements are numbered by their first node, so
+  // only the nodes in the bounds of the region are visited
+  const GLGPUDataset *gds = dynamic_cast<const GLGPUDataset*>(_dataset);
+  const auto candidates = [&](size_t nelems, std::vector<unsigned int>& ids) {
+    ids.clear();
+    if (gds == NULL) {
+      for (size_t i=0; i<nelems; i++) ids.push_back(i);
+      return;
+    }
+    const int *d = gds->dims();
+    const size_t nnodes = (size_t)d[0] * d[1] * d[2], 
+                 per_node = nelems / nnodes;
+    float LB[3], UB[3];
+    int lo[3], hi[3];
+    roi.Bounds(LB, UB);
+    for (int k=0; k<3; k++) {
+      lo[k] = std::max(0, (int)floor((LB[k] - gds->Origins()[k]) / gds->CellLengths()[k]));
+      hi[k] = std::min(d[k]-1, (int)ceil((UB[k] - gds->Origins()[k]) / gds->CellLengths()[k]));
+    }
+    for (int z=lo[2]; z<=hi[2]; z++) 
+      for (int y=lo[1]; y<=hi[1]; y++) 
+        for (int x=lo[0]; x<=hi[0]; x++) {
+          const size_t n = x + d[0] * (y + (size_t)d[1] * z);
+          for (size_t t=0; t<per_node; t++) 
+            ids.push_back(n * per_node + t);
+        }
+  };
+
+  std::vector<unsigned int> ids;
+  candidates(mg->NFaces(), ids);
+  for (size_t i=0; i<ids.size(); i++) {
+    const CFace face = mg->Face(ids[i], true);
+    if (!face.Valid()) continue;
+    bool inside = true;
+    for (int j=0; j<face.nodes.size() && inside; j++) {
+      float X[3];
+      ds->Pos(face.nodes[j], X);
+      inside = roi.Contains(X);
+    }
+    if (inside) _roi_faces.push_back(ids[i]);
+  }
+
+  std::vector<CellIdType> cells;
+  for (size_t i=0; i<_roi_faces.size(); i++) {
+    const CFace face = mg->Face(_roi_faces[i]);
+    _roi_edges.insert(_roi_edges.end(), face.edges.begin(), face.edges.end());
+    for (int j=0; j<face.contained_cells.size(); j++) 
+      if (face.contained_cells[j] != UINT_MAX) 
+        cells.push_back(face.contained_cells[j]);
+  }
+  std::sort(_roi_edges.begin(), _roi_edges.end());
+  _roi_edges.erase(std::unique(_roi_edges.begin(), _roi_edges.end()), _roi_edges.end());
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+  for (size_t i=0; i<cells.size(); i++) {
+    const CCell cell = mg->Cell(cells[i]);
+    bool inside = true;
+    for (int j=0; j<cell.faces.size() && inside; j++) 
+      inside = std::binary_search(_roi_faces.begin(), _roi_faces.end(), cell.faces[j]);
+    if (inside) _roi_cells.push_back(cells[i]);
+  }
+
+  fprintf(stderr, "region of interest: #faces=%lu, #edges=%lu, #cells=%lu\n", 
+      _roi_faces.size(), _roi_edges.size(), _roi_cells.size());
+}
+
 void VortexExtractor::SetGaugeTransformation(bool g)
 {
   _gauge = g; 
@@ -119,6 +217,12 @@ void VortexExtractor::SetPertubation(float p)
   _pertubation = p;
 }
 
+void VortexExtractor::SetRealization(int r, unsigned int seed)
+{
+  _realization = r;
+  _seed = seed;
+}
+
 void VortexExtractor::SetExtentThreshold(float threshold)
 {
   _extent_threshold = threshold;
@@ -126,6 +230,7 @@ void VortexExtractor::SetExtentThreshold(float threshold)
 
 void VortexExtractor::SaveVortexLinesToFile(std::string filename, int slot)
 {
+  ProfileScope prof(PROF_SAVE);
   const GLDatasetBase *ds = _dataset;
   std::vector<VortexObject> &vobjs = 
     slot == 0 ? _vortex_objects : _vortex_objects1;
@@ -141,9 +246,10 @@ void VortexExtractor::SaveVortexLinesToFile(std::string filename, int slot)
 
   std::stringstream ss;
   std::string buf;
-  diy::serialize(vlines, buf);
+  diy::serialize(VortexLineSet(vlines), buf);
   ss << "v." << ds->TimeStep(slot);
   rocksdb::Status status = _db->Put(rocksdb::WriteOptions(), ss.str(), buf);
+  Profiler::Count(PROF_DB_BYTES_WRITTEN, ss.str().size() + buf.size());
 #else
   // diy::serializeToFile(vlines, os.str()); // TODO
   // ::SaveVortexLines(vlines, info, os.str()); // FIXME!
@@ -191,6 +297,8 @@ void VortexExtractor::ClearPuncturedObjects()
   _punctured_edges.clear();
   _punctured_faces.clear();
   _punctured_faces1.clear();
+  _punctured_cells.clear();
+  _punctured_cells1.clear();
 }
 
 void VortexExtractor::Clear()
@@ -201,6 +309,73 @@ void VortexExtractor::Clear()
   _vortex_objects1.clear();
   _vortex_lines.clear();
   _vortex_lines1.clear();
+  _related_faces.clear();
+  _vortex_transition.Clear();
+}
+
+#if WITH_ROCKSDB
+static const std::string key_ckpt = "ckpt";
+#endif
+
+bool VortexExtractor::SaveCheckpoint()
+{
+  ProfileScope prof(PROF_SAVE);
+  const int timestep = _dataset->TimeStep(0);
+
+  std::string buf;
+  diy::StringBuffer bb(buf);
+  diy::save(bb, timestep);
+  diy::save(bb, _punctured_faces);
+  diy::save(bb, _vortex_objects);
+  diy::save(bb, _vortex_transition);
+
+#if WITH_ROCKSDB
+  assert(_db);
+  rocksdb::Status s = _db->Put(rocksdb::WriteOptions(), key_ckpt, buf);
+  Profiler::Count(PROF_DB_BYTES_WRITTEN, key_ckpt.size() + buf.size());
+  return s.ok();
+#else
+  const std::string filename = _dataset->DataName() + ".ckpt", 
+                    filename_tmp = filename + ".tmp";
+  FILE *fp = fopen(filename_tmp.c_str(), "wb");
+  if (!fp) return false;
+  const bool succ = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+  fclose(fp);
+  // replace the previous checkpoint only when the new one is complete
+  return succ && rename(filename_tmp.c_str(), filename.c_str()) == 0;
+#endif
+}
+
+bool VortexExtractor::LoadCheckpoint(int &timestep)
+{
+  std::string buf;
+
+#if WITH_ROCKSDB
+  assert(_db);
+  rocksdb::Status s = _db->Get(rocksdb::ReadOptions(), key_ckpt, &buf);
+  if (!s.ok()) return false;
+#else
+  const std::string filename = _dataset->DataName() + ".ckpt";
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp) return false;
+  fseek(fp, 0, SEEK_END);
+  buf.resize(ftell(fp));
+  fseek(fp, 0, SEEK_SET);
+  const bool succ = fread(&buf[0], 1, buf.size(), fp) == buf.size();
+  fclose(fp);
+  if (!succ) return false;
+#endif
+  if (buf.empty()) return false;
+
+  Clear();
+
+  diy::StringBuffer bb(buf);
+  diy::load(bb, timestep);
+  diy::load(bb, _punctured_faces);
+  diy::load(bb, _vortex_objects);
+  diy::load(bb, _vortex_transition);
+
+  return true;
 }
 
 bool VortexExtractor::SavePuncturedEdges() const
@@ -258,6 +433,7 @@ bool VortexExtractor::LoadPuncturedFaces(int slot)
 
 void VortexExtractor::AddPuncturedFace(FaceIdType id, int slot, ChiralityType chirality, const float pos[], float cond)
 {
+  Profiler::Count(PROF_PUNCTURES);
   pthread_mutex_lock(&_mutex);
   
   // face
@@ -283,6 +459,8 @@ void VortexExtractor::AddPuncturedFace(FaceIdType id, int slot, ChiralityType ch
   for (int i=0; i<face.contained_cells.size(); i++) {
     CellIdType cid = face.contained_cells[i];
     if (cid == UINT_MAX) continue;
+    if (_roi && !std::binary_search(_roi_cells.begin(), _roi_cells.end(), cid)) 
+      continue; // cut by the boundary of the region
 
     int fchirality = face.contained_cells_chirality[i];
     int fid = face.contained_cells_fid[i];
@@ -347,6 +525,7 @@ bool VortexExtractor::FindSpaceTimeEdgeZero(const float re[], const float im[],
 
 void VortexExtractor::RelateOverTime()
 {
+  ProfileScope prof(PROF_RELATE);
   // fprintf(stderr, "Relating over time, #pf0=%ld, #pf1=%ld, #pe=%ld\n", 
   //     _punctured_faces.size(), _punctured_faces1.size(), _punctured_edges.size());
   const MeshGraph *mg = _dataset->MeshGraph();
@@ -505,6 +684,7 @@ void VortexExtractor::TraceVirtualCells()
 
 void VortexExtractor::TraceOverSpace(int slot)
 {
+  ProfileScope prof(PROF_TRACE_SPACE);
   std::vector<VortexObject> &vobjs = 
     slot == 0 ? _vortex_objects : _vortex_objects1;
   std::vector<VortexLine> &vlines = 
@@ -615,8 +795,8 @@ void VortexExtractor::TraceOverSpace(int slot)
         if (!traced) break;
       }
 
-      // loop detection
-      {
+      // loop detection; a trace that left the region of interest is open
+      if (!_roi || ordinary_pcells.find(c) != ordinary_pcells.end()) {
         const PuncturedCell &pcell = ordinary_pcells[seed];
         const CCell &cell = mg->Cell(c);
         for (int i=0; i<cell.neighbor_cells.size(); i++) {
@@ -678,6 +858,7 @@ void VortexExtractor::VortexObjectsToVortexLines(
     const std::vector<VortexObject>& vobjs, 
     std::vector<VortexLine>& vlines, bool bezier)
 {
+  std::vector<VortexLine> lines;
   for (int i=0; i<vobjs.size(); i++) {
     const VortexObject& vobj = vobjs[i];
     VortexLine line;
@@ -701,14 +882,21 @@ void VortexExtractor::VortexObjectsToVortexLines(
       }
     }
 
-    if (bezier) {
-      line.Flattern(Dataset()->Origins(), Dataset()->Lengths());
-      line.ToBezier();
-    }
-
     if (vobj.loop) line.is_loop = true;
+    lines.push_back(line);
+  }
 
-    if (vobj.loop && _extent_threshold > 0) {
+  if (bezier) {
+    VortexLineProcessing p;
+    p.O = Dataset()->Origins();
+    p.L = Dataset()->Lengths();
+    p.bezier_error_bound = 0.01;
+    ProcessVortexLines(lines, p, _nthreads);
+  }
+
+  for (int i=0; i<lines.size(); i++) {
+    const VortexLine& line = lines[i];
+    if (line.is_loop && _extent_threshold > 0) {
       if (line.MaxExtent() < _extent_threshold) {
         fprintf(stderr, "loop filtered, extent=%f\n", line.MaxExtent());
         continue;
@@ -726,8 +914,9 @@ int VortexExtractor::NewGlobalVortexId()
 }
 
 // only relate ids
-VortexTransitionMatrix VortexExtractor::TraceOverTime()
+VortexTransitionMatrix VortexExtractor::TransitionMatrix()
 {
+  ProfileScope prof(PROF_TRACE_TIME);
   const int n0 = _vortex_objects.size(), 
             n1 = _vortex_objects1.size();
   // VortexTransitionMatrix &tm = _vortex_transition[_dataset->TimeStep(0)]; 
@@ -757,7 +946,24 @@ next:
   }
 
   // if (_archive) tm.SaveToFile(Dataset()->DataName(), Dataset()->TimeStep(0), Dataset()->TimeStep(1));
-  _vortex_transition.AddMatrix(tm);
+  tm.Modularize();
+  return tm;
+}
+
+VortexTransitionMatrix VortexExtractor::TraceOverTime()
+{
+  VortexTransitionMatrix tm = TransitionMatrix();
+  const int f0 = tm.t0(), f1 = tm.t1();
+
+  // consecutive intervals extend the sequences
+  const std::vector<int> &frames = _vortex_transition.Frames();
+  if (frames.empty()) 
+    _vortex_transition.AddFrame(f0);
+  if (frames.back() == f0) {
+    _vortex_transition.AddFrame(f1);
+    _vortex_transition.AddMatrix(tm);
+    _vortex_transition.UpdateSequence();
+  }
   // tm.Print();
 
 #if 0 // WITH_ROCKSDB
@@ -877,9 +1083,6 @@ void VortexExtractor::ExtractFaces_GPU(int slot)
 
   vfgpu_upload_data(_vfgpu_ctx, slot, gh, re, im);
  
-  typedef std::chrono::high_resolution_clock clock;
-  auto t0 = clock::now();
-
   int pfcount; 
   vfgpu_pf_t *pf; 
  
@@ -902,10 +1105,6 @@ void VortexExtractor::ExtractFaces_GPU(int slot)
   vfgpu_get_pflist(_vfgpu_ctx, &pfcount, &pf);
 #endif
 
-  auto t1 = clock::now();
-  float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
-  fprintf(stderr, "t_fgpu=%f\n", elapsed);
-
   for (int i=0; i<pfcount; i++) {
     float pos[3] = {pf[i].pos[0], pf[i].pos[1], pf[i].pos[2]};
     AddPuncturedFace(pf[i].fid, slot, pf[i].chirality, pos);
@@ -934,18 +1133,11 @@ void VortexExtractor::ExtractEdges_GPU()
 
   const int count = h.dims[0] * h.dims[1] * h.dims[2];
  
-  typedef std::chrono::high_resolution_clock clock;
-  auto t0 = clock::now();
-
   int pecount; 
   vfgpu_pe_t *pe; 
   vfgpu_extract_edges(_vfgpu_ctx);
   vfgpu_get_pelist(_vfgpu_ctx, &pecount, &pe); 
 
-  auto t1 = clock::now();
-  float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
-  fprintf(stderr, "t_egpu=%f\n", elapsed);
-
   for (int i=0; i<pecount; i++) {
     AddPuncturedEdge(pe[i].eid, pe[i].chirality, 0);
   }
@@ -954,10 +1146,10 @@ void VortexExtractor::ExtractEdges_GPU()
 
 void VortexExtractor::ExtractFaces(int slot) 
 {
-  typedef std::chrono::high_resolution_clock clock;
-  auto t0 = clock::now();
+  ProfileScope prof(PROF_FACES);
 
-  if (!LoadPuncturedFaces(slot)) {
+  const bool perturbed = _pertubation > 0; // never archived
+  if (perturbed || !LoadPuncturedFaces(slot)) {
     if (_gpu) {
       ExtractFaces_GPU(slot);
     } else {
@@ -986,18 +1178,15 @@ void VortexExtractor::ExtractFaces(int slot)
         ExtractFace(i, slot);
 #endif
     }
-    if (_archive) SavePuncturedFaces(slot);
+    if (_archive && !perturbed) SavePuncturedFaces(slot);
   }
- 
-  auto t1 = clock::now();
-  float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
-  fprintf(stderr, "t_f=%f\n", elapsed);
 }
 
 void VortexExtractor::ExtractFaces(std::vector<FaceIdType> faces, int slot, int &positive, int &negative)
 {
   for (int i=0; i<faces.size(); i++) 
     ExtractFace(faces[i], slot);
+  Profiler::Count(PROF_FACES_TESTED, faces.size());
 
   const std::map<FaceIdType, PuncturedFace> &pfs = slot==0 ? _punctured_faces : _punctured_faces1;
 
@@ -1014,8 +1203,7 @@ void VortexExtractor::ExtractFaces(std::vector<FaceIdType> faces, int slot, int
 
 void VortexExtractor::ExtractEdges() 
 {
-  typedef std::chrono::high_resolution_clock clock;
-  auto t0 = clock::now();
+  ProfileScope prof(PROF_EDGES);
 
   if (!LoadPuncturedEdges()) {
     if (_gpu) {
@@ -1048,10 +1236,6 @@ void VortexExtractor::ExtractEdges()
     }
     if (_archive) SavePuncturedEdges();
   }
-  
-  auto t1 = clock::now();
-  float elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
-  fprintf(stderr, "t_e=%f\n", elapsed);
 }
 
 void VortexExtractor::ExtractSpaceTimeEdge(EdgeIdType id)
@@ -1123,22 +1307,25 @@ int VortexExtractor::ExtractFace(FaceIdType id, int slot)
 {
   const GLHeader& hdr = _dataset->GetHeader(slot); 
   const GLDataset *ds = (GLDataset*)_dataset;
-  const MeshGraphRegular3DTets *mg = (const MeshGraphRegular3DTets*)_dataset->MeshGraph();
-  
-  const CFace& f = mg->Face(id, true);
+  const CFace& f = _dataset->MeshGraph()->Face(id, true);
   const int nnodes = f.nodes.size();
 
   if (!f.Valid()) return 0;
 
-  int nidx0[3], nidx1[3], nidx2[3];
-  mg->nid2nidx(f.nodes[0], nidx0);
-  mg->nid2nidx(f.nodes[1], nidx1);
-  mg->nid2nidx(f.nodes[2], nidx2);
-  // fprintf(stderr, "%d, %d, %d\n", f.nodes[0], f.nodes[1], f.nodes[2]);
-
   float X[nnodes][3], A[nnodes][3];
   float rho[nnodes], phi[nnodes], re[nnodes], im[nnodes];
   ds->GetFaceValues(f, slot, X, A, rho, phi, re, im);
+
+  if (_pertubation > 0) { // same noise for a node in all faces of a realization
+    for (int i=0; i<nnodes; i++) {
+      float dre, dim;
+      philox_normal2(f.nodes[i], _realization, _seed, _pertubation, dre, dim);
+      re[i] += dre;
+      im[i] += dim;
+      rho[i] = sqrt(re[i]*re[i] + im[i]*im[i]);
+      phi[i] = atan2(im[i], re[i]);
+    }
+  }
   
 #if 1 // pbc
   for (int i=1; i<nnodes; i++) {
@@ -1217,12 +1404,18 @@ void VortexExtractor::execute_thread(int nthreads, int tid, int type, int slot)
 
   // fprintf(stderr, "nthreads=%d, tid=%d, type=%d\n", nthreads, tid, type);
   if (type == 0) {
-    for (FaceIdType i=tid; i<mg->NFaces(); i+=nthreads) {
-      ExtractFace(i, slot);
+    const FaceIdType nfaces = _roi ? _roi_faces.size() : mg->NFaces();
+    FaceIdType n = 0;
+    for (FaceIdType i=tid; i<nfaces; i+=nthreads, n++) {
+      ExtractFace(_roi ? _roi_faces[i] : i, slot);
     }
+    Profiler::Count(PROF_FACES_TESTED, n);
   } else if (type == 1) { // TODO
-    for (EdgeIdType i=tid; i<mg->NEdges(); i+=nthreads) 
-      ExtractSpaceTimeEdge(i);
+    const EdgeIdType nedges = _roi ? _roi_edges.size() : mg->NEdges();
+    EdgeIdType n = 0;
+    for (EdgeIdType i=tid; i<nedges; i+=nthreads, n++) 
+      ExtractSpaceTimeEdge(_roi ? _roi_edges[i] : i);
+    Profiler::Count(PROF_EDGES_TESTED, n);
   } else assert(false);
 }
 
@@ -1270,6 +1463,18 @@ bool VortexExtractor::FindFaceZero(int n, const float X_[][3], const float re[],
   return succ;
 }
 
+void VortexExtractor::SetPuncturedFaces(const std::map<FaceIdType, PuncturedFace>& pfs, int slot)
+{
+  if (slot == 0) _punctured_faces = pfs;
+  else _punctured_faces1 = pfs;
+}
+
+const std::map<FaceIdType, PuncturedFace>& VortexExtractor::GetPuncturedFaces(int slot) const
+{
+  if (slot == 0) return _punctured_faces;
+  else return _punctured_faces1;
+}
+
 void VortexExtractor::SetVortexObjects(const std::vector<VortexObject>& vobj, int slot)
 {
   if (slot == 0) _vortex_objects = vobj;
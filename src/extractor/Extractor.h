@@ -5,6 +5,7 @@
 #include "common/VortexObject.h"
 #include "common/VortexTransition.h"
 #include "common/Puncture.h"
+#include "common/RegionOfInterest.h"
 #include "InverseInterpolation.h"
 #include <map>
 
@@ -27,23 +28,35 @@ enum {
 class VortexExtractor {
 public: 
   VortexExtractor(); 
-  ~VortexExtractor(); 
+  virtual ~VortexExtractor(); 
 
   void SetNumberOfThreads(int);
+  int NumberOfThreads() const {return _nthreads;}
   void SetInterpolationMode(unsigned int);
 
   void OpenDB(const std::string &dbname);
+#if WITH_ROCKSDB
+  void SetDB(rocksdb::DB* db); // shares an opened DB; must be called before SetDataset
+  rocksdb::DB* DB() const {return _db;}
+#endif
 
   void SetGaugeTransformation(bool);
   void SetArchive(bool); // archive intermediate results for data reuse
   void SetExtentThreshold(float);
   void SetGPU(bool);
   void SetCond(bool); // extrat faces and return condition numbers
-  void SetPertubation(float);
+  void SetPertubation(float); // std dev of the noise added to re and im on the CPU
+  void SetRealization(int r, unsigned int seed=1234); // selects the noise of the perturbed realization r
   
   virtual void SetDataset(const GLDatasetBase* ds);
   const GLDataset* Dataset() const {return (GLDataset*)_dataset;}
 
+  // restricts the CPU extraction to the faces with all nodes in the region
+  // and to their space-time edges; cells cut by the region boundary are not
+  // traced through, so lines leaving the region end on its boundary.  Must
+  // be called after SetDataset; an empty region extracts everything.
+  void SetRegionOfInterest(const RegionOfInterest&);
+
   void ExtractFaces(int slot=0);
   void ExtractFaces(std::vector<FaceIdType> faces, int slot, int &positive, int &negative);
   void ExtractEdges();
@@ -57,6 +70,11 @@ public:
   bool LoadPuncturedFaces(int slot=0);
   void ClearPuncturedObjects();
   void Clear();
+  void SetPuncturedFaces(const std::map<FaceIdType, PuncturedFace>&, int slot);
+  const std::map<FaceIdType, PuncturedFace>& GetPuncturedFaces(int slot) const;
+
+  bool SaveCheckpoint(); // tracking state of slot 0, which holds the last completed timestep
+  bool LoadCheckpoint(int &timestep);
   
   void SaveVortexLines(int slot=0);
   void SaveVortexLinesToFile(std::string filename, int slot=0);
@@ -66,7 +84,8 @@ public:
 
   void TraceVirtualCells();
   void TraceOverSpace(int slot=0);
-  VortexTransitionMatrix TraceOverTime();
+  VortexTransitionMatrix TraceOverTime(); // also extends the sequences of the extractor
+  VortexTransitionMatrix TransitionMatrix(); // relates the vortices of slots 0 and 1 only
   void AnalyzeTransition();
 
   void RelateOverTime();
@@ -111,12 +130,20 @@ protected:
   bool _cond;
   unsigned int _interpolation_mode;
   float _pertubation; // used for stochastic analysis
+  int _realization;
+  unsigned int _seed;
   float _extent_threshold;
 
+  bool _roi;
+  std::vector<FaceIdType> _roi_faces; // sorted
+  std::vector<EdgeIdType> _roi_edges;
+  std::vector<CellIdType> _roi_cells; // cells whose faces are all in the region, sorted
+
   struct vfgpu_ctx_t *_vfgpu_ctx;
 
 #if WITH_ROCKSDB
   rocksdb::DB *_db;
+  bool _own_db;
 #endif
 
 private:
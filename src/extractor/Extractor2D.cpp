@@ -0,0 +1,378 @@
+#include "Extractor2D.h"
+#include "InverseInterpolation.h"
+#include "common/VortexLine.h"
+#include "common/Profiler.h"
+#include "io/GLGPUDataset.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <sstream>
+#include <cmath>
+
+static const float twopi = 2*M_PI, inv_twopi = 0.5*M_1_PI;
+
+// same as mod2pi1 in single precision, so that the row sweeps vectorize
+static inline float wrap_phase(float x)
+{
+  return x - twopi * floorf((x + (float)M_PI) * inv_twopi);
+}
+
+static inline signed char winding_chirality(float w, bool closed)
+{
+  // faces are punctured from half a turn on, space-time edges beyond it
+  if (closed) return (w >= 0.5f) - (w <= -0.5f);
+  else return (w > 0.5f) - (w < -0.5f);
+}
+
+template <typename F>
+static void parallel_for(int n, int nthreads, F f)
+{
+  std::atomic<int> next(0);
+  std::vector<std::thread> threads;
+  for (int t=0; t<nthreads; t++)
+    threads.push_back(std::thread([&]() {
+      for (int i = next++; i < n; i = next++) f(i);
+    }));
+  for (int t=0; t<nthreads; t++)
+    threads[t].join();
+}
+
+VortexExtractor2D::VortexExtractor2D() :
+  _dataset(NULL),
+  _gauge(false),
+  _nthreads(0)
+{
+}
+
+VortexExtractor2D::~VortexExtractor2D()
+{
+}
+
+void VortexExtractor2D::SetDataset(GLGPUDataset* ds)
+{
+  _dataset = ds;
+  for (int k=0; k<2; k++) {
+    _d[k] = ds->dims()[k];
+    _pbc[k] = ds->pbc()[k];
+  }
+}
+
+void VortexExtractor2D::SetNumberOfThreads(int n)
+{
+  _nthreads = n;
+}
+
+void VortexExtractor2D::SetGaugeTransformation(bool g)
+{
+  _gauge = g;
+}
+
+bool VortexExtractor2D::ValidCell(int i, int j) const
+{
+  return i < (_pbc[0] ? _d[0] : _d[0]-1) && j < (_pbc[1] ? _d[1] : _d[1]-1);
+}
+
+static int nthreads_or_default(int n)
+{
+  if (n <= 0) n = std::thread::hardware_concurrency();
+  return n <= 0 ? 1 : n;
+}
+
+void VortexExtractor2D::ComputeEdgePhases(int slot)
+{
+  GLHeader h;
+  float *rho, *phi, *re, *im, *J;
+  _dataset->GetDataArray(h, &rho, &phi, &re, &im, &J, slot);
+
+  const int nx = _d[0], ny = _d[1];
+  std::vector<float> &ex = _ex[slot], &ey = _ey[slot];
+  ex.resize((size_t)nx*ny);
+  ey.resize((size_t)nx*ny);
+
+  // line integrals along the edges; A_x of the GLGPU gauge varies only
+  // along y and A_y only along x
+  std::vector<float> lx(ny, 0.f), ly(nx, 0.f);
+  if (_gauge) {
+    float X[3] = {h.origins[0], h.origins[1], h.origins[2]}, A[3];
+    for (int j=0; j<ny; j++) {
+      X[1] = j * h.cell_lengths[1] + h.origins[1];
+      _dataset->A(X, A, slot);
+      lx[j] = A[0] * h.cell_lengths[0];
+    }
+    X[1] = h.origins[1];
+    for (int i=0; i<nx; i++) {
+      X[0] = i * h.cell_lengths[0] + h.origins[0];
+      _dataset->A(X, A, slot);
+      ly[i] = A[1] * h.cell_lengths[1];
+    }
+  }
+
+  parallel_for(ny, nthreads_or_default(_nthreads), [&](int j) {
+    const float *p = phi + (size_t)nx*j,
+                *p1 = phi + (size_t)nx*(j+1 < ny ? j+1 : 0);
+    float *ex_ = &ex[(size_t)nx*j], *ey_ = &ey[(size_t)nx*j];
+    const float lxj = lx[j];
+
+    for (int i=0; i<nx-1; i++)
+      ex_[i] = wrap_phase(p[i+1] - p[i] - lxj);
+    ex_[nx-1] = wrap_phase(p[0] - p[nx-1] - lxj);
+    for (int i=0; i<nx; i++)
+      ey_[i] = wrap_phase(p1[i] - p[i] - ly[i]);
+  });
+}
+
+void VortexExtractor2D::ExtractPoints(int slot)
+{
+  ProfileScope prof(PROF_FACES);
+  ComputeEdgePhases(slot);
+
+  GLHeader h;
+  float *rho, *phi, *re, *im, *J;
+  _dataset->GetDataArray(h, &rho, &phi, &re, &im, &J, slot);
+
+  const int nx = _d[0], ny = _d[1];
+  const int fx = _pbc[0] ? nx : nx-1,
+            fy = _pbc[1] ? ny : ny-1;
+  const std::vector<float> &ex = _ex[slot], &ey = _ey[slot];
+  std::vector<signed char> &fc = _face_chirality[slot];
+  fc.assign((size_t)nx*ny, 0);
+
+  std::vector<std::vector<PointVortex> > rows(fy);
+  parallel_for(fy, nthreads_or_default(_nthreads), [&](int j) {
+    const int j1 = j+1 < ny ? j+1 : 0;
+    const float *ex0 = &ex[(size_t)nx*j], *ex1 = &ex[(size_t)nx*j1],
+                *ey0 = &ey[(size_t)nx*j];
+    signed char *c = &fc[(size_t)nx*j];
+
+    // winding numbers of the faces; the edges are traversed counterclockwise
+    for (int i=0; i<nx-1; i++)
+      c[i] = winding_chirality(-(ex0[i] + ey0[i+1] - ex1[i] - ey0[i]) * inv_twopi, true);
+    if (fx == nx)
+      c[nx-1] = winding_chirality(-(ex0[nx-1] + ey0[0] - ex1[nx-1] - ey0[nx-1]) * inv_twopi, true);
+    else
+      c[nx-1] = 0;
+
+    for (int i=0; i<fx; i++) {
+      if (!c[i]) continue;
+      const int i1 = i+1 < nx ? i+1 : 0;
+      const size_t n[4] = {(size_t)nx*j + i, (size_t)nx*j + i1, (size_t)nx*j1 + i1, (size_t)nx*j1 + i};
+      const float delta[4] = {ex0[i], ey0[i1], -ex1[i], -ey0[i]};
+
+      float X[4][3], R[4], I[4];
+      const int di[4] = {0, 1, 1, 0}, dj[4] = {0, 0, 1, 1};
+      float phase = phi[n[0]];
+      for (int k=0; k<4; k++) {
+        X[k][0] = (i + di[k]) * h.cell_lengths[0] + h.origins[0]; // unwrapped over the boundaries
+        X[k][1] = (j + dj[k]) * h.cell_lengths[1] + h.origins[1];
+        X[k][2] = h.origins[2];
+        if (_gauge) { // gauge transformation
+          R[k] = rho[n[k]] * cos(phase);
+          I[k] = rho[n[k]] * sin(phase);
+          phase += delta[k];
+        } else {
+          R[k] = re[n[k]];
+          I[k] = im[n[k]];
+        }
+      }
+
+      PointVortex pv;
+      pv.fid = n[0];
+      pv.chirality = c[i];
+      const float epsilon = 0.05;
+      if (!find_zero_quad_bilinear(R, I, X, pv.pos, epsilon) &&
+          !find_zero_quad_barycentric(R, I, X, pv.pos, epsilon))
+        find_quad_center(X, pv.pos);
+      rows[j].push_back(pv);
+    }
+  });
+
+  std::vector<PointVortex> &points = _points[slot];
+  points.clear();
+  for (int j=0; j<fy; j++)
+    points.insert(points.end(), rows[j].begin(), rows[j].end());
+
+  Profiler::Count(PROF_FACES_TESTED, (size_t)fx*fy);
+  Profiler::Count(PROF_PUNCTURES, points.size());
+}
+
+void VortexExtractor2D::ExtractEdges()
+{
+  ProfileScope prof(PROF_EDGES);
+
+  GLHeader h;
+  float *rho, *phi0, *phi1, *re, *im, *J;
+  _dataset->GetDataArray(h, &rho, &phi1, &re, &im, &J, 1);
+  _dataset->GetDataArray(h, &rho, &phi0, &re, &im, &J, 0);
+
+  const int nx = _d[0], ny = _d[1];
+  const int fx = _pbc[0] ? nx : nx-1,
+            fy = _pbc[1] ? ny : ny-1;
+  const int nthreads = nthreads_or_default(_nthreads);
+
+  // phase jumps along the time edges
+  std::vector<float> et((size_t)nx*ny);
+  parallel_for(ny, nthreads, [&](int j) {
+    for (size_t n=(size_t)nx*j; n<(size_t)nx*(j+1); n++)
+      et[n] = wrap_phase(phi1[n] - phi0[n]);
+  });
+
+  // the y-edges across the periodic boundary carry the quasi-periodic
+  // phase jumps of the generic extractor
+  std::vector<float> qp0(nx, 0.f), qp1(nx, 0.f);
+  if (_pbc[1]) {
+    for (int i=0; i<nx; i++) {
+      const float X0[3] = {i * h.cell_lengths[0] + h.origins[0], (ny-1) * h.cell_lengths[1] + h.origins[1], h.origins[2]},
+                  X1[3] = {X0[0], h.origins[1], h.origins[2]};
+      qp0[i] = _dataset->QP(X0, X1);
+      qp1[i] = _dataset->QP(X1, X0);
+    }
+  }
+
+  _edge_chirality.assign((size_t)nx*ny*2, 0);
+  parallel_for(fy, nthreads, [&](int j) {
+    const int j1 = j+1 < ny ? j+1 : 0;
+    const size_t o = (size_t)nx*j;
+    const float *ex0 = &_ex[0][o], *ex1 = &_ex[1][o],
+                *ey0 = &_ey[0][o], *ey1 = &_ey[1][o],
+                *t = &et[o], *t1 = &et[(size_t)nx*j1];
+    signed char *c = &_edge_chirality[o*2];
+
+    for (int i=0; i<fx; i++) {
+      const int i1 = i+1 < nx ? i+1 : 0;
+      c[i*2] = winding_chirality(-(ex0[i] + t[i1] - ex1[i] - t[i]) * inv_twopi, false);
+    }
+    if (j1 == 0) {
+      for (int i=0; i<fx; i++)
+        c[i*2+1] = winding_chirality(-(wrap_phase(ey0[i] + qp0[i]) + t1[i] + wrap_phase(-ey1[i] + qp1[i]) - t[i]) * inv_twopi, false);
+    } else {
+      for (int i=0; i<fx; i++)
+        c[i*2+1] = winding_chirality(-(ey0[i] + t1[i] - ey1[i] - t[i]) * inv_twopi, false);
+    }
+  });
+
+  Profiler::Count(PROF_EDGES_TESTED, (size_t)fx*fy*2);
+}
+
+void VortexExtractor2D::RelatedFaces(const PointVortex& p, std::vector<FaceIdType>& related) const
+{
+  const int nx = _d[0], ny = _d[1];
+  const std::vector<signed char> &fc1 = _face_chirality[1];
+
+  std::vector<std::pair<FaceIdType, int> > to_visit; // face and the chirality of the worldline
+  std::vector<FaceIdType> faces_visited;
+  std::vector<EdgeIdType> edges_visited;
+
+  related.clear();
+  to_visit.push_back(std::make_pair(p.fid, (int)p.chirality));
+
+  while (!to_visit.empty()) {
+    const FaceIdType f = to_visit.back().first;
+    const int chirality = to_visit.back().second;
+    to_visit.pop_back();
+    faces_visited.push_back(f);
+
+    if (fc1[f] == chirality)
+      related.push_back(f);
+
+    const int i = f % nx, j = f / nx,
+              i1 = i+1 < nx ? i+1 : 0, j1 = j+1 < ny ? j+1 : 0;
+    const EdgeIdType edges[4] = {
+      (EdgeIdType)(i + nx*j)*2, (EdgeIdType)(i1 + nx*j)*2 + 1,
+      (EdgeIdType)(i + nx*j1)*2, (EdgeIdType)(i + nx*j)*2 + 1};
+    const int edges_chirality[4] = {1, 1, -1, -1};
+
+    for (int k=0; k<4; k++) {
+      const EdgeIdType e = edges[k];
+      const int pe = _edge_chirality[e];
+      if (!pe || std::find(edges_visited.begin(), edges_visited.end(), e) != edges_visited.end())
+        continue;
+      edges_visited.push_back(e);
+      if (chirality != edges_chirality[k] * pe) continue;
+
+      // the two faces containing the edge, and the orientation of the edge in them
+      const int ei = (e/2) % nx, ej = (e/2) / nx;
+      int fidx[2][2], fchi[2];
+      if (e % 2 == 0) { // x-edge
+        fidx[0][0] = ei; fidx[0][1] = ej;                       fchi[0] = 1;
+        fidx[1][0] = ei; fidx[1][1] = ej > 0 ? ej-1 : ny-1;     fchi[1] = -1;
+      } else { // y-edge
+        fidx[0][0] = ei;                   fidx[0][1] = ej;     fchi[0] = -1;
+        fidx[1][0] = ei > 0 ? ei-1 : nx-1; fidx[1][1] = ej;     fchi[1] = 1;
+      }
+
+      for (int m=0; m<2; m++) {
+        if (!ValidCell(fidx[m][0], fidx[m][1])) continue;
+        const FaceIdType f1 = fidx[m][0] + nx*fidx[m][1];
+        if (std::find(faces_visited.begin(), faces_visited.end(), f1) == faces_visited.end())
+          to_visit.push_back(std::make_pair(f1, -fchi[m] * pe));
+      }
+    }
+  }
+}
+
+static bool point_fid_less(const PointVortex& p, FaceIdType fid)
+{
+  return p.fid < fid;
+}
+
+VortexTransitionMatrix VortexExtractor2D::TraceOverTime()
+{
+  ProfileScope prof(PROF_TRACE_TIME);
+  const std::vector<PointVortex> &points0 = _points[0], &points1 = _points[1];
+  const int n0 = points0.size(), n1 = points1.size();
+  const int f0 = _dataset->TimeStep(0), f1 = _dataset->TimeStep(1);
+  VortexTransitionMatrix tm(f0, f1, n0, n1);
+
+  std::vector<FaceIdType> related;
+  for (int i=0; i<n0; i++) {
+    RelatedFaces(points0[i], related);
+    for (int k=0; k<related.size(); k++) {
+      std::vector<PointVortex>::const_iterator it =
+        std::lower_bound(points1.begin(), points1.end(), related[k], point_fid_less);
+      tm(i, it - points1.begin()) = 1; // the related faces are punctured at slot 1
+    }
+  }
+
+  tm.Modularize();
+
+  // consecutive intervals extend the sequences
+  const std::vector<int> &frames = _vortex_transition.Frames();
+  if (frames.empty())
+    _vortex_transition.AddFrame(f0);
+  if (frames.back() == f0) {
+    _vortex_transition.AddFrame(f1);
+    _vortex_transition.AddMatrix(tm);
+    _vortex_transition.UpdateSequence();
+  }
+
+  return tm;
+}
+
+void VortexExtractor2D::RotateTimeSteps()
+{
+  _ex[0].swap(_ex[1]);
+  _ey[0].swap(_ey[1]);
+  _face_chirality[0].swap(_face_chirality[1]);
+  _points[0].swap(_points[1]);
+
+  _points[1].clear();
+  _edge_chirality.clear();
+}
+
+void VortexExtractor2D::SaveVortexLines(int slot) const
+{
+  ProfileScope prof(PROF_SAVE);
+  const std::vector<PointVortex> &points = _points[slot];
+
+  std::vector<VortexLine> vlines(points.size());
+  for (int i=0; i<points.size(); i++) {
+    VortexLine &line = vlines[i];
+    line.id = i;
+    line.timestep = _dataset->TimeStep(slot);
+    line.insert(line.end(), points[i].pos, points[i].pos+3);
+  }
+
+  std::ostringstream os;
+  os << _dataset->DataName() << ".vlines." << _dataset->TimeStep(slot);
+  ::SaveVortexLinesAscii(vlines, os.str());
+}
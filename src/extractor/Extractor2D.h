@@ -0,0 +1,71 @@
+#ifndef _EXTRACTOR_2D_H
+#define _EXTRACTOR_2D_H
+
+#include "common/VortexTransition.h"
+#include "common/Puncture.h"
+#include <vector>
+
+class GLGPUDataset;
+
+// a punctured face of the 2D grid
+struct PointVortex {
+  FaceIdType fid;
+  ChiralityType chirality;
+  float pos[3];
+};
+
+/*
+ * \class   VortexExtractor2D
+ * \brief   Extraction and tracking of point vortices on the regular grids
+ *          of 2D GLGPU datasets.  Every punctured face of a 2D grid is a
+ *          vortex, so the faces are tested in row-major sweeps over flat
+ *          arrays of the gauge-corrected phase jumps along the grid edges,
+ *          and the punctures are kept as point lists in the order of face
+ *          ids.  Points are related across time by walking from each face
+ *          through the punctured space-time edges, the same criterion as
+ *          VortexExtractor::RelateOverTime, so the transition matrices and
+ *          the saved vortex lines match those of the generic extractor.
+*/
+class VortexExtractor2D {
+public:
+  VortexExtractor2D();
+  ~VortexExtractor2D();
+
+  void SetDataset(GLGPUDataset* ds); // both slots must hold the same grid
+  void SetNumberOfThreads(int);
+  void SetGaugeTransformation(bool);
+
+  void ExtractPoints(int slot=0);
+  void ExtractEdges(); // space-time edges between slot 0 and 1
+  VortexTransitionMatrix TraceOverTime();
+  void RotateTimeSteps();
+
+  const std::vector<PointVortex>& Points(int slot=0) const {return _points[slot];}
+  const VortexTransition& Transition() const {return _vortex_transition;}
+
+  void SaveVortexLines(int slot=0) const; // one-point lines, <dataname>.vlines.<timestep>
+
+private:
+  void ComputeEdgePhases(int slot);
+  void RelatedFaces(const PointVortex& p, std::vector<FaceIdType>& related) const;
+  bool ValidCell(int i, int j) const;
+
+private:
+  GLGPUDataset *_dataset;
+  bool _gauge;
+  int _nthreads;
+
+  int _d[2];
+  bool _pbc[2];
+
+  // per node, the phase jumps along the +x and +y edges minus the line
+  // integrals of A, wrapped to [-pi, pi)
+  std::vector<float> _ex[2], _ey[2];
+  std::vector<signed char> _face_chirality[2];
+  std::vector<signed char> _edge_chirality; // by edge id, 2*node+{0,1}
+  std::vector<PointVortex> _points[2];
+
+  VortexTransition _vortex_transition;
+};
+
+#endif
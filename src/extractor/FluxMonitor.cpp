@@ -0,0 +1,185 @@
+#include "FluxMonitor.h"
+#include "common/Profiler.h"
+#include "io/GLGPUDataset.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cmath>
+
+static const float twopi = 2*M_PI, inv_twopi = 0.5*M_1_PI;
+
+// same as mod2pi1 in single precision, so that the row sweeps vectorize
+static inline float wrap_phase(float x)
+{
+  return x - twopi * floorf((x + (float)M_PI) * inv_twopi);
+}
+
+template <typename F>
+static void parallel_for(int n, int nthreads, F f)
+{
+  std::atomic<int> next(0);
+  std::vector<std::thread> threads;
+  for (int t=0; t<nthreads; t++)
+    threads.push_back(std::thread([&]() {
+      for (int i = next++; i < n; i = next++) f(i);
+    }));
+  for (int t=0; t<nthreads; t++)
+    threads[t].join();
+}
+
+static int nthreads_or_default(int n)
+{
+  if (n <= 0) n = std::thread::hardware_concurrency();
+  return n <= 0 ? 1 : n;
+}
+
+VortexFluxMonitor::VortexFluxMonitor() :
+  _dataset(NULL),
+  _gauge(false),
+  _nthreads(0)
+{
+}
+
+VortexFluxMonitor::~VortexFluxMonitor()
+{
+}
+
+void VortexFluxMonitor::SetNumberOfThreads(int n)
+{
+  _nthreads = n;
+}
+
+void VortexFluxMonitor::SetGaugeTransformation(bool g)
+{
+  _gauge = g;
+}
+
+void VortexFluxMonitor::SetDataset(GLGPUDataset* ds)
+{
+  _dataset = ds;
+  _planes.clear();
+
+  const int *d = ds->dims();
+  const bool *pbc = ds->pbc();
+
+  for (int axis=0; axis<3; axis++) {
+    const int b = (axis+1)%3, c = (axis+2)%3;
+    for (int side=0; side<2; side++) {
+      Plane p;
+      p.axis = axis;
+      p.nb = d[b];
+      p.nc = d[c];
+      p.pbc_b = pbc[b];
+      p.pbc_c = pbc[c];
+      p.nodes.resize((size_t)p.nb * p.nc);
+
+      int idx[3];
+      idx[axis] = side ? d[axis]-1 : 0;
+      for (idx[c]=0; idx[c]<p.nc; idx[c]++)
+        for (idx[b]=0; idx[b]<p.nb; idx[b]++)
+          p.nodes[(size_t)p.nb*idx[c] + idx[b]] = idx[0] + d[0] * (idx[1] + d[1] * idx[2]);
+      _planes.push_back(p);
+    }
+  }
+}
+
+void VortexFluxMonitor::CountPlane(const Plane& p, int slot, int &positive, int &negative) const
+{
+  GLHeader h;
+  float *rho, *phi, *re, *im, *J;
+  _dataset->GetDataArray(h, &rho, &phi, &re, &im, &J, slot);
+
+  const int nb = p.nb, nc = p.nc;
+  const int fb = p.pbc_b ? nb : nb-1,
+            fc = p.pbc_c ? nc : nc-1;
+  const int kb = (p.axis+1)%3, kc = (p.axis+2)%3;
+  const size_t n = (size_t)nb*nc;
+
+  std::vector<float> ph(n), ab(n, 0.f), ac(n, 0.f);
+  for (size_t i=0; i<n; i++)
+    ph[i] = phi[p.nodes[i]];
+
+  // the components of A along the plane at the nodes, scaled by half of
+  // the cell lengths, so that the line integral of an edge is the sum at
+  // its ends (see GLDataset::LineIntegral)
+  if (_gauge) {
+    for (size_t i=0; i<n; i++) {
+      float X[3], A[3];
+      _dataset->Pos(p.nodes[i], X);
+      _dataset->A(X, A, slot);
+      ab[i] = 0.5f * A[kb] * h.cell_lengths[kb];
+      ac[i] = 0.5f * A[kc] * h.cell_lengths[kc];
+    }
+  }
+
+  // phase jumps along the +b and +c edges
+  std::vector<float> eb(n), ec(n);
+  for (int j=0; j<nc; j++) {
+    const size_t r = (size_t)nb*j, r1 = (size_t)nb*(j+1 < nc ? j+1 : 0);
+    for (int i=0; i<nb-1; i++)
+      eb[r+i] = wrap_phase(ph[r+i+1] - ph[r+i] - ab[r+i+1] - ab[r+i]);
+    eb[r+nb-1] = wrap_phase(ph[r] - ph[r+nb-1] - ab[r] - ab[r+nb-1]);
+    for (int i=0; i<nb; i++)
+      ec[r+i] = wrap_phase(ph[r1+i] - ph[r+i] - ac[r1+i] - ac[r+i]);
+  }
+
+  // winding numbers of the faces, counterclockwise about the plane normal;
+  // faces are punctured from half a turn on
+  std::vector<float> w(nb);
+  positive = negative = 0;
+  for (int j=0; j<fc; j++) {
+    const float *eb0 = &eb[(size_t)nb*j], *eb1 = &eb[(size_t)nb*(j+1 < nc ? j+1 : 0)],
+                *ec0 = &ec[(size_t)nb*j];
+    for (int i=0; i<nb-1; i++)
+      w[i] = -(eb0[i] + ec0[i+1] - eb1[i] - ec0[i]) * inv_twopi;
+    w[nb-1] = -(eb0[nb-1] + ec0[0] - eb1[nb-1] - ec0[nb-1]) * inv_twopi;
+
+    for (int i=0; i<fb; i++) {
+      positive += w[i] >= 0.5f;
+      negative += w[i] <= -0.5f;
+    }
+  }
+}
+
+FluxCounts VortexFluxMonitor::Count(int slot) const
+{
+  ProfileScope prof(PROF_FACES);
+
+  FluxCounts counts;
+  const int nplanes = _planes.size();
+  parallel_for(nplanes, std::min(nplanes, nthreads_or_default(_nthreads)), [&](int i) {
+    CountPlane(_planes[i], slot, counts.positive[i], counts.negative[i]);
+  });
+
+  size_t nfaces = 0;
+  for (int i=0; i<nplanes; i++) {
+    const Plane &p = _planes[i];
+    nfaces += (size_t)(p.pbc_b ? p.nb : p.nb-1) * (p.pbc_c ? p.nc : p.nc-1);
+    Profiler::Count(PROF_PUNCTURES, counts.positive[i] + counts.negative[i]);
+  }
+  Profiler::Count(PROF_FACES_TESTED, nfaces);
+
+  return counts;
+}
+
+void VortexFluxMonitor::Print(FILE *fp, int timestep, const FluxCounts& counts)
+{
+  fprintf(fp, "%d", timestep);
+  for (int i=0; i<6; i++)
+    fprintf(fp, "\t%d\t%d", counts.positive[i], counts.negative[i]);
+  fprintf(fp, "\n");
+}
+
+bool VortexFluxMonitor::AppendToFile(const char *filename, int timestep, const FluxCounts& counts)
+{
+  FILE *fp = fopen(filename, "a");
+  if (!fp) return false;
+
+  fseek(fp, 0, SEEK_END);
+  if (ftell(fp) == 0)
+    fprintf(fp, "#t\tx0+\tx0-\tx1+\tx1-\ty0+\ty0-\ty1+\ty1-\tz0+\tz0-\tz1+\tz1-\n");
+  Print(fp, timestep, counts);
+
+  fclose(fp);
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef _FLUX_MONITOR_H
+#define _FLUX_MONITOR_H
+
+#include <vector>
+#include <cstdio>
+
+class GLGPUDataset;
+
+// punctured faces per side of the box, by chirality
+struct FluxCounts {
+  int positive[6], negative[6]; // sides x=0, x=nx-1, y=0, y=ny-1, z=0, z=nz-1
+  int Net(int side) const {return positive[side] - negative[side];}
+};
+
+/*
+ * \class   VortexFluxMonitor
+ * \brief   Counts the vortices threading the six boundary planes of the
+ *          regular grid of a 3D GLGPU dataset.  The node ids of every
+ *          plane are enumerated once; each frame the phases of a plane are
+ *          gathered into a flat buffer and the faces are tested in
+ *          row-major sweeps over the gauge-corrected phase jumps, with the
+ *          same winding criterion and orientation as the hex faces of
+ *          VortexExtractor.  Nothing but the counts is computed.
+*/
+class VortexFluxMonitor {
+public:
+  VortexFluxMonitor();
+  ~VortexFluxMonitor();
+
+  void SetDataset(GLGPUDataset* ds); // enumerates the boundary planes
+  void SetNumberOfThreads(int);
+  void SetGaugeTransformation(bool);
+
+  // chirality along the axis normal to each side
+  FluxCounts Count(int slot=0) const;
+
+  // appends one line per frame; a header is written to empty files
+  static bool AppendToFile(const char *filename, int timestep, const FluxCounts&);
+  static void Print(FILE *fp, int timestep, const FluxCounts&);
+
+private:
+  struct Plane {
+    int axis, nb, nc; // the plane spans axes (axis+1)%3 and (axis+2)%3
+    bool pbc_b, pbc_c;
+    std::vector<unsigned int> nodes; // nb*nc node ids, row-major in b
+  };
+
+  void CountPlane(const Plane&, int slot, int &positive, int &negative) const;
+
+private:
+  GLGPUDataset *_dataset;
+  bool _gauge;
+  int _nthreads;
+
+  std::vector<Plane> _planes;
+};
+
+#endif
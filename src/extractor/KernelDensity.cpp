@@ -0,0 +1,124 @@
+#include "KernelDensity.h"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+static const int brick_size = 8; // nodes along each edge of a brick
+static const int brick_nodes = brick_size * brick_size * brick_size;
+
+static const double fixed_point_scale = 4294967296.0; // 2^32 per unit of density
+
+KernelDensityGrid::KernelDensityGrid(const GLHeader& h, float sigma, float cutoff) :
+  _h(h), 
+  _sigma(sigma), 
+  _cutoff(cutoff)
+{
+  for (int k=0; k<3; k++) 
+    _nb[k] = (h.dims[k] + brick_size - 1) / brick_size;
+
+  std::vector<std::atomic<std::atomic<long long>*> > bricks((size_t)_nb[0] * _nb[1] * _nb[2]);
+  for (size_t i=0; i<bricks.size(); i++) 
+    bricks[i] = NULL;
+  _bricks.swap(bricks);
+}
+
+KernelDensityGrid::~KernelDensityGrid()
+{
+  for (size_t i=0; i<_bricks.size(); i++) 
+    delete [] _bricks[i].load();
+}
+
+std::atomic<long long>* KernelDensityGrid::Brick(int b)
+{
+  std::atomic<long long> *p = _bricks[b].load(std::memory_order_acquire);
+  if (p) return p;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  p = _bricks[b].load(std::memory_order_relaxed);
+  if (!p) {
+    p = new std::atomic<long long>[brick_nodes];
+    for (int i=0; i<brick_nodes; i++) 
+      p[i].store(0, std::memory_order_relaxed);
+    _bricks[b].store(p, std::memory_order_release);
+  }
+  return p;
+}
+
+void KernelDensityGrid::Splat(size_t npts, const float *pts, const float *weights)
+{
+  if (_sigma <= 0) return;
+
+  const int *dims = _h.dims;
+  const float r = _cutoff * _sigma, r2 = r*r;
+  const float inv_2sigma2 = 0.5f / (_sigma * _sigma);
+  float rn[3];
+  for (int k=0; k<3; k++) 
+    rn[k] = r / _h.cell_lengths[k];
+
+  std::vector<float> e[3], d2[3];
+  std::vector<int> node[3], brick[3]; // wrapped node index and its brick
+  int i0[3], i1[3];
+
+  for (size_t i=0; i<npts; i++) {
+    const float w = weights ? weights[i] : 1.f;
+
+    // node range within the cutoff; along periodic axes the indices wrap, 
+    // so kernels wider than the domain add up all their images
+    bool empty = false;
+    for (int k=0; k<3 && !empty; k++) {
+      float c = (pts[i*3+k] - _h.origins[k]) / _h.cell_lengths[k];
+      if (std::isnan(c)) {empty = true; break;}
+      if (_h.pbc[k]) {
+        c -= dims[k] * floor(c / dims[k]);
+        if (c >= dims[k]) c = 0; // rounding
+      }
+      i0[k] = (int)ceil(c - rn[k]);
+      i1[k] = (int)floor(c + rn[k]);
+      if (!_h.pbc[k]) {
+        i0[k] = std::max(0, i0[k]);
+        i1[k] = std::min(dims[k]-1, i1[k]);
+      }
+      if (i0[k] > i1[k]) {empty = true; break;}
+
+      const int n = i1[k] - i0[k] + 1;
+      e[k].resize(n); d2[k].resize(n); node[k].resize(n); brick[k].resize(n);
+      for (int j=i0[k]; j<=i1[k]; j++) {
+        const float d = (j - c) * _h.cell_lengths[k];
+        const int jj = _h.pbc[k] ? ((j % dims[k]) + dims[k]) % dims[k] : j;
+        d2[k][j-i0[k]] = d*d;
+        e[k][j-i0[k]] = expf(-d*d * inv_2sigma2);
+        node[k][j-i0[k]] = jj;
+        brick[k][j-i0[k]] = jj / brick_size;
+      }
+    }
+    if (empty) continue;
+
+    for (int z=0; z<=i1[2]-i0[2]; z++) {
+      const float dz2 = d2[2][z], wz = w * e[2][z];
+      for (int y=0; y<=i1[1]-i0[1]; y++) {
+        const float dyz2 = dz2 + d2[1][y], wyz = wz * e[1][y];
+        if (dyz2 > r2) continue;
+        for (int x=0; x<=i1[0]-i0[0]; x++) {
+          if (dyz2 + d2[0][x] > r2) continue;
+          std::atomic<long long> *b = Brick(brick[0][x] + _nb[0] * (brick[1][y] + _nb[1] * brick[2][z]));
+          b[node[0][x] % brick_size + brick_size * (node[1][y] % brick_size + brick_size * (node[2][z] % brick_size))]
+            .fetch_add(llround(wyz * e[0][x] * fixed_point_scale), std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+}
+
+void KernelDensityGrid::GetDensity(float *density, float scale) const
+{
+  const int *dims = _h.dims;
+  const double s = scale / fixed_point_scale;
+  for (int z=0; z<dims[2]; z++)
+    for (int y=0; y<dims[1]; y++)
+      for (int x=0; x<dims[0]; x++) {
+        const std::atomic<long long> *b = 
+          _bricks[x/brick_size + _nb[0] * (y/brick_size + _nb[1] * (z/brick_size))].load();
+        density[x + dims[0] * (y + (size_t)dims[1] * z)] = b == NULL ? 0.f : 
+          b[x%brick_size + brick_size * (y%brick_size + brick_size * (z%brick_size))].load() * s;
+      }
+}
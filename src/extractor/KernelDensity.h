@@ -0,0 +1,45 @@
+#ifndef _KERNEL_DENSITY_H
+#define _KERNEL_DENSITY_H
+
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "io/GLHeader.h"
+
+/*
+ * \class   KernelDensityGrid
+ * \brief   Gaussian kernel density of a stream of points (e.g. punctures)
+ *          on the grid nodes of h:
+ *            density[nid] = sum_i w_i exp(-|X_nid - p_i|^2 / (2 sigma^2)),
+ *          with w_i = weights[i], or 1 if weights is NULL.  Kernels are cut
+ *          off at cutoff*sigma and wrap around periodic boundaries.  Points
+ *          are splatted as they come and not kept.  Sums are held in fixed
+ *          point by bricks of nodes, allocated when a kernel first reaches
+ *          them; they are exact, so threads may splat into the same grid
+ *          concurrently and the result does not depend on the order of the
+ *          points.  Weights should be O(1).
+*/
+class KernelDensityGrid {
+public:
+  KernelDensityGrid(const GLHeader& h, float sigma, float cutoff=3.f);
+  ~KernelDensityGrid();
+
+  void Splat(size_t npts, const float *pts, const float *weights=NULL); // thread-safe
+  void GetDensity(float *density, float scale=1.f) const; // all nodes, native layout
+
+private:
+  KernelDensityGrid(const KernelDensityGrid&);
+  KernelDensityGrid& operator=(const KernelDensityGrid&);
+
+  std::atomic<long long>* Brick(int b);
+
+private:
+  GLHeader _h;
+  float _sigma, _cutoff;
+  int _nb[3]; // bricks along each axis
+  std::vector<std::atomic<std::atomic<long long>*> > _bricks;
+  std::mutex _mutex; // allocation of bricks
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _PHILOX_H
+#define _PHILOX_H
+
+#include <stdint.h>
+#include <cmath>
+
+// Philox4x32-10 counter-based generator (Salmon et al., SC'11).  The output
+// is a pure function of counter and key, so a random stream can be indexed
+// by e.g. (node, realization) and gives the same numbers on any thread.
+static inline void philox4x32(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+  const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57,
+                 W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+  uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]},
+           k[2] = {key[0], key[1]};
+
+  for (int r=0; r<10; r++) {
+    const uint64_t p0 = (uint64_t)M0 * c[0],
+                   p1 = (uint64_t)M1 * c[2];
+    const uint32_t hi0 = p0 >> 32, lo0 = p0,
+                   hi1 = p1 >> 32, lo1 = p1;
+
+    c[0] = hi1 ^ c[1] ^ k[0];
+    c[1] = lo1;
+    c[2] = hi0 ^ c[3] ^ k[1];
+    c[3] = lo0;
+
+    k[0] += W0;
+    k[1] += W1;
+  }
+
+  out[0] = c[0]; out[1] = c[1]; out[2] = c[2]; out[3] = c[3];
+}
+
+// two independent normal samples with standard deviation sigma for element i of stream s
+static inline void philox_normal2(uint64_t i, uint32_t s, uint32_t seed, float sigma, float &z0, float &z1)
+{
+  const uint32_t counter[4] = {(uint32_t)i, (uint32_t)(i >> 32), s, 0},
+                 key[2] = {seed, 0x5EED};
+  uint32_t x[4];
+  philox4x32(counter, key, x);
+
+  // Box-Muller; u0 in (0, 1], u1 in [0, 1)
+  const double u0 = ((double)x[0] + 1.0) / 4294967296.0,
+               u1 = (double)x[1] / 4294967296.0;
+  const double r = sqrt(-2.0 * log(u0));
+  z0 = sigma * r * cos(2*M_PI*u1);
+  z1 = sigma * r * sin(2*M_PI*u1);
+}
+
+#endif
@@ -1,10 +1,17 @@
 #include "StochasticExtractor.h"
+#include "io/GLDatasetBase.h"
+#include "KernelDensity.h"
+#include "common/Profiler.h"
 #include "vfgpu/vfgpu.h"
+#include <atomic>
+#include <thread>
+#include <cmath>
 
 StochasticVortexExtractor::StochasticVortexExtractor() :
   _nruns(256), 
   _kernel_size(0.5),
   _pertubation(0.04),
+  _seed(1234),
   _density(NULL)
 {
 
@@ -31,6 +38,11 @@ void StochasticVortexExtractor::SetPertubation(float p)
   _pertubation = p;
 }
 
+void StochasticVortexExtractor::SetSeed(unsigned int s)
+{
+  _seed = s;
+}
+
 void StochasticVortexExtractor::ExtractDeterministicVortices()
 {
   Clear();
@@ -40,6 +52,74 @@ void StochasticVortexExtractor::ExtractDeterministicVortices()
 }
 
 void StochasticVortexExtractor::ExtractStochasticVortices()
+{
+  if (_gpu) ExtractStochasticVortices_GPU();
+  else ExtractStochasticVortices_CPU();
+}
+
+// runs are distributed over threads, each with its own extractor sharing the 
+// unperturbed data; the noise of a run only depends on the run and the node, 
+// and the density grid sums exactly, so results do not depend on threads
+void StochasticVortexExtractor::ExtractStochasticVortices_CPU()
+{
+  ProfileScope prof(PROF_ENSEMBLE);
+
+  const GLHeader &h = _dataset->GetHeader(0);
+  const int nnodes = h.dims[0] * h.dims[1] * h.dims[2];
+
+  // the punctures of a run are splatted into the shared density grid as 
+  // soon as the run finishes, and dropped
+  const int nthreads = std::max(1, std::min(NumberOfThreads(), _nruns));
+  std::vector<std::map<FaceIdType, int> > counts(nthreads);
+  KernelDensityGrid grid(h, _kernel_size);
+  std::atomic<int> next(0);
+
+  auto run = [&](int tid) {
+    VortexExtractor ex;
+#if WITH_ROCKSDB
+    ex.SetDB(_db);
+#endif
+    ex.SetDataset(_dataset);
+    ex.SetNumberOfThreads(1);
+    ex.SetGaugeTransformation(_gauge);
+    ex.SetPertubation(_pertubation);
+
+    std::vector<float> pts;
+    for (int r = next++; r < _nruns; r = next++) {
+      ex.Clear();
+      ex.SetRealization(r, _seed);
+      ex.ExtractFaces(0);
+
+      const std::map<FaceIdType, PuncturedFace> &pfs = ex.GetPuncturedFaces(0);
+      pts.clear();
+      for (std::map<FaceIdType, PuncturedFace>::const_iterator it = pfs.begin(); it != pfs.end(); it ++) {
+        counts[tid][it->first] ++;
+        pts.insert(pts.end(), it->second.pos, it->second.pos + 3);
+      }
+      grid.Splat(pts.size()/3, pts.data());
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i=1; i<nthreads; i++) threads.push_back(std::thread(run, i));
+  run(0);
+  for (int i=0; i<threads.size(); i++) threads[i].join();
+
+  // reduce
+  if (_density != NULL) free(_density);
+  _density = (float*)malloc(sizeof(float)*nnodes);
+  {
+    ProfileScope prof_density(PROF_DENSITY);
+    grid.GetDensity(_density, 1.f / _nruns);
+  }
+
+  _puncture_counts.clear();
+  for (int j=0; j<nthreads; j++) 
+    for (std::map<FaceIdType, int>::const_iterator it = counts[j].begin(); it != counts[j].end(); it ++) 
+      _puncture_counts[it->first] += it->second;
+}
+
+void StochasticVortexExtractor::ExtractStochasticVortices_GPU()
 {
   std::vector<float> pts;
   std::vector<int> acc;
@@ -61,12 +141,6 @@ void StochasticVortexExtractor::ExtractStochasticVortices()
     }
   }
 
-  typedef std::chrono::high_resolution_clock clock;
-  auto t0 = clock::now();
-  
+  ProfileScope prof(PROF_DENSITY);
   // vfgpu_density_estimate(pts.size()/3, acc.size(), pts.data(), acc.data());
-
-  auto t1 = clock::now();
-  double elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / 1000000000.0; 
-  fprintf(stderr, "t_density=%f\n", elapsed);
 }
@@ -9,20 +9,29 @@ public:
   ~StochasticVortexExtractor();
 
   void SetNumberOfRuns(int);
-  void SetKernelSize(float);
+  void SetKernelSize(float); // std dev of the Gaussian kernel of the density
   void SetPertubation(float);
+  void SetSeed(unsigned int);
 
   void ExtractDeterministicVortices();
   void ExtractStochasticVortices();
 
-  void EstimateDensities(int vid);
+  // ensemble statistics of the CPU runs
+  const float* Density() const {return _density;} // per grid node, kernel density of the punctures per run
+  const std::map<FaceIdType, int>& PunctureCounts() const {return _puncture_counts;} // per face, number of punctured runs
+
+private:
+  void ExtractStochasticVortices_CPU();
+  void ExtractStochasticVortices_GPU();
 
 private:
   int _nruns;
   float _kernel_size;
   float _pertubation;
+  unsigned int _seed;
 
   float *_density;
+  std::map<FaceIdType, int> _puncture_counts;
 };
 
 #endif
@@ -1,4 +1,6 @@
 #include "BDATReader.h"
+#include "common/Profiler.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <limits.h>
@@ -103,12 +105,28 @@ void BDATReader::ReadNextRecordData(std::string *buf)
   state = BDAT_STATE_HEADER;
 }
 
+void BDATReader::ReadNextRecordData(std::string *buf, size_t offset, size_t length)
+{
+  assert(state == BDAT_STATE_DATA);
+  if (!Valid()) return;
+
+  const size_t size = (size_t)recLen*recNum;
+  offset = std::min(offset, size);
+  length = std::min(length, size - offset);
+
+  fseek(fp, offset, SEEK_CUR);
+  ReadString(length, buf);
+  fseek(fp, size - offset - length, SEEK_CUR);
+  state = BDAT_STATE_HEADER;
+}
+
 bool BDATReader::Read(int typeName, void *val)
 {
   if (!Valid()) return false;
 
   int typeSize = BDATTypeSizes[typeName];
   size_t count = fread(val, typeSize, 1, fp);
+  Profiler::Count(PROF_BYTES_READ, count*typeSize);
 
   return count>0;
 }
@@ -119,6 +137,7 @@ bool BDATReader::ReadString(int length, std::string *str)
   
   str->resize(length);
   size_t count = fread((char*)str->data(), 1, length, fp);
+  Profiler::Count(PROF_BYTES_READ, count);
   
   return count>0;
 }
@@ -17,6 +17,7 @@ public:
 
   std::string ReadNextRecordInfo();
   void ReadNextRecordData(std::string *buf); //!< returns recType
+  void ReadNextRecordData(std::string *buf, size_t offset, size_t length); //!< reads a byte range and skips the rest
 
   unsigned int RecType() const {return recType;}
   unsigned int RedID() const {return recID;}
@@ -1,9 +1,11 @@
+#include <algorithm>
 #include <cassert>
 #include <cfloat>
 #include <libmesh/dof_map.h>
 #include "Condor2Dataset.h"
 #include "common/DataInfo.pb.h"
 #include "common/Utils.hpp"
+#include "common/Profiler.h"
 
 using namespace libMesh;
 
@@ -11,8 +13,7 @@ Condor2Dataset::Condor2Dataset(const Parallel::Communicator &comm) :
   ParallelObject(comm), 
   _eqsys(NULL), 
   _exio(NULL), 
-  _mesh(NULL),
-  _locator(NULL)
+  _mesh(NULL)
 {
 }
 
@@ -20,7 +21,6 @@ Condor2Dataset::~Condor2Dataset()
 {
   if (_eqsys) delete _eqsys;
   if (_exio) delete _exio;
-  if (_locator) delete _locator;
   if (_mesh) delete _mesh;
 }
 
@@ -80,11 +80,8 @@ bool Condor2Dataset::OpenDataFile(const std::string& filename)
 
   _eqsys->init(); 
 
-  /// point locator
-  _locator = new PointLocatorTree(*_mesh);
-
-  // it takes some time (~0.5s) to compute the bounding box. is there any better way to get this information?
-  ProbeBoundingBox();
+  /// point locator and bounding box
+  BuildLocator();
 
   _valid = true;
   return true; 
@@ -95,6 +92,16 @@ void Condor2Dataset::CloseDataFile()
   if (_eqsys) delete _eqsys; 
   if (_exio) delete _exio; 
   if (_mesh) delete _mesh; 
+  _eqsys = NULL;
+  _exio = NULL;
+  _mesh = NULL;
+  _locator.Clear();
+  _X.clear();
+  for (int i=0; i<2; i++) {
+    _rho[i].clear();
+    _phi[i].clear();
+    _A[i].clear();
+  }
 }
 
 void Condor2Dataset::BuildMeshGraph()
@@ -145,29 +152,40 @@ void Condor2Dataset::BuildMeshGraph()
   fprintf(stderr, "mesh graph saved.\n");
 }
 
-void Condor2Dataset::ProbeBoundingBox()
+void Condor2Dataset::BuildLocator()
 {
-  float L[3] = {DBL_MAX, DBL_MAX, DBL_MAX}, 
-         U[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
-
-  MeshBase::const_node_iterator it = mesh()->local_nodes_begin(); 
-  const MeshBase::const_node_iterator end = mesh()->local_nodes_end();
-
+  // nodes and tets are indexed by their ids, which are not renumbered
+  const unsigned int nnodes = mesh()->max_node_id(), 
+                     nelems = mesh()->max_elem_id();
+  std::vector<float> &X = _X;
+  X.assign(nnodes*3, 0);
+  std::vector<unsigned int> tets(nelems*4, UINT_MAX), neighbors(nelems*4, UINT_MAX);
+
+  MeshBase::const_node_iterator nit = mesh()->nodes_begin(); 
+  const MeshBase::const_node_iterator nend = mesh()->nodes_end();
+  for (; nit != nend; nit++) 
+    for (int k=0; k<3; k++)
+      X[(*nit)->id()*3+k] = (*(*nit))(k);
+
+  MeshBase::const_element_iterator it = mesh()->active_elements_begin(); 
+  const MeshBase::const_element_iterator end = mesh()->active_elements_end(); 
   for (; it != end; it++) {
-    L[0] = std::min(L[0], (*it)->slice(0));
-    L[1] = std::min(L[1], (*it)->slice(1));
-    L[2] = std::min(L[2], (*it)->slice(2));
-    U[0] = std::max(U[0], (*it)->slice(0));
-    U[1] = std::max(U[1], (*it)->slice(1));
-    U[2] = std::max(U[2], (*it)->slice(2));
+    const Elem *e = *it;
+    if (e->n_vertices() != 4) continue;
+    for (int i=0; i<4; i++) {
+      tets[e->id()*4+i] = e->node(i);
+      if (e->neighbor(i) != NULL)
+        neighbors[e->id()*4+i] = e->neighbor(i)->id();
+    }
   }
 
-  _h[0].origins[0] = L[0]; 
-  _h[0].origins[1] = L[1]; 
-  _h[0].origins[2] = L[2]; 
-  _h[0].lengths[0] = U[0] - L[0]; 
-  _h[0].lengths[1] = U[1] - L[1]; 
-  _h[0].lengths[2] = U[2] - L[2];
+  _locator.Build(nnodes, X.data(), nelems, tets.data(), neighbors.data());
+
+  for (int slot=0; slot<2; slot++) // both, since the headers rotate with the timesteps
+    for (int k=0; k<3; k++) {
+      _h[slot].origins[k] = _locator.LB()[k];
+      _h[slot].lengths[k] = _locator.UB()[k] - _locator.LB()[k];
+    }
 }
 
 void Condor2Dataset::LoadTimeStep_(int timestep)
@@ -183,27 +201,54 @@ void Condor2Dataset::LoadTimeStep_(int timestep)
   _exio->copy_nodal_solution(*_asys, "Az", "A_z", timestep);
 }
 
-void Condor2Dataset::LoadTimeStep(int timestep, int slot)
+bool Condor2Dataset::LoadTimeStep(int timestep, int slot)
 {
+  ProfileScope prof(PROF_LOAD);
+
+  // loading the next timestep moves the current one to slot 0
+  if (slot == 1 && !_rho[1].empty())
+    RotateTimeSteps();
+
   SetTimeStep(timestep, slot);
   LoadTimeStep_(timestep);
+  CopyNodalFields(slot);
 
-  if (slot == 0) {
-    _ts = _tsys->solution->clone();
-    _as = _asys->solution->clone();
-  } else {
-    if (_ts1.get() != NULL) {
-      _ts = _ts1;
-      _as = _as1;
-    }
-
-    _ts1 = _tsys->solution->clone();
-    _as1 = _asys->solution->clone();
+  return true; // FIXME
+}
 
-    GLDatasetBase::RotateTimeSteps();
+void Condor2Dataset::CopyNodalFields(int slot)
+{
+  std::vector<Number> ts, as;
+  _tsys->solution->localize(ts);
+  _asys->solution->localize(as);
+
+  const unsigned int nnodes = mesh()->max_node_id();
+  const unsigned int tn = tsys()->number(), an = asys()->number();
+  _rho[slot].assign(nnodes, 0);
+  _phi[slot].assign(nnodes, 0);
+  _A[slot].assign(nnodes*3, 0);
+
+  MeshBase::const_node_iterator it = mesh()->nodes_begin(); 
+  const MeshBase::const_node_iterator end = mesh()->nodes_end();
+  for (; it != end; it++) {
+    const Node &node = *(*it);
+    const unsigned int i = node.id();
+    _rho[slot][i] = ts[ node.dof_number(tn, _rho_var, 0) ];
+    _phi[slot][i] = ts[ node.dof_number(tn, _phi_var, 0) ];
+    _A[slot][i*3] = as[ node.dof_number(an, _Ax_var, 0) ];
+    _A[slot][i*3+1] = as[ node.dof_number(an, _Ay_var, 0) ];
+    _A[slot][i*3+2] = as[ node.dof_number(an, _Az_var, 0) ];
   }
+}
 
-  return true; // FIXME
+void Condor2Dataset::RotateTimeSteps()
+{
+  _rho[0].swap(_rho[1]);
+  _phi[0].swap(_phi[1]);
+  _A[0].swap(_A[1]);
+  std::swap(_h[0], _h[1]);
+
+  GLDataset::RotateTimeSteps();
 }
 
 #if 0
@@ -226,9 +271,7 @@ std::vector<ElemIdType> Condor2Dataset::GetNeighborIds(ElemIdType elem_id) const
 
 CellIdType Condor2Dataset::Pos2CellId(const float X[]) const
 {
-  Point p(X[0], X[1], X[2]);
-  
-  const Elem *e = (*_locator)(p);
+  const Elem *e = LocateElemCoherently(X);
   if (e == NULL) return UINT_MAX;
   else return e->id();
 }
@@ -237,7 +280,7 @@ bool Condor2Dataset::A(const float X[3], float A[3], int slot) const
 {
   Point p(X[0], X[1], X[2]);
 
-  const Elem *e = (*_locator)(p);
+  const Elem *e = LocateElemCoherently(X);
   if (e == NULL) return false;
 
   A[0] = asys()->point_value(_Ax_var, p, e);
@@ -247,16 +290,20 @@ bool Condor2Dataset::A(const float X[3], float A[3], int slot) const
   return true;
 }
 
-bool Condor2Dataset::A(NodeIdType, float A[3], int slot) const
+bool Condor2Dataset::A(NodeIdType i, float A[3], int slot) const
 {
-  // TODO
-  return false;
+  if (i*3 >= _A[slot].size()) return false;
+  for (int j=0; j<3; j++) 
+    A[j] = _A[slot][i*3+j];
+  return true;
 }
 
-bool Condor2Dataset::Pos(NodeIdType, float X[3]) const
+bool Condor2Dataset::Pos(NodeIdType i, float X[3]) const
 {
-  // TODO
-  return false;
+  if (i*3 >= _X.size()) return false;
+  for (int j=0; j<3; j++) 
+    X[j] = _X[i*3+j];
+  return true;
 }
 
 #if 0
@@ -318,37 +365,13 @@ bool Condor2Dataset::Supercurrent(const float X[3], float J[3], int slot) const
 #endif
 }
  
-const Elem* Condor2Dataset::LocateElemCoherently(const float X[3]) const
+const Elem* Condor2Dataset::LocateElemCoherently(const float X[3], unsigned int *hint) const
 {
-  static const Elem* e_last = NULL;
-  
-  if (X[0] < Origins()[0] || X[0] > Origins()[0] + Lengths()[0] ||
-      X[1] < Origins()[1] || X[1] > Origins()[1] + Lengths()[1] || 
-      X[2] < Origins()[2] || X[2] > Origins()[2] + Lengths()[2])
-    return NULL;
+  static thread_local unsigned int last = UINT_MAX;
   
-  Point p(X[0], X[1], X[2]);
-
-  /// check if p is inside last queried element or neighbors
-  if (e_last != NULL) {
-    if (e_last->contains_point(p)) {
-      // fprintf(stderr, "hit last.\n");
-      return e_last;
-    }
-    else {
-      for (int i=0; i<e_last->n_neighbors(); i++) {
-        const Elem* e = e_last->neighbor(i);
-        if (e != NULL && e->contains_point(p)) {
-          // fprintf(stderr, "hit last neighbor.\n");
-          e_last = e;
-          return e;
-        }
-      }
-    }
-  }
-  
-  e_last = (*_locator)(p);
-  return e_last;
+  const unsigned int id = _locator.Locate(X, hint ? *hint : last);
+  if (id == UINT_MAX) return NULL;
+  else return mesh()->elem(id);
 }
 
 bool Condor2Dataset::OnBoundary(ElemIdType id) const
@@ -455,80 +478,50 @@ bool Condor2Dataset::GetSpaceTimeEdgeValues(const Edge* e, float X[][3], float A
 }
 #endif
 
-void Condor2Dataset::GetFaceValues(const CFace& f, int time, float X[][3], float A[][3], float rho[], float phi[]) const
+void Condor2Dataset::GetFaceValues(const CFace& f, int slot, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const
 {
-  const NumericVector<Number> &ts = time == 0 ? *_ts : *_ts1;
-  const NumericVector<Number> &as = time == 0 ? *_as : *_as1;
- 
-  const Node nodes[3] = {
-    _mesh->node(f.nodes[0]), 
-    _mesh->node(f.nodes[1]), 
-    _mesh->node(f.nodes[2])};
-
-  for (int i=0; i<3; i++) {
+  for (int i=0; i<f.nodes.size(); i++) {
+    const NodeIdType n = f.nodes[i];
     for (int j=0; j<3; j++) {
-      X[i][j] = nodes[i](j); 
+      X[i][j] = _X[n*3+j];
+      A[i][j] = _A[slot][n*3+j];
     }
-
-    A[i][0] = as( nodes[i].dof_number(asys()->number(), _Ax_var, 0) );
-    A[i][1] = as( nodes[i].dof_number(asys()->number(), _Ay_var, 0) );
-    A[i][2] = as( nodes[i].dof_number(asys()->number(), _Az_var, 0) );
-
-    rho[i] = ts( nodes[i].dof_number(tsys()->number(), _rho_var, 0) );
-    phi[i] = ts( nodes[i].dof_number(tsys()->number(), _phi_var, 0) );
+    rho[i] = _rho[slot][n];
+    phi[i] = _phi[slot][n];
+    re[i] = rho[i] * cos(phi[i]);
+    im[i] = rho[i] * sin(phi[i]);
   }
 }
 
-void Condor2Dataset::GetSpaceTimeEdgeValues(const CEdge& e, float X[][3], float A[][3], float rho[], float phi[]) const
+void Condor2Dataset::GetSpaceTimeEdgeValues(const CEdge& e, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const
 {
-  const NumericVector<Number> &ts = *_ts;
-  const NumericVector<Number> &ts1 = *_ts1;
-  const NumericVector<Number> &as = *_as;
-  const NumericVector<Number> &as1 = *_as1;
-  
-  const Node& node0 = _mesh->node(e.node0), 
-              node1 = _mesh->node(e.node1);
- 
+  // the quad (node0, t0), (node1, t0), (node1, t1), (node0, t1)
+  const NodeIdType nodes[4] = {e.node0, e.node1, e.node1, e.node0};
+  const int slots[4] = {0, 0, 1, 1};
+
   for (int j=0; j<3; j++) {
-    X[0][j] = node0(j);
-    X[1][j] = node1(j);
+    X[0][j] = _X[e.node0*3+j];
+    X[1][j] = _X[e.node1*3+j];
   }
 
-  A[0][0] = as( node0.dof_number(asys()->number(), _Ax_var, 0) );
-  A[0][1] = as( node0.dof_number(asys()->number(), _Ay_var, 0) );
-  A[0][2] = as( node0.dof_number(asys()->number(), _Az_var, 0) );
-
-  A[1][0] = as( node1.dof_number(asys()->number(), _Ax_var, 0) );
-  A[1][1] = as( node1.dof_number(asys()->number(), _Ay_var, 0) );
-  A[1][2] = as( node1.dof_number(asys()->number(), _Az_var, 0) );
-  
-  A[2][0] = as1( node1.dof_number(asys()->number(), _Ax_var, 0) );
-  A[2][1] = as1( node1.dof_number(asys()->number(), _Ay_var, 0) );
-  A[2][2] = as1( node1.dof_number(asys()->number(), _Az_var, 0) );
-  
-  A[3][0] = as1( node0.dof_number(asys()->number(), _Ax_var, 0) );
-  A[3][1] = as1( node0.dof_number(asys()->number(), _Ay_var, 0) );
-  A[3][2] = as1( node0.dof_number(asys()->number(), _Az_var, 0) );
-
-  rho[0] = ts( node0.dof_number(tsys()->number(), _rho_var, 0) );
-  rho[1] = ts( node1.dof_number(tsys()->number(), _rho_var, 0) );
-  rho[2] = ts1( node1.dof_number(tsys()->number(), _rho_var, 0) );
-  rho[3] = ts1( node0.dof_number(tsys()->number(), _rho_var, 0) );
-
-  phi[0] = ts( node0.dof_number(tsys()->number(), _phi_var, 0) );
-  phi[1] = ts( node1.dof_number(tsys()->number(), _phi_var, 0) );
-  phi[2] = ts1( node1.dof_number(tsys()->number(), _phi_var, 0) );
-  phi[3] = ts1( node0.dof_number(tsys()->number(), _phi_var, 0) );
+  for (int i=0; i<4; i++) {
+    const NodeIdType n = nodes[i];
+    const int s = slots[i];
+    for (int j=0; j<3; j++) 
+      A[i][j] = _A[s][n*3+j];
+    rho[i] = _rho[s][n];
+    phi[i] = _phi[s][n];
+    re[i] = rho[i] * cos(phi[i]);
+    im[i] = rho[i] * sin(phi[i]);
+  }
 }
 
-float Condor2Dataset::Rho(NodeIdType, int) const
+float Condor2Dataset::Rho(NodeIdType i, int slot) const
 {
-  // TODO
-  assert(false);
+  return _rho[slot][i];
 }
 
-float Condor2Dataset::Phi(NodeIdType, int) const
+float Condor2Dataset::Phi(NodeIdType i, int slot) const
 {
-  // TODO
-  assert(false);
+  return _phi[slot][i];
 }
@@ -7,9 +7,9 @@
 #include <libmesh/numeric_vector.h>
 #include <libmesh/equation_systems.h>
 #include <libmesh/nonlinear_implicit_system.h>
-#include <libmesh/point_locator_tree.h>
 #include <libmesh/exodusII_io.h>
 #include "GLDataset.h"
+#include "common/TetLocator.h"
 
 class Condor2Dataset : public libMesh::ParallelObject, public GLDataset
 {
@@ -23,6 +23,7 @@ public:
   bool OpenDataFile(const std::string& filename);
   bool LoadTimeStep(int timestep, int slot);
   void CloseDataFile();
+  void RotateTimeSteps();
 
   void BuildMeshGraph();
 
@@ -34,8 +35,8 @@ public:
   void SerializeDataInfoToString(std::string& buf) const;
 
 public:
-  void GetFaceValues(const CFace&, int slot, float X[][3], float A[][3], float rho[], float phi[]) const;
-  void GetSpaceTimeEdgeValues(const CEdge&, float X[][3], float A[][3], float rho[], float phi[]) const;
+  void GetFaceValues(const CFace&, int slot, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const;
+  void GetSpaceTimeEdgeValues(const CEdge&, float X[][3], float A[][3], float rho[], float phi[], float re[], float im[]) const;
   
   CellIdType Pos2CellId(const float X[]) const; //!< returns the elemId for a given position
   bool OnBoundary(ElemIdType id) const;
@@ -65,11 +66,13 @@ public:
   bool Supercurrent(NodeIdType, float J[3], int slot) const;
 
 private: 
-  void ProbeBoundingBox();
+  void BuildLocator();
   void LoadTimeStep_(int timestep);
+  void CopyNodalFields(int slot);
 
 private:
-  const libMesh::Elem* LocateElemCoherently(const float X[3]) const; // not thread-safe
+  // starts from the element last located by the calling thread, or by hint if given
+  const libMesh::Elem* LocateElemCoherently(const float X[3], unsigned int *hint=NULL) const;
 
 private:
   libMesh::UnstructuredMesh *_mesh;
@@ -77,14 +80,15 @@ private:
   libMesh::EquationSystems *_eqsys;
   libMesh::NonlinearImplicitSystem *_tsys;
   libMesh::System *_asys;
-  libMesh::PointLocatorTree *_locator;
+  TetLocator _locator;
 
   unsigned int _rho_var, _phi_var;
   unsigned int _Ax_var, _Ay_var, _Az_var;
   // unsigned int _rho_var, _phi_var;
 
-  libMesh::AutoPtr<libMesh::NumericVector<libMesh::Number> > _ts, _ts1;
-  libMesh::AutoPtr<libMesh::NumericVector<libMesh::Number> > _as, _as1;
+  // nodal values indexed by node id, copied from the systems once per timestep
+  std::vector<float> _X; // 3 per node
+  std::vector<float> _rho[2], _phi[2], _A[2]; // A: 3 per node
 }; 
 
 #endif
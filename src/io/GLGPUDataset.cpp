@@ -1,7 +1,9 @@
 #include "GLGPUDataset.h"
 #include "GLGPU_IO_Helper.h"
 #include "common/Utils.hpp"
+#include "common/Profiler.h"
 #include "glpp/GL_post_process.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <climits>
@@ -34,19 +36,29 @@ GLGPUDataset::GLGPUDataset()
   memset(_Jx, 0, sizeof(float*)*2);
   memset(_Jy, 0, sizeof(float*)*2);
   memset(_Jz, 0, sizeof(float*)*2);
+  _borrowed[0] = _borrowed[1] = false;
 }
 
 GLGPUDataset::~GLGPUDataset()
 {
-  for (int i=0; i<2; i++) {
-    free1(&_rho[i]);
-    free1(&_phi[i]);
-    free1(&_re[i]);
-    free1(&_im[i]);
-    free1(&_Jx[i]);
-    free1(&_Jy[i]);
-    free1(&_Jz[i]);
+  for (int i=0; i<2; i++) 
+    FreeSlot(i);
+}
+
+void GLGPUDataset::FreeSlot(int slot)
+{
+  if (_borrowed[slot]) { // owned by the caller of BindDataArrays
+    _rho[slot] = _phi[slot] = _re[slot] = _im[slot] = NULL;
+    _borrowed[slot] = false;
+  } else {
+    free1(&_rho[slot]);
+    free1(&_phi[slot]);
+    free1(&_re[slot]);
+    free1(&_im[slot]);
   }
+  free1(&_Jx[slot]);
+  free1(&_Jy[slot]);
+  free1(&_Jz[slot]);
 }
 
 void GLGPUDataset::PrintInfo(int slot) const
@@ -142,6 +154,7 @@ void GLGPUDataset::CloseDataFile()
 
 bool GLGPUDataset::LoadTimeStep(int timestep, int slot)
 {
+  ProfileScope prof(PROF_LOAD);
   assert(timestep>=0 && timestep<=_filenames.size());
   bool succ = false;
   const std::string &filename = _filenames[timestep];
@@ -173,25 +186,41 @@ void GLGPUDataset::GetDataArray(GLHeader& h, float **rho, float **phi, float **r
   *J = NULL;  // FIXME
 }
 
-bool GLGPUDataset::BuildDataFromArray(const GLHeader& h, const float *rho, const float *phi, const float *re, const float *im)
+bool GLGPUDataset::BuildDataFromArray(const GLHeader& h, const float *rho, const float *phi, const float *re, const float *im, int slot)
 {
-  memcpy(&_h[0], &h, sizeof(GLHeader));
+  memcpy(&_h[slot], &h, sizeof(GLHeader));
+
+  FreeSlot(slot);
 
   const int count = h.dims[0]*h.dims[1]*h.dims[2];
   // _psi[0] = (float*)realloc(_psi[0], sizeof(float)*count*2);
-  _rho[0] = (float*)malloc(sizeof(float)*count); 
-  _phi[0] = (float*)malloc(sizeof(float)*count); 
-  _re[0] = (float*)malloc(sizeof(float)*count); 
-  _im[0] = (float*)malloc(sizeof(float)*count); 
-
-  memcpy(_rho[0], rho, sizeof(float)*count);
-  memcpy(_phi[0], phi, sizeof(float)*count);
-  memcpy(_re[0], re, sizeof(float)*count);
-  memcpy(_im[0], im, sizeof(float)*count);
+  _rho[slot] = (float*)malloc(sizeof(float)*count); 
+  _phi[slot] = (float*)malloc(sizeof(float)*count); 
+  _re[slot] = (float*)malloc(sizeof(float)*count); 
+  _im[slot] = (float*)malloc(sizeof(float)*count); 
+
+  memcpy(_rho[slot], rho, sizeof(float)*count);
+  memcpy(_phi[slot], phi, sizeof(float)*count);
+  memcpy(_re[slot], re, sizeof(float)*count);
+  memcpy(_im[slot], im, sizeof(float)*count);
   
   return true;
 }
 
+bool GLGPUDataset::BindDataArrays(const GLHeader& h, float *rho, float *phi, float *re, float *im, int slot)
+{
+  memcpy(&_h[slot], &h, sizeof(GLHeader));
+  FreeSlot(slot);
+
+  _rho[slot] = rho;
+  _phi[slot] = phi;
+  _re[slot] = re;
+  _im[slot] = im;
+  _borrowed[slot] = true;
+
+  return true;
+}
+
 #if 0
 void GLGPUDataset::ModulateKex(int slot)
 {
@@ -225,22 +254,32 @@ void GLGPUDataset::RotateTimeSteps()
   std::swap(_Jx[0], _Jx[1]);
   std::swap(_Jy[0], _Jy[1]);
   std::swap(_Jz[0], _Jz[1]);
+  std::swap(_h[0], _h[1]);
+  std::swap(_borrowed[0], _borrowed[1]);
 
   GLDataset::RotateTimeSteps();
 }
 
+void GLGPUDataset::SwapTimeStep(GLGPUDataset& other, int slot, int other_slot)
+{
+  std::swap(_rho[slot], other._rho[other_slot]);
+  std::swap(_phi[slot], other._phi[other_slot]);
+  std::swap(_re[slot], other._re[other_slot]);
+  std::swap(_im[slot], other._im[other_slot]);
+  std::swap(_Jx[slot], other._Jx[other_slot]);
+  std::swap(_Jy[slot], other._Jy[other_slot]);
+  std::swap(_Jz[slot], other._Jz[other_slot]);
+  std::swap(_h[slot], other._h[other_slot]);
+  std::swap(_borrowed[slot], other._borrowed[other_slot]);
+  std::swap(_timestep[slot], other._timestep[other_slot]);
+}
+
 bool GLGPUDataset::OpenLegacyDataFile(const std::string& filename, int slot)
 {
   int ndims;
   _h[slot].dtype = DTYPE_CA02;
 
-  free1(&_rho[slot]); 
-  free1(&_phi[slot]); 
-  free1(&_re[slot]); 
-  free1(&_im[slot]);
-  free1(&_Jx[slot]);
-  free1(&_Jy[slot]);
-  free1(&_Jz[slot]);
+  FreeSlot(slot);
 
   if (!::GLGPU_IO_Helper_ReadLegacy(
         filename, _h[slot], &_rho[slot], &_phi[slot], &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot], false, _precompute_supercurrent))
@@ -272,21 +311,31 @@ bool GLGPUDataset::OpenBDATDataFile(const std::string& filename, int slot)
   int ndims;
   _h[slot].dtype = DTYPE_BDAT;
   
-  free1(&_rho[slot]); 
-  free1(&_phi[slot]); 
-  free1(&_re[slot]); 
-  free1(&_im[slot]); 
-  free1(&_Jx[slot]);
-  free1(&_Jy[slot]);
-  free1(&_Jz[slot]);
+  FreeSlot(slot);
+
+  int z0 = 0, z1 = INT_MAX; // xy planes overlapping the region of interest
+  if (!_roi.Empty()) {
+    GLHeader h;
+    float LB[3], UB[3];
+    if (!::GLGPU_IO_Helper_ReadBDAT(filename, h, NULL, NULL, NULL, NULL, NULL, NULL, NULL, true))
+      return false;
+    _roi.Bounds(LB, UB);
+    z0 = std::max(0, (int)floor((LB[2] - h.origins[2]) / h.cell_lengths[2]));
+    z1 = std::min(h.dims[2]-1, (int)ceil((UB[2] - h.origins[2]) / h.cell_lengths[2]));
+  }
 
   if (!::GLGPU_IO_Helper_ReadBDAT(
-        filename, _h[slot], &_rho[slot], &_phi[slot], &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot], false, _precompute_supercurrent))
+        filename, _h[slot], &_rho[slot], &_phi[slot], &_re[slot], &_im[slot], &_Jx[slot], &_Jy[slot], &_Jz[slot], false, _precompute_supercurrent, z0, z1))
     return false;
   else 
     return true;
 }
 
+void GLGPUDataset::SetRegionOfInterest(const RegionOfInterest& roi)
+{
+  _roi = roi;
+}
+
 #if 0
 float Ax(const float X[3], int slot=0) const {if (By()>0) return -Kex(slot); else return -X[1]*Bz()-Kex(slot);}
 // float Ax(const float X[3], int slot=0) const {if (By()>0) return 0; else return -X[1]*Bz();}
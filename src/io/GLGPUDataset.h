@@ -2,6 +2,7 @@
 #define _GLGPUDATASET_H
 
 #include "io/GLDataset.h"
+#include "common/RegionOfInterest.h"
 
 class GLGPUDataset : public GLDataset
 {
@@ -18,19 +19,28 @@ public:
   void WriteNetCDF(const std::string& filename, int slot=0);
   void WriteRaw(const std::string& prefix, int slot=0);
   void RotateTimeSteps();
+  void SwapTimeStep(GLGPUDataset& other, int slot=0, int other_slot=0); // exchanges loaded data without copying
   void CloseDataFile();
 
+  // BDAT frames are then read only in the xy planes overlapping the region
+  // (with its halo); the field is zero elsewhere
+  void SetRegionOfInterest(const RegionOfInterest&);
+  const RegionOfInterest& GetRegionOfInterest() const {return _roi;}
+
   int NTimeSteps() const {return _filenames.size();}
 
   void PrintInfo(int slot=0) const;
 
-  bool BuildDataFromArray(const GLHeader&, const float *rho, const float *phi, const float *re, const float *im);
+  bool BuildDataFromArray(const GLHeader&, const float *rho, const float *phi, const float *re, const float *im, int slot=0);
+  // non-owning: the slot refers to the given arrays, which must outlive it or the next load into it
+  bool BindDataArrays(const GLHeader&, float *rho, float *phi, float *re, float *im, int slot=0);
   void GetDataArray(GLHeader& h, float **rho, float **phi, float **re, float **im, float **J, int slot=0);
   // float *GetSupercurrentDataArray() const {return _J[0];} // FIXME
   
 private:
   bool OpenBDATDataFile(const std::string& filename, int slot=0);
   bool OpenLegacyDataFile(const std::string& filename, int slot=0);
+  void FreeSlot(int slot);
 
   // void ComputeSupercurrentField(int slot=0);
 
@@ -81,6 +91,8 @@ public:
 protected:
   float *_rho[2], *_phi[2], *_re[2], *_im[2];
   float *_Jx[2], *_Jy[2], *_Jz[2]; // supercurrent
+  bool _borrowed[2]; // psi arrays bound by BindDataArrays
+  RegionOfInterest _roi;
 
   std::vector<std::string> _filenames; // filenames for different timesteps
 };
@@ -0,0 +1,263 @@
+#include "GLGPUSynthetic.h"
+#include "GLGPU_IO_Helper.h"
+#include <algorithm>
+#include <random>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+GLGPUSynthetic::GLGPUSynthetic(const int dims[3], const float lengths[3], float xi) :
+  _xi(xi)
+{
+  for (int i=0; i<3; i++) {
+    _dims[i] = dims[i];
+    _lengths[i] = lengths[i];
+    _origins[i] = -0.5 * lengths[i];
+    _cell_lengths[i] = lengths[i] / (dims[i] - 1);
+  }
+}
+
+void GLGPUSynthetic::AddStraight(float x, float y, float vx, float vy, int chirality)
+{
+  SyntheticVortex v;
+  memset(&v, 0, sizeof(SyntheticVortex));
+  v.type = SYNTHETIC_STRAIGHT;
+  v.chirality = chirality;
+  v.center[0] = x;
+  v.center[1] = y;
+  v.velocity[0] = vx;
+  v.velocity[1] = vy;
+  AddVortex(v);
+}
+
+void GLGPUSynthetic::AddHelix(float x, float y, float radius, float wavenumber, float omega, int chirality)
+{
+  SyntheticVortex v;
+  memset(&v, 0, sizeof(SyntheticVortex));
+  v.type = SYNTHETIC_HELIX;
+  v.chirality = chirality;
+  v.center[0] = x;
+  v.center[1] = y;
+  v.radius = radius;
+  v.wavenumber = wavenumber;
+  v.omega = omega;
+  AddVortex(v);
+}
+
+void GLGPUSynthetic::AddPair(float x, float y, float z, float a, float rate, float t0)
+{
+  SyntheticVortex v;
+  memset(&v, 0, sizeof(SyntheticVortex));
+  v.type = SYNTHETIC_PAIR;
+  v.chirality = 1;
+  v.center[0] = x;
+  v.center[1] = y;
+  v.center[2] = z;
+  v.a = a;
+  v.rate = rate;
+  v.t0 = t0;
+  AddVortex(v);
+}
+
+void GLGPUSynthetic::AddRandom(int nstraight, int nhelices, int npairs, float speed, unsigned int seed)
+{
+  const int n = nstraight + nhelices + npairs;
+  if (n == 0) return;
+
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+  // cells of the xy-plane, visited in a shuffled order
+  int ncells[2];
+  ncells[0] = std::max(1, (int)ceil(sqrt((double)n * _lengths[0] / _lengths[1])));
+  ncells[1] = (n + ncells[0] - 1) / ncells[0];
+  const float w[2] = {_lengths[0] / ncells[0], _lengths[1] / ncells[1]};
+
+  std::vector<int> cells(ncells[0] * ncells[1]);
+  for (int i=0; i<cells.size(); i++) cells[i] = i;
+  std::shuffle(cells.begin(), cells.end(), gen);
+
+  for (int i=0; i<n; i++) {
+    const int cx = cells[i] % ncells[0], cy = cells[i] / ncells[0];
+    const float x = _origins[0] + w[0] * (cx + 0.35f + 0.3f*uniform(gen)),
+                y = _origins[1] + w[1] * (cy + 0.35f + 0.3f*uniform(gen));
+    const int chirality = uniform(gen) < 0.5f ? 1 : -1;
+
+    if (i < nstraight) {
+      const float angle = 2*M_PI*uniform(gen);
+      AddStraight(x, y, speed*cos(angle), speed*sin(angle), chirality);
+    } else if (i < nstraight + nhelices) {
+      const float radius = 0.15f * std::min(w[0], w[1]),
+                  wavenumber = 2*M_PI / _lengths[2] * (1 + (int)(2*uniform(gen)));
+      AddHelix(x, y, radius, wavenumber, speed/radius, chirality);
+    } else {
+      // the branches stay within the cell, start up to 0.2 cells from the center, 
+      // and reconnect half way between two integer times; after about three times
+      // as long, the reconnected branches leave the domain through the z-boundaries
+      const float a = (0.5f*w[0]/_lengths[2]) * (0.5f*w[0]/_lengths[2]),
+                  h0 = w[0] * (0.1f + 0.1f*uniform(gen)),
+                  rate = speed * w[0] / 8;
+      AddPair(x, y, 0, a, rate, floor(h0*h0/rate) + 0.5f);
+    }
+  }
+}
+
+GLHeader GLGPUSynthetic::Header(float t) const
+{
+  GLHeader h;
+  memset(&h, 0, sizeof(GLHeader));
+  h.ndims = 3;
+  for (int i=0; i<3; i++) {
+    h.dims[i] = _dims[i];
+    h.pbc[i] = false;
+    h.lengths[i] = _lengths[i];
+    h.origins[i] = _origins[i];
+    h.cell_lengths[i] = _cell_lengths[i];
+  }
+  h.time = t;
+  h.dtype = DTYPE_BDAT;
+  return h;
+}
+
+void GLGPUSynthetic::Factor(const SyntheticVortex& v, const float X[3], float t, float &re, float &im) const
+{
+  float wr, wi;
+
+  if (v.type == SYNTHETIC_STRAIGHT) {
+    wr = X[0] - (v.center[0] + v.velocity[0]*t);
+    wi = X[1] - (v.center[1] + v.velocity[1]*t);
+  } else if (v.type == SYNTHETIC_HELIX) {
+    const float theta = v.wavenumber*X[2] + v.omega*t;
+    wr = X[0] - (v.center[0] + v.radius*cos(theta));
+    wi = X[1] - (v.center[1] + v.radius*sin(theta));
+  } else { // SYNTHETIC_PAIR
+    const float x = X[0] - v.center[0], y = X[1] - v.center[1], z = X[2] - v.center[2];
+    wr = (x*x - v.a*z*z + v.rate*(t - v.t0)) / (2*_xi);
+    wi = y;
+  }
+
+  wi *= v.chirality;
+  const float s = 1.f / sqrt(wr*wr + wi*wi + _xi*_xi);
+  re = wr * s;
+  im = wi * s;
+}
+
+void GLGPUSynthetic::Generate(float t, float *re, float *im) const
+{
+  for (int k=0; k<_dims[2]; k++)
+    for (int j=0; j<_dims[1]; j++)
+      for (int i=0; i<_dims[0]; i++) {
+        const float X[3] = {
+          _origins[0] + i*_cell_lengths[0],
+          _origins[1] + j*_cell_lengths[1],
+          _origins[2] + k*_cell_lengths[2]};
+
+        float r = 1, m = 0;
+        for (int l=0; l<_vortices.size(); l++) {
+          float fr, fi;
+          Factor(_vortices[l], X, t, fr, fi);
+          const float r1 = r*fr - m*fi, m1 = r*fi + m*fr;
+          r = r1;
+          m = m1;
+        }
+
+        const size_t nid = i + _dims[0] * (j + (size_t)_dims[1] * k);
+        re[nid] = r;
+        im[nid] = m;
+      }
+}
+
+bool GLGPUSynthetic::WriteBDAT(const std::string& filename, float t) const
+{
+  const size_t count = (size_t)_dims[0] * _dims[1] * _dims[2];
+  std::vector<float> re(count), im(count);
+  Generate(t, re.data(), im.data());
+
+  GLHeader h = Header(t);
+  return GLGPU_IO_Helper_WriteBDAT(filename, h, re.data(), im.data());
+}
+
+bool GLGPUSynthetic::Inside(const float X[3]) const
+{
+  for (int i=0; i<3; i++)
+    if (X[i] < _origins[i] || X[i] > _origins[i] + _lengths[i]) return false;
+  return true;
+}
+
+int GLGPUSynthetic::NumLines(float t) const
+{
+  int n = 0;
+  for (int l=0; l<_vortices.size(); l++) {
+    const SyntheticVortex &v = _vortices[l];
+    if (v.type == SYNTHETIC_STRAIGHT || v.type == SYNTHETIC_HELIX) {
+      const float X[3] = {v.center[0] + v.velocity[0]*t, v.center[1] + v.velocity[1]*t, 0};
+      n += Inside(X);
+    } else { // each branch of the hyperbola is counted if its vertex is in the domain
+      const float c = v.rate*(t - v.t0);
+      if (c == 0) {
+        n += Inside(v.center);
+        continue;
+      }
+      for (int s=-1; s<=1; s+=2) {
+        float X[3] = {v.center[0], v.center[1], v.center[2]};
+        if (c < 0) X[0] += s*sqrt(-c);
+        else X[2] += s*sqrt(c/v.a);
+        n += Inside(X);
+      }
+    }
+  }
+  return n;
+}
+
+int GLGPUSynthetic::NumReconnections(float t0, float t1) const
+{
+  int n = 0;
+  for (int l=0; l<_vortices.size(); l++) 
+    if (_vortices[l].type == SYNTHETIC_PAIR && _vortices[l].t0 > t0 && _vortices[l].t0 <= t1)
+      n ++;
+  return n;
+}
+
+float GLGPUSynthetic::Distance(const SyntheticVortex& v, const float X[3], float t) const
+{
+  if (v.type == SYNTHETIC_STRAIGHT || v.type == SYNTHETIC_HELIX) { // within the z-plane of X
+    float C[2] = {v.center[0] + v.velocity[0]*t, v.center[1] + v.velocity[1]*t};
+    if (v.type == SYNTHETIC_HELIX) {
+      const float theta = v.wavenumber*X[2] + v.omega*t;
+      C[0] += v.radius*cos(theta);
+      C[1] += v.radius*sin(theta);
+    }
+    return sqrt((X[0]-C[0])*(X[0]-C[0]) + (X[1]-C[1])*(X[1]-C[1]));
+  }
+
+  // pair: sample the hyperbola in the xz-plane
+  const float x = X[0] - v.center[0], y = X[1] - v.center[1], z = X[2] - v.center[2];
+  const float c = v.rate*(t - v.t0);
+  const float extent = std::max(_lengths[0], _lengths[2]),
+              step = 0.125f * std::min(_cell_lengths[0], _cell_lengths[2]);
+
+  float d2 = FLT_MAX;
+  for (float s=-extent; s<=extent; s+=step) {
+    float P[2][2]; // two branches, (x, z)
+    if (c <= 0) {
+      const float px = sqrt(v.a*s*s - c);
+      P[0][0] = px; P[0][1] = s;
+      P[1][0] = -px; P[1][1] = s;
+    } else {
+      const float pz = sqrt((s*s + c) / v.a);
+      P[0][0] = s; P[0][1] = pz;
+      P[1][0] = s; P[1][1] = -pz;
+    }
+    for (int b=0; b<2; b++)
+      d2 = std::min(d2, (x-P[b][0])*(x-P[b][0]) + (z-P[b][1])*(z-P[b][1]));
+  }
+  return sqrt(d2 + y*y);
+}
+
+float GLGPUSynthetic::Distance(const float X[3], float t) const
+{
+  float d = FLT_MAX;
+  for (int l=0; l<_vortices.size(); l++)
+    d = std::min(d, Distance(_vortices[l], X, t));
+  return d;
+}
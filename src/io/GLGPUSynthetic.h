@@ -0,0 +1,67 @@
+#ifndef _GLGPU_SYNTHETIC_H
+#define _GLGPU_SYNTHETIC_H
+
+#include <string>
+#include <vector>
+#include "GLHeader.h"
+
+enum {
+  SYNTHETIC_STRAIGHT = 0, // along z through (x, y)
+  SYNTHETIC_HELIX, // along z, winding around (x, y)
+  SYNTHETIC_PAIR // antiparallel pair in the plane y, reconnecting at (x, y, z) at time t0
+};
+
+struct SyntheticVortex {
+  int type;
+  int chirality;
+  float center[3];
+  float velocity[2]; // drift of straight lines and helices in the xy-plane
+  float radius, wavenumber, omega; // helix: phase wavenumber*z + omega*t
+  float a, rate, t0; // pair: (x-cx)^2 - a*(z-cz)^2 + rate*(t-t0) = 0 in the plane y = cy
+};
+
+/*
+ * \class   GLGPUSynthetic
+ * \brief   Deterministic GLGPU order parameter fields with analytically
+ *          placed vortex lines.  The field is the product of one factor
+ *          per vortex, w/sqrt(|w|^2+xi^2), where w is a complex function
+ *          vanishing exactly on the vortex, so the zero set of the field
+ *          is the union of the prescribed lines.  Boundaries are open.
+*/
+class GLGPUSynthetic
+{
+public:
+  GLGPUSynthetic(const int dims[3], const float lengths[3], float xi=1.f);
+
+  void AddVortex(const SyntheticVortex& v) {_vortices.push_back(v);}
+  void AddStraight(float x, float y, float vx=0, float vy=0, int chirality=1);
+  void AddHelix(float x, float y, float radius, float wavenumber, float omega, int chirality=1);
+  void AddPair(float x, float y, float z, float a, float rate, float t0);
+
+  // places the vortices on separate cells of a jittered grid over the xy-plane
+  void AddRandom(int nstraight, int nhelices, int npairs, float speed, unsigned int seed);
+
+  const std::vector<SyntheticVortex>& Vortices() const {return _vortices;}
+
+  GLHeader Header(float t) const;
+  void Generate(float t, float *re, float *im) const; // x fastest, as in the dataset
+  bool WriteBDAT(const std::string& filename, float t) const;
+
+  // known topology at time t
+  int NumLines(float t) const;
+  int NumReconnections(float t0, float t1) const; // in (t0, t1]
+  float Distance(const float X[3], float t) const; // to the nearest vortex line
+
+private:
+  void Factor(const SyntheticVortex& v, const float X[3], float t, float &re, float &im) const;
+  float Distance(const SyntheticVortex& v, const float X[3], float t) const;
+  bool Inside(const float X[3]) const;
+
+private:
+  int _dims[3];
+  float _lengths[3], _origins[3], _cell_lengths[3];
+  float _xi;
+  std::vector<SyntheticVortex> _vortices;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "def.h"
 #include "GLGPU_IO_Helper.h"
 #include "glpp/GL_post_process.h"
+#include "common/Profiler.h"
+#include <algorithm>
 #include <cmath>
 #include <cassert>
 #include <cstdio>
@@ -24,11 +26,55 @@ enum {
 static const int GLGPU_LEGACY_TAG_SIZE = 4;
 static const char GLGPU_LEGACY_TAG[] = "CA02";
 
+// converts interleaved psi samples (re, im if optype is 0, otherwise rho or
+// rho^2, phi) into the requested arrays; outputs passed as NULL are skipped.
+// The samples are the nodes [offset, offset+count) of total nodes (count if
+// 0); the other nodes are zero.
+static void decode_psi(const float *data, int count, int optype, bool rho_squared, 
+    float **rho, float **phi, float **re, float **im, size_t offset=0, size_t total=0)
+{
+  if (total == 0) total = count;
+  if (total == (size_t)count) {
+    if (rho) *rho = (float*)malloc(sizeof(float)*total);
+    if (phi) *phi = (float*)malloc(sizeof(float)*total);
+    if (re) *re = (float*)malloc(sizeof(float)*total);
+    if (im) *im = (float*)malloc(sizeof(float)*total);
+  } else { // pages outside the slab are never touched
+    if (rho) *rho = (float*)calloc(total, sizeof(float));
+    if (phi) *phi = (float*)calloc(total, sizeof(float));
+    if (re) *re = (float*)calloc(total, sizeof(float));
+    if (im) *im = (float*)calloc(total, sizeof(float));
+  }
+
+  float *rho_ = rho ? *rho + offset : NULL, *phi_ = phi ? *phi + offset : NULL,
+        *re_ = re ? *re + offset : NULL, *im_ = im ? *im + offset : NULL;
+
+  if (optype == 0) {
+#pragma omp parallel for
+    for (int i=0; i<count; i++) {
+      const float R = data[i*2], I = data[i*2+1];
+      if (rho) rho_[i] = sqrt(R*R + I*I);
+      if (phi) phi_[i] = atan2(I, R);
+      if (re) re_[i] = R;
+      if (im) im_[i] = I;
+    }
+  } else {
+#pragma omp parallel for
+    for (int i=0; i<count; i++) {
+      const float Rho = rho_squared ? sqrt(data[i*2]) : data[i*2], Phi = data[i*2+1];
+      if (rho) rho_[i] = Rho; 
+      if (phi) phi_[i] = Phi;
+      if (re) re_[i] = Rho * cos(Phi);
+      if (im) im_[i] = Rho * sin(Phi);
+    }
+  }
+}
+
 bool GLGPU_IO_Helper_ReadBDAT(
     const std::string& filename, 
     GLHeader &h,
     float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz,
-    bool header_only, bool supercurrent)
+    bool header_only, bool supercurrent, int z0, int z1)
 {
   BDATReader *reader = new BDATReader(filename); 
   if (!reader->Valid()) {
@@ -45,11 +91,19 @@ bool GLGPU_IO_Helper_ReadBDAT(
                  recID = reader->RedID(); 
     float f; // temp var
 
+    size_t offset = 0; // first node of the psi samples read
     if (name != "psi")
       reader->ReadNextRecordData(&buf);
-    else if (!header_only)
+    else if (header_only)
+      break;
+    else if (type == BDAT_FLOAT && (z0 > 0 || z1 < h.dims[2]-1)) {
+      const size_t plane = (size_t)h.dims[0] * h.dims[1];
+      const int k0 = std::max(z0, 0), k1 = std::min(z1, h.dims[2]-1);
+      offset = plane * k0;
+      reader->ReadNextRecordData(&buf, offset*2*sizeof(float), 
+          k1 >= k0 ? (k1-k0+1)*plane*2*sizeof(float) : 0);
+    } else 
       reader->ReadNextRecordData(&buf);
-    else break;
     void *p = (void*)buf.data();
 
     if (name == "dim") {
@@ -124,33 +178,9 @@ bool GLGPU_IO_Helper_ReadBDAT(
     } else if (name == "psi" && !header_only) {
       if (type == BDAT_FLOAT) {
         int count = buf.size()/sizeof(float)/2;
-        int optype = recID == 2000 ? 0 : 1;
-        float *data = (float*)p;
-
-        *rho = (float*)malloc(sizeof(float)*count);
-        *phi = (float*)malloc(sizeof(float)*count);
-        *re = (float*)malloc(sizeof(float)*count);
-        *im = (float*)malloc(sizeof(float)*count);
-
-        if (optype == 0) { // re, im
-#pragma omp parallel for
-          for (int i=0; i<count; i++) {
-            const float R = data[i*2], I = data[i*2+1];
-            (*rho)[i] = sqrt(R*R + I*I);
-            (*phi)[i] = atan2(I, R);
-            (*re)[i] = R;
-            (*im)[i] = I;
-          }
-        } else { // rho^2, phi
-#pragma omp parallel for
-          for (int i=0; i<count; i++) {
-            const float Rho = sqrt(data[i*2]), Phi = data[i*2+1];
-            (*rho)[i] = Rho; 
-            (*phi)[i] = Phi;
-            (*re)[i] = Rho * cos(Phi);
-            (*im)[i] = Rho * sin(Phi);
-          }
-        }
+        int optype = recID == 2000 ? 0 : 1; // re, im or rho^2, phi
+        decode_psi((const float*)p, count, optype, true, rho, phi, re, im, 
+            offset, (size_t)h.dims[0] * h.dims[1] * h.dims[2]);
       } else if (type == BDAT_DOUBLE) {
         // TODO
         assert(false);
@@ -161,7 +191,9 @@ bool GLGPU_IO_Helper_ReadBDAT(
   
   for (int i=0; i<3; i++) {
     h.origins[i] = -0.5 * h.lengths[i];
-    if (h.pbc[i]) 
+    if (h.dims[i] <= 1) // the single layer of 2D data
+      h.cell_lengths[i] = h.lengths[i];
+    else if (h.pbc[i]) 
       h.cell_lengths[i] = h.lengths[i] / h.dims[i];
     else 
       h.cell_lengths[i] = h.lengths[i] / (h.dims[i] - 1);
@@ -254,7 +286,9 @@ bool GLGPU_IO_Helper_ReadLegacy(
 
   for (int i=0; i<3; i++) {
     h.origins[i] = -0.5 * h.lengths[i];
-    if (h.pbc[i]) 
+    if (h.dims[i] <= 1) // the single layer of 2D data
+      h.cell_lengths[i] = h.lengths[i];
+    else if (h.pbc[i]) 
       h.cell_lengths[i] = h.lengths[i] / h.dims[i];
     else 
       h.cell_lengths[i] = h.lengths[i] / (h.dims[i] - 1);
@@ -276,6 +310,7 @@ bool GLGPU_IO_Helper_ReadLegacy(
   }
  
   if (header_only) {
+    Profiler::Count(PROF_BYTES_READ, ftell(fp));
     fclose(fp);
     return true;
   }
@@ -287,37 +322,11 @@ bool GLGPU_IO_Helper_ReadLegacy(
 
   int offset = ftell(fp);
 
-  // mem allocation 
-  *rho = (float*)malloc(sizeof(float)*count);
-  *phi = (float*)malloc(sizeof(float)*count);
-  *re = (float*)malloc(sizeof(float)*count);
-  *im = (float*)malloc(sizeof(float)*count);
-
   if (datatype == GLGPU_TYPE_FLOAT) {
     // raw data
     float *buf = (float*)malloc(sizeof(float)*count*2); // complex numbers
     fread(buf, sizeof(float), count*2, fp);
-    
-    if (optype == 0) { // re, im
-#pragma omp parallel for
-      for (int i=0; i<count; i++) {
-        const float R = buf[i*2], I = buf[i*2+1]; 
-        (*rho)[i] = sqrt(R*R + I*I);
-        (*phi)[i] = atan2(I, R);
-        (*re)[i] = R;
-        (*im)[i] = I;
-      }
-    } else { // rho, phi
-#pragma omp parallel for
-      for (int i=0; i<count; i++) {
-        const float Rho = buf[i*2], Phi = buf[i*2+1];
-        (*rho)[i] = Rho; 
-        (*phi)[i] = Phi;
-        (*re)[i] = Rho * cos(Phi);
-        (*im)[i] = Rho * sin(Phi);
-      }
-    }
-
+    decode_psi(buf, count, optype, false, rho, phi, re, im); // re, im or rho, phi
     free(buf);
   } else if (datatype == GLGPU_TYPE_DOUBLE) {
     assert(false);
@@ -326,10 +335,67 @@ bool GLGPU_IO_Helper_ReadLegacy(
   if (supercurrent)
     GLGPU_IO_Helper_ComputeSupercurrent(h, *re, *im, Jx, Jy, Jz);
 
+  Profiler::Count(PROF_BYTES_READ, ftell(fp));
   fclose(fp);
   return true;
 }
 
+static void write_bdat_record(FILE *fp, const char *name, unsigned int recID, 
+    unsigned int typeID, unsigned int recNum, unsigned int recLen, const void *data)
+{
+  const unsigned int IDlen = (recID << 8) | (strlen(name) & 0xff);
+  fwrite(&IDlen, sizeof(unsigned int), 1, fp);
+  fwrite(name, 1, strlen(name), fp);
+  fwrite(&typeID, sizeof(unsigned int), 1, fp);
+  fwrite(&recNum, sizeof(unsigned int), 1, fp);
+  fwrite(&recLen, sizeof(unsigned int), 1, fp);
+  fwrite(data, recLen, recNum, fp);
+}
+
+bool GLGPU_IO_Helper_WriteBDAT(
+    const std::string& filename, 
+    const GLHeader& h,
+    const float *re, const float *im)
+{
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp) return false;
+
+  const unsigned int BOM = 0x01020304, 
+                     INT32 = 0x400, FLOAT = 0x402;
+  fwrite("BDAT", 1, 4, fp);
+  fwrite(&BOM, sizeof(unsigned int), 1, fp);
+
+  const int btype = (h.pbc[0] ? 0x01 : 0) | (h.pbc[1] ? 0x0100 : 0) | (h.pbc[2] ? 0x010000 : 0);
+  write_bdat_record(fp, "dim", 0, INT32, 1, 4, &h.ndims);
+  write_bdat_record(fp, "Nx", 0, INT32, 1, 4, &h.dims[0]);
+  write_bdat_record(fp, "Ny", 0, INT32, 1, 4, &h.dims[1]);
+  write_bdat_record(fp, "Nz", 0, INT32, 1, 4, &h.dims[2]);
+  write_bdat_record(fp, "Lx", 0, FLOAT, 1, 4, &h.lengths[0]);
+  write_bdat_record(fp, "Ly", 0, FLOAT, 1, 4, &h.lengths[1]);
+  write_bdat_record(fp, "Lz", 0, FLOAT, 1, 4, &h.lengths[2]);
+  write_bdat_record(fp, "BC", 0, INT32, 1, 4, &btype);
+  write_bdat_record(fp, "t", 0, FLOAT, 1, 4, &h.time);
+  write_bdat_record(fp, "Bx", 0, FLOAT, 1, 4, &h.B[0]);
+  write_bdat_record(fp, "By", 0, FLOAT, 1, 4, &h.B[1]);
+  write_bdat_record(fp, "Bz", 0, FLOAT, 1, 4, &h.B[2]);
+  write_bdat_record(fp, "Jxext", 0, FLOAT, 1, 4, &h.Jxext);
+  write_bdat_record(fp, "K", 0, FLOAT, 1, 4, &h.Kex);
+  write_bdat_record(fp, "V", 0, FLOAT, 1, 4, &h.V);
+
+  const size_t count = (size_t)h.dims[0] * h.dims[1] * h.dims[2];
+  float *buf = (float*)malloc(sizeof(float)*count*2);
+  for (size_t i=0; i<count; i++) {
+    buf[i*2] = re[i];
+    buf[i*2+1] = im[i];
+  }
+  write_bdat_record(fp, "psi", 2000, FLOAT, count*2, 4, buf); // recID 2000: re, im
+  free(buf);
+
+  const bool succ = !ferror(fp);
+  fclose(fp);
+  return succ;
+}
+
 bool GLGPU_IO_Helper_WriteNetCDF(
     const std::string& filename, 
     GLHeader& h,
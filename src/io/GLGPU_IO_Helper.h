@@ -3,12 +3,17 @@
 
 #include "GLHeader.h"
 #include "BDATReader.h"
+#include <climits>
+
+// Any of rho, phi, re and im may be NULL to skip decoding that array; re and im
+// are required with supercurrent.  Only the xy planes z0..z1 of psi are read
+// from BDAT files, and the other nodes are zero.
 
 bool GLGPU_IO_Helper_ReadBDAT(
     const std::string& filename, 
     GLHeader &hdr,
     float **rho, float **phi, float **re, float **im, float **Jx, float **Jy, float **Jz,
-    bool header_only=false, bool supercurrent=false);
+    bool header_only=false, bool supercurrent=false, int z0=0, int z1=INT_MAX);
 
 bool GLGPU_IO_Helper_ReadLegacy(
     const std::string& filename, 
@@ -24,6 +29,12 @@ bool GLGPU_IO_Helper_ReadNetCDF(
     GLHeader &hdr, 
     float **psi); 
 
+// writes the header and psi (as re, im) in the format read by GLGPU_IO_Helper_ReadBDAT
+bool GLGPU_IO_Helper_WriteBDAT(
+    const std::string& filename, 
+    const GLHeader &hdr, 
+    const float *re, const float *im);
+
 bool GLGPU_IO_Helper_WriteNetCDF(
     const std::string& filename, 
     GLHeader &hdr, 
@@ -4,6 +4,9 @@
 #include "vtkCellData.h"
 #include "vtkPointData.h"
 #include "vtkFieldData.h"
+#include "vtkFloatArray.h"
+#include "vtkDataArraySelection.h"
+#include "vtkCallbackCommand.h"
 #include "vtkRectilinearGrid.h"
 #include "vtkStructuredGrid.h"
 #include "vtkInformation.h"
@@ -12,27 +15,76 @@
 #include "vtkBDATSeriesReader.h"
 #include "io/GLGPU_IO_Helper.h"
 #include <assert.h>
+#include <algorithm>
 
 vtkStandardNewMacro(vtkBDATSeriesReader);
 
-vtkBDATSeriesReader::vtkBDATSeriesReader()
+static const char *arrayNames[] = {"rho", "phi", "re", "im"};
+
+vtkBDATSeriesReader::vtkBDATSeriesReader() : 
+  FileIndex(0), CacheSize(1024), ReadAhead(0), CacheBytes(0)
 {
   SetNumberOfInputPorts(0);
   SetNumberOfOutputPorts(1);
+
+  PointDataArraySelection = vtkDataArraySelection::New();
+  for (int i=0; i<NARRAYS; i++) 
+    PointDataArraySelection->AddArray(arrayNames[i]);
+
+  SelectionObserver = vtkCallbackCommand::New();
+  SelectionObserver->SetCallback(&vtkBDATSeriesReader::SelectionModifiedCallback);
+  SelectionObserver->SetClientData(this);
+  PointDataArraySelection->AddObserver(vtkCommand::ModifiedEvent, SelectionObserver);
+
+  Pending.fidx = -1;
 }
 
 vtkBDATSeriesReader::~vtkBDATSeriesReader()
 {
+  ClearCache();
+  PointDataArraySelection->RemoveObserver(SelectionObserver);
+  SelectionObserver->Delete();
+  PointDataArraySelection->Delete();
+}
+
+void vtkBDATSeriesReader::SelectionModifiedCallback(vtkObject*, unsigned long, void* clientdata, void*)
+{
+  static_cast<vtkBDATSeriesReader*>(clientdata)->Modified();
+}
+
+int vtkBDATSeriesReader::GetNumberOfPointArrays()
+{
+  return PointDataArraySelection->GetNumberOfArrays();
+}
+
+const char* vtkBDATSeriesReader::GetPointArrayName(int index)
+{
+  return PointDataArraySelection->GetArrayName(index);
+}
+
+int vtkBDATSeriesReader::GetPointArrayStatus(const char* name)
+{
+  return PointDataArraySelection->ArrayIsEnabled(name);
+}
+
+void vtkBDATSeriesReader::SetPointArrayStatus(const char* name, int status)
+{
+  if (status) PointDataArraySelection->EnableArray(name);
+  else PointDataArraySelection->DisableArray(name);
 }
 
 void vtkBDATSeriesReader::AddFileName(const char* filename)
 {
+  ClearCache(); // keyed by file index
   FileNames.push_back(filename);
+  Modified();
 }
 
 void vtkBDATSeriesReader::RemoveAllFileNames()
 {
+  ClearCache();
   FileNames.clear();
+  Modified();
 }
 
 const char* vtkBDATSeriesReader::GetFileName(unsigned int idx)
@@ -103,6 +155,100 @@ int vtkBDATSeriesReader::RequestInformation(
   return 1;
 }
 
+bool vtkBDATSeriesReader::ReadTimeStep(
+    const std::string& filename, const bool wanted[NARRAYS], 
+    GLHeader& h, float *data[NARRAYS])
+{
+  float **p[NARRAYS];
+  for (int i=0; i<NARRAYS; i++) {
+    data[i] = NULL;
+    p[i] = wanted[i] ? &data[i] : NULL;
+  }
+
+  bool succ = GLGPU_IO_Helper_ReadBDAT(
+      filename, h, p[0], p[1], p[2], p[3], NULL, NULL, NULL);
+  if (!succ) 
+    succ = GLGPU_IO_Helper_ReadLegacy(
+        filename, h, p[0], p[1], p[2], p[3], NULL, NULL, NULL);
+  return succ;
+}
+
+void vtkBDATSeriesReader::AddToCache(int fidx, const GLHeader& h, float *data[NARRAYS])
+{
+  const vtkIdType count = (vtkIdType)h.dims[0] * h.dims[1] * h.dims[2];
+  CacheEntry &e = Cache[fidx];
+  e.h = h;
+
+  for (int i=0; i<NARRAYS; i++) {
+    if (data[i] == NULL) continue;
+    if (e.arrays[i] != NULL) {
+      free(data[i]);
+      continue;
+    }
+
+    // the array takes over the buffer; it stays valid downstream after eviction
+    vtkSmartPointer<vtkFloatArray> a = vtkSmartPointer<vtkFloatArray>::New();
+    a->SetName(arrayNames[i]);
+    a->SetNumberOfComponents(1);
+    a->SetArray(data[i], count, 0, vtkFloatArray::VTK_DATA_ARRAY_FREE);
+    e.arrays[i] = a;
+    e.bytes += sizeof(float) * count;
+    CacheBytes += sizeof(float) * count;
+  }
+
+  CacheOrder.remove(fidx);
+  CacheOrder.push_back(fidx);
+}
+
+void vtkBDATSeriesReader::EvictFromCache(int keep)
+{
+  const size_t limit = (size_t)std::max(0, CacheSize) << 20;
+  for (std::list<int>::iterator it = CacheOrder.begin(); 
+      CacheBytes > limit && it != CacheOrder.end(); ) {
+    if (*it == keep) {
+      it ++;
+      continue;
+    }
+    CacheBytes -= Cache[*it].bytes;
+    Cache.erase(*it);
+    it = CacheOrder.erase(it);
+  }
+}
+
+void vtkBDATSeriesReader::ClearCache()
+{
+  FinishReadAhead();
+  Cache.clear();
+  CacheOrder.clear();
+  CacheBytes = 0;
+}
+
+void vtkBDATSeriesReader::StartReadAhead(int fidx, const bool wanted[NARRAYS])
+{
+  Pending.fidx = fidx;
+  const std::string filename = FileNames[fidx];
+  bool wanted1[NARRAYS];
+  std::copy(wanted, wanted + NARRAYS, wanted1);
+
+  // the thread only touches Pending, which is not read before joining
+  ReadAheadThread = std::thread([this, filename, wanted1]() {
+    Pending.succ = ReadTimeStep(filename, wanted1, Pending.h, Pending.data);
+  });
+}
+
+void vtkBDATSeriesReader::FinishReadAhead()
+{
+  if (!ReadAheadThread.joinable()) return;
+  ReadAheadThread.join();
+
+  if (Pending.succ && Pending.fidx >= 0 && Pending.fidx < FileNames.size())
+    AddToCache(Pending.fidx, Pending.h, Pending.data);
+  else 
+    for (int i=0; i<NARRAYS; i++) 
+      free(Pending.data[i]);
+  Pending.fidx = -1;
+}
+
 int vtkBDATSeriesReader::RequestData(
     vtkInformation*, 
     vtkInformationVector**, 
@@ -115,65 +261,46 @@ int vtkBDATSeriesReader::RequestData(
 
   fprintf(stderr, "uptime=%f, timestep=%d\n", upTime, upTimeStep);
 
-  GLHeader h;
-  float *rho=NULL, *phi=NULL, *re=NULL, *im=NULL;
-  // FIXME
+  bool wanted[NARRAYS];
+  for (int i=0; i<NARRAYS; i++) 
+    wanted[i] = PointDataArraySelection->ArrayIsEnabled(arrayNames[i]) != 0;
 
-  bool succ = false;
-  if (!succ) {
-    succ = GLGPU_IO_Helper_ReadBDAT(
-        filename.c_str(), h, &rho, &phi, &re, &im, NULL, NULL, NULL);
-  }
-  if (!succ) {
-    succ = GLGPU_IO_Helper_ReadLegacy(
-        filename.c_str(), h, &rho, &phi, &re, &im, NULL, NULL, NULL);
+  FinishReadAhead();
+
+  // decode only the selected arrays that are not cached yet
+  std::map<int, CacheEntry>::iterator it = Cache.find(upTimeStep);
+  bool missing[NARRAYS], anyMissing = it == Cache.end();
+  for (int i=0; i<NARRAYS; i++) {
+    missing[i] = wanted[i] && (it == Cache.end() || it->second.arrays[i] == NULL);
+    anyMissing = anyMissing || missing[i];
   }
-  if (!succ)
-  {
-    vtkErrorMacro("Error opening file " << filename);
-    return 0;
+
+  if (anyMissing) {
+    GLHeader h;
+    float *data[NARRAYS];
+    if (!ReadTimeStep(filename, missing, h, data)) {
+      vtkErrorMacro("Error opening file " << filename);
+      return 0;
+    }
+    AddToCache(upTimeStep, h, data);
+  } else {
+    CacheOrder.remove(upTimeStep);
+    CacheOrder.push_back(upTimeStep);
   }
+  EvictFromCache(upTimeStep);
+
+  const CacheEntry &entry = Cache[upTimeStep];
+  const GLHeader &h = entry.h;
     
   // vtk data structures
   vtkImageData *imageData = 
     vtkImageData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
   imageData->SetDimensions(h.dims[0], h.dims[1], h.dims[2]);
-  // imageData->AllocateScalars(VTK_FLOAT, 1);
 
-  // copy data
-  const int arraySize = h.dims[0]*h.dims[1]*h.dims[2];
-  vtkSmartPointer<vtkDataArray> dataArrayRe, dataArrayIm, dataArrayRho, dataArrayPhi;
-  
-  dataArrayRho.TakeReference(vtkDataArray::CreateDataArray(VTK_FLOAT));
-  dataArrayRho->SetNumberOfComponents(1); 
-  dataArrayRho->SetNumberOfTuples(arraySize);
-  dataArrayRho->SetName("rho");
-  memcpy(dataArrayRho->GetVoidPointer(0), rho, sizeof(float)*arraySize);
-  
-  dataArrayPhi.TakeReference(vtkDataArray::CreateDataArray(VTK_FLOAT));
-  dataArrayPhi->SetNumberOfComponents(1); 
-  dataArrayPhi->SetNumberOfTuples(arraySize);
-  dataArrayPhi->SetName("phi");
-  memcpy(dataArrayPhi->GetVoidPointer(0), phi, sizeof(float)*arraySize);
-
-#if 0
-  dataArrayRe.TakeReference(vtkDataArray::CreateDataArray(VTK_FLOAT));
-  dataArrayRe->SetNumberOfComponents(1); 
-  dataArrayRe->SetNumberOfTuples(arraySize);
-  dataArrayRe->SetName("re");
-  memcpy(dataArrayRe->GetVoidPointer(0), re, sizeof(float)*arraySize);
-  
-  dataArrayIm.TakeReference(vtkDataArray::CreateDataArray(VTK_FLOAT));
-  dataArrayIm->SetNumberOfComponents(1); 
-  dataArrayIm->SetNumberOfTuples(arraySize);
-  dataArrayIm->SetName("im");
-  memcpy(dataArrayIm->GetVoidPointer(0), im, sizeof(float)*arraySize);
-#endif
-
-  imageData->GetPointData()->AddArray(dataArrayRho);
-  imageData->GetPointData()->AddArray(dataArrayPhi);
-  imageData->GetPointData()->AddArray(dataArrayRe);
-  imageData->GetPointData()->AddArray(dataArrayIm);
+  // the cached arrays are shared with the output, not copied
+  for (int i=0; i<NARRAYS; i++) 
+    if (wanted[i]) 
+      imageData->GetPointData()->AddArray(entry.arrays[i]);
 
   // global attributes
   vtkSmartPointer<vtkDataArray> dataArrayB, dataArrayPBC, dataArrayJxext, dataArrayKx, dataArrayV;
@@ -214,8 +341,17 @@ int vtkBDATSeriesReader::RequestData(
   imageData->GetFieldData()->AddArray(dataArrayKx);
   imageData->GetFieldData()->AddArray(dataArrayV);
 
-  free(rho);
-  free(phi);
+  if (ReadAhead) {
+    std::map<double, int>::iterator next = TimeStepsMap.upper_bound(h.time);
+    if (next != TimeStepsMap.end()) {
+      std::map<int, CacheEntry>::iterator it1 = Cache.find(next->second);
+      bool needed = it1 == Cache.end();
+      for (int i=0; i<NARRAYS; i++) 
+        needed = needed || (wanted[i] && it1->second.arrays[i] == NULL);
+      if (needed) 
+        StartReadAhead(next->second, wanted);
+    }
+  }
 
   return 1;
 }
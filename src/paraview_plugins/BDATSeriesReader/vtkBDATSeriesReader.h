@@ -4,9 +4,18 @@
 #include "vtkDataReader.h"
 #include "vtkDataObjectAlgorithm.h"
 #include "vtkImageAlgorithm.h"
+#include "vtkSmartPointer.h"
+#include "io/GLHeader.h"
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
+#include <thread>
+
+class vtkFloatArray;
+class vtkDataArraySelection;
+class vtkCallbackCommand;
+class vtkObject;
 
 class vtkBDATSeriesReader : public vtkImageAlgorithm
 {
@@ -23,15 +32,68 @@ public:
   vtkSetMacro(FileIndex, vtkIdType);
   vtkGetMacro(FileIndex, vtkIdType);
 
+  // upper bound of the decoded timesteps kept in memory, in MB
+  vtkSetMacro(CacheSize, int);
+  vtkGetMacro(CacheSize, int);
+
+  // decode the next timestep in the background after each request
+  vtkSetMacro(ReadAhead, int);
+  vtkGetMacro(ReadAhead, int);
+
+  // point arrays to load: rho, phi, re, im
+  int GetNumberOfPointArrays();
+  const char* GetPointArrayName(int index);
+  int GetPointArrayStatus(const char* name);
+  void SetPointArrayStatus(const char* name, int status);
+
   int RequestInformation(vtkInformation*, vtkInformationVector**, vtkInformationVector*);
   int RequestData(vtkInformation*, vtkInformationVector**, vtkInformationVector*);
 
+private:
+  enum {NARRAYS = 4};
+
+  struct CacheEntry {
+    CacheEntry() : bytes(0) {}
+    GLHeader h;
+    vtkSmartPointer<vtkFloatArray> arrays[NARRAYS]; // NULL if not loaded
+    size_t bytes;
+  };
+
+  // a timestep decoded by the read-ahead thread, collected after joining it
+  struct PendingRead {
+    int fidx; // -1 if none
+    bool succ;
+    GLHeader h;
+    float *data[NARRAYS];
+  };
+
+  static bool ReadTimeStep(const std::string& filename, const bool wanted[NARRAYS],
+      GLHeader& h, float *data[NARRAYS]);
+  void AddToCache(int fidx, const GLHeader& h, float *data[NARRAYS]);
+  void EvictFromCache(int keep);
+  void ClearCache();
+  void StartReadAhead(int fidx, const bool wanted[NARRAYS]);
+  void FinishReadAhead();
+
+  static void SelectionModifiedCallback(vtkObject*, unsigned long, void*, void*);
+
 private:
   std::vector<std::string> FileNames;
   std::vector<double> TimeSteps;
   std::map<double, int> TimeStepsMap;
   vtkIdType FileIndex;
 
+  int CacheSize, ReadAhead;
+  vtkDataArraySelection *PointDataArraySelection;
+  vtkCallbackCommand *SelectionObserver;
+
+  std::map<int, CacheEntry> Cache;
+  std::list<int> CacheOrder; // least recently used first
+  size_t CacheBytes;
+
+  std::thread ReadAheadThread;
+  PendingRead Pending;
+
 protected:
   vtkBDATSeriesReader();
   ~vtkBDATSeriesReader();
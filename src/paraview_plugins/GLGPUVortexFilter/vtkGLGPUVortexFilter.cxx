@@ -22,28 +22,46 @@ vtkGLGPUVortexFilter::vtkGLGPUVortexFilter()
   SetNumberOfInputPorts(1);
   SetNumberOfOutputPorts(1);
   
-  SetUseGPU(false);
-  SetMeshType(0);
-  SetExtentThreshold(0);
+  bUseGPU = false;
+  iMeshType = 0;
+  dExtentThreshold = 0;
+
+  ds = NULL;
+  ex = NULL;
 }
 
 vtkGLGPUVortexFilter::~vtkGLGPUVortexFilter()
 {
+  ReleaseCache();
+}
+
+void vtkGLGPUVortexFilter::ReleaseCache()
+{
+  delete ex;
+  delete ds;
+  ex = NULL;
+  ds = NULL;
 }
 
 void vtkGLGPUVortexFilter::SetUseGPU(bool b)
 {
+  if (bUseGPU == b) return;
   bUseGPU = b;
+  Modified();
 }
 
 void vtkGLGPUVortexFilter::SetMeshType(int i)
 {
+  if (iMeshType == i) return;
   iMeshType = i;
+  Modified();
 }
 
 void vtkGLGPUVortexFilter::SetExtentThreshold(double t)
 {
+  if (dExtentThreshold == t) return;
   dExtentThreshold = t;
+  Modified();
 }
 
 int vtkGLGPUVortexFilter::FillOutputPortInformation(int, vtkInformation *info)
@@ -116,27 +134,50 @@ int vtkGLGPUVortexFilter::ExtractVorticies(vtkImageData* imageData, vtkPolyData*
   // fprintf(stderr, "B={%f, %f, %f}, pbc={%d, %d, %d}, Jxext=%f, Kx=%f, V=%f\n", 
   //     h.B[0], h.B[1], h.B[2], h.pbc[0], h.pbc[1], h.pbc[2], h.Jxext, h.Kex, h.V);
 
-  const int count = h.dims[0]*h.dims[1]*h.dims[2];
+  vtkDataArray *arrays[4] = {dataArrayRho, dataArrayPhi, dataArrayRe, dataArrayIm};
+  for (int i=0; i<4; i++) 
+    if (arrays[i] == NULL || arrays[i]->GetDataType() != VTK_FLOAT) {
+      vtkErrorMacro(<< "rho, phi, re and im must be present as float arrays");
+      return 0;
+    }
+
   float *rho = (float*)dataArrayRho->GetVoidPointer(0), 
         *phi = (float*)dataArrayPhi->GetVoidPointer(0), 
         *re = (float*)dataArrayRe->GetVoidPointer(0), 
         *im = (float*)dataArrayIm->GetVoidPointer(0);
 
-  // build data
-  GLGPUDataset *ds;
-  if (h.ndims == 2) ds = new GLGPU2DDataset;
-  else ds = new GLGPU3DDataset;
-  ds->BuildDataFromArray(h, rho, phi, re, im); // FIXME
+  // the mesh graph only depends on the geometry and the mesh type
+  bool cached = ds != NULL && cachedMeshType == iMeshType;
+  for (int i=0; i<3; i++) 
+    cached = cached && cachedDims[i] == h.dims[i] 
+      && cachedOrigins[i] == origins[i] && cachedSpacing[i] == cell_lengths[i];
+
+  if (!cached) {
+    ReleaseCache();
 
-  if (h.ndims == 3 && iMeshType == 1) {
-    GLGPU3DDataset *ds3 = (GLGPU3DDataset*)ds;
-    ds3->SetMeshType(GLGPU3D_MESH_TET);
+    if (h.ndims == 2) ds = new GLGPU2DDataset;
+    else ds = new GLGPU3DDataset;
+    ds->BindDataArrays(h, rho, phi, re, im);
+
+    if (h.ndims == 3 && iMeshType == 1) {
+      GLGPU3DDataset *ds3 = (GLGPU3DDataset*)ds;
+      ds3->SetMeshType(GLGPU3D_MESH_TET);
+    }
+    ds->BuildMeshGraph();
+
+    ex = new VortexExtractor;
+    ex->SetDataset(ds);
+    ex->SetArchive(false);
+
+    memcpy(cachedDims, h.dims, sizeof(int)*3);
+    memcpy(cachedOrigins, origins, sizeof(double)*3);
+    memcpy(cachedSpacing, cell_lengths, sizeof(double)*3);
+    cachedMeshType = iMeshType;
+  } else {
+    ds->BindDataArrays(h, rho, phi, re, im); // B, Kex, etc. may change between timesteps
+    ex->Clear();
   }
-  ds->BuildMeshGraph();
 
-  VortexExtractor *ex = new VortexExtractor;
-  ex->SetDataset(ds);
-  ex->SetArchive(false);
 #if WITH_CUDA
   ex->SetGPU(bUseGPU); // FIXME: failure fallback
 #endif
@@ -221,8 +262,5 @@ int vtkGLGPUVortexFilter::ExtractVorticies(vtkImageData* imageData, vtkPolyData*
     polyData->SetVerts(cells);
   }
 
-  delete ex;
-  delete ds;
-
   return 1;
 }
@@ -5,6 +5,8 @@
 #include "vtkPolyDataAlgorithm.h"
 
 class vtkDataSet;
+class GLGPUDataset;
+class VortexExtractor;
 
 class vtkGLGPUVortexFilter : public vtkImageAlgorithm
 {
@@ -26,6 +28,7 @@ protected:
 
 private:
   int ExtractVorticies(vtkImageData*, vtkPolyData*);
+  void ReleaseCache();
 
 private:
   vtkGLGPUVortexFilter(const vtkGLGPUVortexFilter&);
@@ -35,6 +38,13 @@ private:
   bool bUseGPU;
   int iMeshType;
   double dExtentThreshold;
+
+  // the dataset views the input arrays without copying; the dataset, its
+  // mesh graph and the extractor are kept while the geometry is unchanged
+  GLGPUDataset *ds;
+  VortexExtractor *ex;
+  int cachedDims[3], cachedMeshType;
+  double cachedOrigins[3], cachedSpacing[3];
 };
 
 #endif
@@ -0,0 +1,182 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include "io/GLGPU3DDataset.h"
+#include "io/GLGPUSynthetic.h"
+#include "extractor/Extractor.h"
+#include "common/VortexEvents.h"
+
+// End-to-end benchmark on synthetic data with known topology:
+//   bench_glgpu3D [sizes=32,64] [threads=1,<cores>] [frames=8] [dir=/tmp]
+// For every grid size, mesh type and thread count, the series is loaded from
+// BDAT files, and faces, vortex lines, edges and transitions are extracted as
+// in extractor_glgpu3D.  The lines of each frame are checked against the
+// generator; the row fails if their number differs, a puncture is more than a
+// cell away from the nearest line, or the number of reconnections between two
+// frames differs.  The generated pairs reconnect at t=3.5 and 6.5, so at
+// least 8 frames are needed to check both.
+
+typedef std::chrono::steady_clock clock_type;
+
+static std::vector<int> parse_list(const char *arg)
+{
+  std::vector<int> v;
+  std::stringstream ss(arg);
+  std::string tok;
+  while (std::getline(ss, tok, ','))
+    v.push_back(atoi(tok.c_str()));
+  return v;
+}
+
+struct bench_result_t {
+  double t[6]; // load, faces, trace, edges, track, save
+  int nlines_wrong, nevents_wrong;
+  float max_dist; // in cells
+};
+
+template <typename F>
+static void timed(double &acc, F f)
+{
+  const clock_type::time_point t0 = clock_type::now();
+  f();
+  acc += std::chrono::duration<double>(clock_type::now() - t0).count();
+}
+
+static void check_frame(const GLGPUSynthetic& syn, VortexExtractor& ex, int slot, float t,
+    float cell, bench_result_t& r)
+{
+  if (ex.GetVortexLines(slot).size() != syn.NumLines(t))
+    r.nlines_wrong ++;
+
+  const std::map<FaceIdType, PuncturedFace>& pfs = ex.GetPuncturedFaces(slot);
+  for (std::map<FaceIdType, PuncturedFace>::const_iterator it = pfs.begin(); it != pfs.end(); it ++)
+    r.max_dist = std::max(r.max_dist, syn.Distance(it->second.pos, t) / cell);
+}
+
+static bench_result_t run(const GLGPUSynthetic& syn, const std::string& list, int nframes,
+    int mesh, int nthreads)
+{
+  bench_result_t r;
+  memset(&r, 0, sizeof(bench_result_t));
+
+  GLGPU3DDataset ds;
+  ds.OpenDataFile(list);
+  timed(r.t[0], [&]() {ds.LoadTimeStep(0, 0);});
+  ds.SetMeshType(mesh);
+  ds.BuildMeshGraph();
+
+  const GLHeader &h = ds.GetHeader(0);
+  const float cell = std::max(h.cell_lengths[0], std::max(h.cell_lengths[1], h.cell_lengths[2]));
+
+  VortexExtractor ex;
+  ex.SetDataset(&ds);
+  ex.SetNumberOfThreads(nthreads);
+  ex.SetGaugeTransformation(true);
+
+  timed(r.t[1], [&]() {ex.ExtractFaces(0);});
+  timed(r.t[2], [&]() {ex.TraceOverSpace(0);});
+  check_frame(syn, ex, 0, h.time, cell, r);
+  timed(r.t[5], [&]() {ex.SaveVortexLines(0);});
+
+  for (int f=1; f<nframes; f++) {
+    timed(r.t[0], [&]() {ds.LoadTimeStep(f, 1);});
+    timed(r.t[1], [&]() {ex.ExtractFaces(1);});
+    timed(r.t[2], [&]() {ex.TraceOverSpace(1);});
+    check_frame(syn, ex, 1, ds.GetHeader(1).time, cell, r);
+    timed(r.t[3], [&]() {ex.ExtractEdges();});
+
+    VortexTransitionMatrix tm;
+    timed(r.t[4], [&]() {tm = ex.TraceOverTime();});
+    int nevents = 0, event;
+    std::set<int> lhs, rhs;
+    for (int i=0; i<tm.NModules(); i++) {
+      tm.GetModule(i, lhs, rhs, event);
+      if (event == VORTEX_EVENT_RECOMBINATION) nevents ++;
+    }
+    if (nevents != syn.NumReconnections(ds.GetHeader(0).time, ds.GetHeader(1).time))
+      r.nevents_wrong ++;
+
+    timed(r.t[5], [&]() {ex.SaveVortexLines(1);});
+    ex.RotateTimeSteps();
+    ds.RotateTimeSteps();
+  }
+
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<int> sizes = parse_list(argc > 1 ? argv[1] : "32,64"),
+                   threads;
+  if (argc > 2) threads = parse_list(argv[2]);
+  else {
+    threads.push_back(1);
+    if (std::thread::hardware_concurrency() > 1)
+      threads.push_back(std::thread::hardware_concurrency());
+  }
+  const int nframes = argc > 3 ? atoi(argv[3]) : 8;
+  const std::string dir = argc > 4 ? argv[4] : "/tmp";
+
+  printf("%6s %4s %3s %9s %9s %9s %9s %9s %9s %6s\n",
+      "size", "mesh", "thr", "load", "faces", "trace", "edges", "track", "save", "check");
+
+  bool succ = true;
+  for (int s=0; s<sizes.size(); s++) {
+    const int n = sizes[s];
+    const int dims[3] = {n, n, n};
+    const float lengths[3] = {32, 32, 32};
+    GLGPUSynthetic syn(dims, lengths);
+    syn.AddRandom(4, 2, 2, 0.5, 1);
+
+    std::ostringstream os;
+    os << dir << "/bench_glgpu3D." << n;
+    const std::string prefix = os.str(), list = prefix + ".list";
+    std::vector<std::string> files;
+
+    FILE *fp = fopen(list.c_str(), "w");
+    if (!fp) return EXIT_FAILURE;
+    for (int f=0; f<nframes; f++) {
+      std::ostringstream os1;
+      os1 << prefix << "." << f << ".bdat";
+      files.push_back(os1.str());
+      syn.WriteBDAT(os1.str(), f);
+      fprintf(fp, "%s\n", os1.str().c_str());
+    }
+    fclose(fp);
+
+    for (int m=0; m<2; m++) {
+      const int mesh = m == 0 ? GLGPU3D_MESH_HEX : GLGPU3D_MESH_TET;
+      for (int k=0; k<threads.size(); k++) {
+        const bench_result_t r = run(syn, list, nframes, mesh, threads[k]);
+        const bool ok = r.nlines_wrong == 0 && r.nevents_wrong == 0 && r.max_dist <= 1.f;
+        succ = succ && ok;
+
+        printf("%6d %4s %3d %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f %6s\n",
+            n, m == 0 ? "hex" : "tet", threads[k],
+            r.t[0], r.t[1], r.t[2], r.t[3], r.t[4], r.t[5], ok ? "ok" : "FAIL");
+        if (!ok)
+          fprintf(stderr, "size=%d, mesh=%d, nthreads=%d: %d frames with wrong number of lines, "
+              "%d transitions with wrong number of reconnections, max distance %f cells\n",
+              n, mesh, threads[k], r.nlines_wrong, r.nevents_wrong, r.max_dist);
+      }
+    }
+
+    for (int f=0; f<files.size(); f++) {
+      std::ostringstream os1;
+      os1 << list << ".vlines." << f;
+      remove(files[f].c_str());
+      remove(os1.str().c_str());
+    }
+    remove(list.c_str());
+  }
+
+  return succ ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,269 @@
+#include "tubeBuilder.h"
+#include <cmath>
+#include <cstring>
+
+static inline void sub3(const float *a, const float *b, float *c)
+{
+  c[0] = a[0] - b[0]; c[1] = a[1] - b[1]; c[2] = a[2] - b[2];
+}
+
+static inline float dot3(const float *a, const float *b)
+{
+  return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+static inline void cross3(const float *a, const float *b, float *c)
+{
+  c[0] = a[1]*b[2] - a[2]*b[1];
+  c[1] = a[2]*b[0] - a[0]*b[2];
+  c[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+static inline float normalize3(float *a)
+{
+  const float l = sqrt(dot3(a, a));
+  if (l > 0) {a[0] /= l; a[1] /= l; a[2] /= l;}
+  return l;
+}
+
+CTubeBuilder::CTubeBuilder(int nthreads) :
+  _stop(false), _generation(0), _ready(false)
+{
+  if (nthreads <= 0) nthreads = std::thread::hardware_concurrency();
+  if (nthreads <= 0) nthreads = 1;
+
+  for (int i=0; i<nthreads; i++)
+    _workers.push_back(std::thread(&CTubeBuilder::WorkerThread, this));
+}
+
+CTubeBuilder::~CTubeBuilder()
+{
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cond.notify_all();
+  for (int i=0; i<_workers.size(); i++)
+    _workers[i].join();
+}
+
+void CTubeBuilder::Build(
+    const std::vector<float>& vertices, const std::vector<unsigned char>& colors,
+    const std::vector<TubeLine>& lines, float radius)
+{
+  std::shared_ptr<Job> job(new Job);
+  job->vertices = vertices;
+  job->colors = colors;
+  job->lines = lines;
+  job->radius = radius;
+  job->meshes.resize(lines.size());
+  job->keys.resize(lines.size());
+  job->next = job->ndone = 0;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  job->generation = ++ _generation;
+  if (lines.empty()) {
+    _job.reset();
+    _result.clear();
+    _ready = true;
+  } else {
+    _job = job; // a pending build, if any, is abandoned
+    _cond.notify_all();
+  }
+}
+
+bool CTubeBuilder::Poll(std::vector<MeshPtr>& meshes)
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (!_ready) return false;
+  meshes.swap(_result);
+  _result.clear();
+  _ready = false;
+  return true;
+}
+
+void CTubeBuilder::WorkerThread()
+{
+  while (1) {
+    std::shared_ptr<Job> job;
+    size_t i;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cond.wait(lock, [this]() {return _stop || (_job && _job->next < _job->lines.size());});
+      if (_stop) return;
+      job = _job;
+      i = job->next ++;
+    }
+
+    const TubeLine& line = job->lines[i];
+    const uint64_t key = Key(*job, line);
+
+    MeshPtr mesh;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      std::map<uint64_t, MeshPtr>::iterator it = _cache.find(key);
+      if (it != _cache.end()) mesh = it->second;
+    }
+
+    if (!mesh) {
+      std::vector<int> kept;
+      Simplify(&job->vertices[line.first*3], line.count, line.tolerance, kept);
+      TubeMesh *m = new TubeMesh;
+      Sweep(&job->vertices[line.first*3], &job->colors[line.first*4], kept, line.sides, job->radius, *m);
+      mesh.reset(m);
+    }
+
+    bool completed = false;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      job->meshes[i] = mesh;
+      job->keys[i] = key;
+      if (++ job->ndone == job->lines.size() && job == _job) {
+        std::map<uint64_t, MeshPtr> cache;
+        for (size_t j=0; j<job->keys.size(); j++)
+          cache[job->keys[j]] = job->meshes[j];
+        _cache.swap(cache);
+
+        _result = job->meshes;
+        _ready = true;
+        _job.reset();
+        completed = true;
+      }
+    }
+
+    if (completed && _ready_callback)
+      _ready_callback();
+  }
+}
+
+uint64_t CTubeBuilder::Key(const Job& job, const TubeLine& line)
+{
+  // FNV-1a over everything the mesh depends on
+  uint64_t h = 14695981039346656037ULL;
+  const auto mix = [&h](const void *p, size_t n) {
+    const unsigned char *c = (const unsigned char*)p;
+    for (size_t i=0; i<n; i++) {
+      h ^= c[i];
+      h *= 1099511628211ULL;
+    }
+  };
+
+  mix(&job.vertices[line.first*3], sizeof(float)*line.count*3);
+  mix(&job.colors[line.first*4], line.count*4);
+  mix(&line.count, sizeof(int));
+  mix(&line.sides, sizeof(int));
+  mix(&line.tolerance, sizeof(float));
+  mix(&job.radius, sizeof(float));
+  return h;
+}
+
+void CTubeBuilder::Simplify(const float *V, int count, float tolerance, std::vector<int>& kept)
+{
+  kept.clear();
+  if (count <= 2 || tolerance <= 0) {
+    for (int i=0; i<count; i++) kept.push_back(i);
+    return;
+  }
+
+  // Douglas-Peucker
+  std::vector<bool> keep(count, false);
+  keep[0] = keep[count-1] = true;
+
+  std::vector<std::pair<int, int> > stack;
+  stack.push_back(std::make_pair(0, count-1));
+  while (!stack.empty()) {
+    const int a = stack.back().first, b = stack.back().second;
+    stack.pop_back();
+    if (b - a < 2) continue;
+
+    float d[3];
+    sub3(V+b*3, V+a*3, d);
+    const float l2 = dot3(d, d);
+
+    int imax = -1;
+    float dmax = tolerance * tolerance;
+    for (int i=a+1; i<b; i++) {
+      float e[3];
+      sub3(V+i*3, V+a*3, e);
+      float dist2;
+      if (l2 > 0) {
+        float c[3];
+        cross3(e, d, c);
+        dist2 = dot3(c, c) / l2;
+      } else
+        dist2 = dot3(e, e);
+      if (dist2 > dmax) {
+        dmax = dist2;
+        imax = i;
+      }
+    }
+
+    if (imax >= 0) {
+      keep[imax] = true;
+      stack.push_back(std::make_pair(a, imax));
+      stack.push_back(std::make_pair(imax, b));
+    }
+  }
+
+  for (int i=0; i<count; i++)
+    if (keep[i]) kept.push_back(i);
+}
+
+void CTubeBuilder::Sweep(const float *V, const unsigned char *C, const std::vector<int>& kept,
+    int sides, float radius, TubeMesh& mesh)
+{
+  if (kept.size() < 2) return;
+
+  float N0[3];
+  for (int j=1; j<kept.size(); j++) {
+    const float *P0 = V + kept[j-1]*3, *P = V + kept[j]*3;
+    const unsigned char *color = C + kept[j]*4;
+
+    // parallel transport of the frame along the line
+    float T[3], N[3] = {0}, B[3];
+    sub3(P, P0, T);
+    normalize3(T);
+    N[0] = -T[1]; N[1] = T[0];
+    if (normalize3(N) == 0 || std::isnan(N[0])) {
+      N[0] = 1; N[1] = 0; N[2] = 0;
+    }
+    cross3(N, T, B);
+
+    if (j>1) {
+      const float n0 = dot3(N0, N), b0 = dot3(N0, B);
+      for (int k=0; k<3; k++) N[k] = n0*N[k] + b0*B[k];
+      normalize3(N);
+      cross3(N, T, B);
+      normalize3(B);
+    }
+    memcpy(N0, N, sizeof(float)*3);
+
+    const int nrings = j==1 ? 2 : 1;
+    for (int k=0; k<nrings; k++) {
+      const float *center = (k==0 && j==1) ? P0 : P;
+      for (int p=0; p<sides; p++) {
+        const float angle = p * 2.f * M_PI / sides;
+        float normal[3];
+        for (int m=0; m<3; m++) normal[m] = N[m]*cos(angle) + B[m]*sin(angle);
+        normalize3(normal);
+
+        for (int m=0; m<3; m++) {
+          mesh.vertices.push_back(center[m] + normal[m]*radius);
+          mesh.normals.push_back(normal[m]);
+          mesh.colors.push_back(color[m]);
+        }
+      }
+    }
+
+    const unsigned int n = mesh.vertices.size()/3;
+    for (int p=0; p<sides; p++) {
+      const int pn = (p+1)%sides;
+      mesh.indices.push_back(n-sides+p);
+      mesh.indices.push_back(n-2*sides+pn);
+      mesh.indices.push_back(n-2*sides+p);
+      mesh.indices.push_back(n-sides+p);
+      mesh.indices.push_back(n-sides+pn);
+      mesh.indices.push_back(n-2*sides+pn);
+    }
+  }
+}
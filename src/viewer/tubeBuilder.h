@@ -0,0 +1,85 @@
+#ifndef _TUBEBUILDER_H
+#define _TUBEBUILDER_H
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stdint.h>
+
+// triangle mesh of one tube, indexed locally
+struct TubeMesh {
+  std::vector<float> vertices, normals;
+  std::vector<unsigned char> colors; // rgb
+  std::vector<unsigned int> indices;
+};
+
+// a polyline to sweep, with its level of detail
+struct TubeLine {
+  int first, count; // vertices in the submitted arrays
+  int sides;
+  float tolerance; // vertices closer than this to the simplified line are dropped
+};
+
+/*
+ * \class   CTubeBuilder
+ * \brief   Sweeps polylines into tube meshes on a pool of worker threads.
+ *          Build() returns immediately; the meshes of the latest build are
+ *          handed out by Poll() once all lines are done, and a build
+ *          superseded by a newer one is abandoned.  Meshes of lines whose
+ *          vertices, colors and level of detail are unchanged since the
+ *          previous build are reused instead of being regenerated.
+*/
+class CTubeBuilder
+{
+public:
+  typedef std::shared_ptr<const TubeMesh> MeshPtr;
+
+  CTubeBuilder(int nthreads=0); // 0: hardware concurrency
+  ~CTubeBuilder();
+
+  // called from a worker when a build is complete; must be thread-safe
+  void SetReadyCallback(const std::function<void()>& f) {_ready_callback = f;}
+
+  void Build(const std::vector<float>& vertices, const std::vector<unsigned char>& colors, // rgba
+      const std::vector<TubeLine>& lines, float radius);
+  bool Poll(std::vector<MeshPtr>& meshes); // true if a new build completed since the last call
+
+  static void Simplify(const float *vertices, int count, float tolerance, std::vector<int>& kept);
+  static void Sweep(const float *vertices, const unsigned char *colors, const std::vector<int>& kept,
+      int sides, float radius, TubeMesh& mesh);
+
+private:
+  struct Job {
+    uint64_t generation;
+    std::vector<float> vertices;
+    std::vector<unsigned char> colors;
+    std::vector<TubeLine> lines;
+    float radius;
+    std::vector<MeshPtr> meshes;
+    std::vector<uint64_t> keys;
+    size_t next, ndone;
+  };
+
+  void WorkerThread();
+  static uint64_t Key(const Job& job, const TubeLine& line);
+
+private:
+  std::vector<std::thread> _workers;
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  bool _stop;
+
+  uint64_t _generation;
+  std::shared_ptr<Job> _job; // the latest build, NULL once collected
+  bool _ready;
+  std::vector<MeshPtr> _result;
+
+  std::map<uint64_t, MeshPtr> _cache; // meshes of the last completed build, by key
+  std::function<void()> _ready_callback;
+};
+
+#endif
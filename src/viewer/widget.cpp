@@ -11,19 +11,7 @@
 #include "common/Utils.hpp"
 #include "io/GLGPU3DDataset.h"
 #include "common/random_color.h"
-
-#ifdef WITH_VTK
-#include <vtkNew.h>
-#include <vtkImageImport.h>
-#include <vtkImageData.h>
-#include <vtkMarchingCubes.h>
-#include <vtkPolyDataMapper.h>
-#include <vtkCell.h>
-#include <vtkTriangle.h>
-#include <vtkPointData.h>
-#include <vtkIdList.h>
-#include <vtkSmartPointer.h>
-#endif
+#include "common/Isosurface.h"
 
 #ifdef WITH_CUDA
 #undef WITH_CUDA
@@ -57,10 +45,16 @@ CGLWidget::CGLWidget(const QGLFormat& fmt, QWidget *parent, QGLWidget *sharedWid
     _ts(0), _tl(0), 
     _rc(NULL), _rc_fb(NULL),
     _ds(NULL), _vt(NULL),
-    h_max(0)
+    h_max(0),
+    _tube_sides(20), _tube_radius(0.3), _tube_lod_scale(0)
 {
   _ilrender = new ILines::ILRender;
 
+  _tube_builder = new CTubeBuilder;
+  _tube_builder->SetReadyCallback([this]() {
+    QMetaObject::invokeMethod(this, "updateGL", Qt::QueuedConnection);
+  });
+
   // _vips << 39 << 40 << 43 << 44;
   // _vips << 3 << 15 << 16 << 17 << 18 << 19; 
   _vips << 2;
@@ -68,6 +62,7 @@ CGLWidget::CGLWidget(const QGLFormat& fmt, QWidget *parent, QGLWidget *sharedWid
 
 CGLWidget::~CGLWidget()
 {
+  delete _tube_builder; // joins the workers before the widget goes away
   delete _ilrender;
   if (_ds != NULL)
     delete _ds;
@@ -83,11 +78,18 @@ void CGLWidget::SetData(const std::string& dataname, int ts, int tl)
   _dataname = dataname;
   _ts = ts; 
   _tl = tl;
+
+#if !WITH_ROCKSDB
+  _frame_store.SetDataName(dataname);
+#endif
 }
 
 void CGLWidget::SetVortexTransition(const VortexTransition *vt)
 {
   _vt = vt;
+#if WITH_ROCKSDB
+  _frame_store.SetFrames(vt->Frames());
+#endif
 }
 
 void CGLWidget::OpenGLGPUDataset()
@@ -122,7 +124,7 @@ void CGLWidget::LoadVortexLines2D()
     const std::string filename = ss.str();
   
     std::string info_bytes;
-    std::vector<VortexLine> vlines;
+    VortexLineSet vlines;
     diy::unserializeFromFile(filename, vlines);
     // if (!::LoadVortexLines(vlines, info_bytes, filename))
     //   continue;
@@ -130,12 +132,13 @@ void CGLWidget::LoadVortexLines2D()
     // if (info_bytes.length()>0) 
     //   _data_info.ParseFromString(info_bytes);
 
-    for (int i=0; i<vlines.size(); i++) {
-      const int gid = _vt->lvid2gvid(t, vlines[i].id);
+    for (int i=0; i<vlines.NLines(); i++) {
+      const VortexLineSet::View vline = vlines.Line(i);
+      const int gid = _vt->lvid2gvid(t, vline.id);
       unsigned char r, g, b;
       _vt->SequenceColor(gid, r, g, b);
-      lines[gid] << *(vlines[i].begin())
-                 << *(vlines[i].begin()+1)
+      lines[gid] << *(vline.begin())
+                 << *(vline.begin()+1)
                  << t*delta - (_tl*delta*0.5);
       colors[gid] = QColor(r, g, b);
     }
@@ -691,10 +694,18 @@ void CGLWidget::renderVortexTubes()
   glEnableClientState(GL_NORMAL_ARRAY); 
   glEnableClientState(GL_COLOR_ARRAY); 
 
-  glVertexPointer(3, GL_FLOAT, 0, vortex_tube_vertices.data()); 
-  glNormalPointer(GL_FLOAT, 0, vortex_tube_normals.data()); 
-  glColorPointer(3, GL_UNSIGNED_BYTE, 0, vortex_tube_colors.data()); 
-  glDrawElements(GL_TRIANGLES, vortex_tube_indices_vertices.size(), GL_UNSIGNED_INT, vortex_tube_indices_vertices.data()); 
+  std::vector<CTubeBuilder::MeshPtr> tubes;
+  if (_tube_builder->Poll(tubes)) 
+    vortex_tubes.swap(tubes);
+
+  for (int i=0; i<vortex_tubes.size(); i++) {
+    const TubeMesh &m = *vortex_tubes[i];
+    if (m.indices.empty()) continue;
+    glVertexPointer(3, GL_FLOAT, 0, m.vertices.data()); 
+    glNormalPointer(GL_FLOAT, 0, m.normals.data()); 
+    glColorPointer(3, GL_UNSIGNED_BYTE, 0, m.colors.data()); 
+    glDrawElements(GL_TRIANGLES, m.indices.size(), GL_UNSIGNED_INT, m.indices.data()); 
+  }
 
   glPopClientAttrib(); 
 
@@ -750,6 +761,9 @@ void CGLWidget::paintGL()
   glLoadIdentity(); 
   glLoadMatrixd(_mvmatrix.data()); 
 
+  if (_trackball.getScale() != _tube_lod_scale) // zoomed; level of detail is outdated
+    updateVortexTubes(_tube_sides, _tube_radius);
+
 #if 0
   glEnable(GL_DEPTH_TEST);
   glColor3f(0.f, 0.f, 0.f);
@@ -834,11 +848,7 @@ void CGLWidget::Clear()
   v_line_colors.clear();
   v_line_vert_count.clear();
   v_line_indices.clear();
-  vortex_tube_vertices.clear();
-  vortex_tube_normals.clear();
-  vortex_tube_colors.clear();
-  vortex_tube_indices_lines.clear();
-  vortex_tube_indices_vertices.clear();
+  // the tubes are kept until the next build completes
 
   f_line_vertices.clear();
   f_line_colors.clear();
@@ -859,6 +869,13 @@ void CGLWidget::Clear()
 void CGLWidget::SetDB(rocksdb::DB* db)
 {
   _db = db;
+  _frame_store.SetDB(db);
+  _frame_store.SetPostProcessor([](std::vector<VortexLine>& vlines) {
+    VortexLineProcessing p;
+    p.remove_invalid_points = true; // non-bezier lines only
+    p.regular_npts = 500; // bezier lines only
+    ProcessVortexLines(vlines, p);
+  });
 
   std::string buf;
   rocksdb::Status s = _db->Get(rocksdb::ReadOptions(), "hdrs", &buf);
@@ -875,21 +892,14 @@ void CGLWidget::LoadVortexLines()
   const std::string key = ss.str();
   std::string info_bytes, buf;
 
-  rocksdb::Status s = _db->Get(rocksdb::ReadOptions(), key, &buf);
   std::vector<VortexLine> vlines;
-  diy::unserialize(buf, vlines);
-  for (int i=0; i<vlines.size(); i++) {
-    if (vlines[i].is_bezier) {
-      vlines[i].ToRegular(500);
-    }
-    else 
-      vlines[i].RemoveInvalidPoints();
-  }
+  VortexFrameStore::FramePtr frame = _frame_store.Get(_vt->TimestepToFrame(_timestep));
+  if (frame) frame->ToVortexLines(vlines);
 
   if (_vortex_render_mode == 4) {
-    ss.clear(); 
+    ss.str(""); 
     ss << "d." << _vt->TimestepToFrame(_timestep);
-    s = _db->Get(rocksdb::ReadOptions(), ss.str(), &buf);
+    rocksdb::Status s = _db->Get(rocksdb::ReadOptions(), ss.str(), &buf);
     
     std::vector<float> fdist;
     diy::unserialize(buf, fdist);
@@ -917,7 +927,8 @@ void CGLWidget::LoadVortexLines()
 
   std::string info_bytes;
   std::vector<VortexLine> vlines;
-  diy::unserializeFromFile(filename, vlines);
+  VortexFrameStore::FramePtr frame = _frame_store.Get(_timestep);
+  if (frame) frame->ToVortexLines(vlines);
   
   fprintf(stderr, "Loaded vortex line file from %s\n", filename.c_str());
 #endif
@@ -949,6 +960,12 @@ void CGLWidget::LoadVortexLines()
   // const float O[3] = {_data_info.ox(), _data_info.oy(), _data_info.oz()},
   //              L[3] = {_data_info.lx(), _data_info.ly(), _data_info.lz()};
 
+  // curves start at the first point of the line, so the id labels below are not affected
+  VortexLineProcessing proc;
+  if (_toggle_bezier) proc.bezier_error_bound = 0.01;
+  proc.regular_npts = 100;
+  ProcessVortexLines(vlines, proc);
+
   int vertCount = 0; 
   for (int k=0; k<vlines.size(); k++) { //iterator over lines
     if (_toggle_vip && !_vips.contains(vlines[k].gid)) continue;
@@ -980,11 +997,6 @@ void CGLWidget::LoadVortexLines()
       _vids_speed.push_back(vlines[k].moving_speed);
     }
 
-    if (_toggle_bezier) {
-      // vlines[k].Flattern(O, L);
-      vlines[k].ToBezier();
-    }
-
     if (vlines[k].is_bezier) { // TODO: make it more graceful..
       VortexLine& vl = vlines[k];
       const int span = vl.size()/4/2/2;
@@ -1011,7 +1023,6 @@ void CGLWidget::LoadVortexLines()
       }
 #endif
 
-      vl.ToRegular(100);
       // vl.Unflattern(O, L);
     }
     
@@ -1127,166 +1138,67 @@ void CGLWidget::LoadInclusionsFromTextFile(const std::string& filename)
 ////////////////
 void CGLWidget::updateVortexTubes(int nPatches, float radius) 
 {
-  vortex_tube_vertices.clear(); 
-  vortex_tube_normals.clear(); 
-  vortex_tube_colors.clear(); 
-  vortex_tube_indices_lines.clear(); 
-  vortex_tube_indices_vertices.clear(); 
+  _tube_sides = nPatches;
+  _tube_radius = radius;
+
+  // pixels per unit length at unit distance from the eye, and eye units per object unit
+  const float focal = height() / (2 * tan(_fovy * M_PI / 360)), 
+              scale = _mvmatrix.mapVector(QVector3D(1, 0, 0)).length();
+  const bool lod = !_mvmatrix.isIdentity() && scale > 0; // known after the first paint
+  _tube_lod_scale = lod ? _trackball.getScale() : 0; // otherwise redone on the first paint
 
+  std::vector<TubeLine> lines;
   for (int i=0; i<v_line_vert_count.size(); i++) {
     if (v_line_vert_count[i] < 2) continue; 
-     
-    int first = v_line_indices[i]; 
-    QVector3D N0; 
-    for (int j=1; j<v_line_vert_count[i]; j++) {
-      QVector3D P0 = QVector3D(v_line_vertices[(first+j-1)*3], v_line_vertices[(first+j-1)*3+1], v_line_vertices[(first+j-1)*3+2]); 
-      QVector3D P  = QVector3D(v_line_vertices[(first+j)*3], v_line_vertices[(first+j)*3+1], v_line_vertices[(first+j)*3+2]);
-      GLubyte color[3] = {v_line_colors[(first+j)*4], v_line_colors[(first+j)*4+1], v_line_colors[(first+j)*4+2]}; 
-
-      QVector3D T = (P - P0).normalized(); 
-      QVector3D N = QVector3D(-T.y(), T.x(), 0.0).normalized(); 
-      QVector3D B = QVector3D::crossProduct(N, T); 
-
-      if (N.length() == 0 || isnan(N.length())) N=QVector3D(1,0,0);
-      // if (N.length() == 0 || isnan(N.length())) continue;
-
-      if (j>1) {
-        float n0 = QVector3D::dotProduct(N0, N); 
-        float b0 = QVector3D::dotProduct(N0, B);
-        QVector3D N1 = n0 * N + b0 * B;
-        N = N1.normalized(); 
-        B = QVector3D::crossProduct(N, T).normalized(); 
-      }
-      N0 = N;
-
-      const int nIteration = (j==1)?2:1; 
-      for (int k=0; k<nIteration; k++) {
-        for (int p=0; p<nPatches; p++) {
-          float angle = p * 2.f * M_PI / nPatches; 
-          QVector3D normal = (N*cos(angle) + B*sin(angle)).normalized(); 
-          QVector3D offset = normal * radius; 
-          QVector3D coord; 
-
-          if (k==0 && j==1) coord = P0 + offset; 
-          else coord = P + offset; 
-
-          vortex_tube_vertices.push_back(coord.x()); 
-          vortex_tube_vertices.push_back(coord.y()); 
-          vortex_tube_vertices.push_back(coord.z()); 
-          // vortex_tube_vertices.push_back(1); 
-          vortex_tube_normals.push_back(normal.x()); 
-          vortex_tube_normals.push_back(normal.y()); 
-          vortex_tube_normals.push_back(normal.z()); 
-          vortex_tube_colors.push_back(color[0]); 
-          vortex_tube_colors.push_back(color[1]); 
-          vortex_tube_colors.push_back(color[2]);
-          vortex_tube_indices_lines.push_back(j); 
-        }
-      }
 
-      for (int p=0; p<nPatches; p++) {
-        const int n = vortex_tube_vertices.size()/3; 
-        const int pn = (p+1)%nPatches; 
-        vortex_tube_indices_vertices.push_back(n-nPatches+p); 
-        vortex_tube_indices_vertices.push_back(n-nPatches-nPatches+pn); 
-        vortex_tube_indices_vertices.push_back(n-nPatches-nPatches+p); 
-        vortex_tube_indices_vertices.push_back(n-nPatches+p); 
-        vortex_tube_indices_vertices.push_back(n-nPatches+pn); 
-        vortex_tube_indices_vertices.push_back(n-nPatches-nPatches+pn); 
+    TubeLine line;
+    line.first = v_line_indices[i];
+    line.count = v_line_vert_count[i];
+    line.sides = nPatches;
+    line.tolerance = 0;
+
+    if (lod) {
+      QVector3D lo(v_line_vertices[line.first*3], v_line_vertices[line.first*3+1], v_line_vertices[line.first*3+2]), 
+                hi = lo;
+      for (int j=1; j<line.count; j++) {
+        const QVector3D p(v_line_vertices[(line.first+j)*3], v_line_vertices[(line.first+j)*3+1], v_line_vertices[(line.first+j)*3+2]);
+        lo = QVector3D(std::min(lo.x(), p.x()), std::min(lo.y(), p.y()), std::min(lo.z(), p.z()));
+        hi = QVector3D(std::max(hi.x(), p.x()), std::max(hi.y(), p.y()), std::max(hi.z(), p.z()));
       }
+      const float dist = std::max(_znear, (_mvmatrix * ((lo + hi) * 0.5f)).length()), 
+                  pixels = focal / dist * scale; // per object unit
+
+      // about four pixels per side, halving the sides per level
+      const float sides = 2 * M_PI * radius * pixels / 4;
+      while (line.sides > 4 && line.sides/2 >= sides) 
+        line.sides /= 2;
+      line.sides = std::max(line.sides, std::min(nPatches, 4));
+
+      // half a pixel, rounded down to a power of two so that small zooms reuse the meshes
+      line.tolerance = pow(2.f, floor(log2(0.5f / pixels)));
     }
+    lines.push_back(line);
   }
+
+  _tube_builder->Build(v_line_vertices, v_line_colors, lines, radius);
 }
 
 void CGLWidget::extractIsosurfaces()
 {
-// #ifdef WITH_VTK
-#if 0
   const float isovalue = 0.2, 
                isovalue1 = 0.6;
-  const float *re = _ds->GetDataPointerRe(), 
-               *im = _ds->GetDataPointerIm();
-  const int count = _ds->dims()[0] * _ds->dims()[1] * _ds->dims()[2];
-  float *rho = (float*)malloc(sizeof(float)*count);
-
-  for (int i=0; i<count; i++)
-    rho[i] = sqrt(re[i]*re[i] + im[i]*im[i]);
-
-  vtkNew<vtkImageImport> import;
-  import->SetDataScalarTypeToDouble();
-  import->SetDataExtent(0, _ds->dims()[0]-1, 0, _ds->dims()[1]-1, 0, _ds->dims()[2]-1);
-  import->SetWholeExtent(0, _ds->dims()[0]-1, 0, _ds->dims()[1]-1, 0, _ds->dims()[2]-1);
-  import->SetDataOrigin(_ds->Origins()[0], _ds->Origins()[1], _ds->Origins()[2]);
-  import->SetDataSpacing(_ds->CellLengths()[0], _ds->CellLengths()[1], _ds->CellLengths()[2]);
-  import->SetImportVoidPointer(rho);
-  import->Update();
-
-  vtkNew<vtkMarchingCubes> surface;
-  surface->SetInputData(import->GetOutput());
-  surface->ComputeNormalsOn();
-  surface->SetValue(0, isovalue);
-  surface->Update();
-
-  {
-    vtkPolyData* poly = surface->GetOutput();
-
-    s_triangle_vertices.clear(); 
-    s_triangle_normals.clear();
-    s_triangle_indices.clear();
-
-    vtkDataArray* normals = poly->GetPointData()->GetNormals();
-
-    for (int i=0; i<poly->GetNumberOfPoints(); i++) {
-      s_triangle_vertices.push_back(poly->GetPoint(i)[0]); 
-      s_triangle_vertices.push_back(poly->GetPoint(i)[1]); 
-      s_triangle_vertices.push_back(poly->GetPoint(i)[2]); 
-      s_triangle_normals.push_back(normals->GetComponent(i, 0));
-      s_triangle_normals.push_back(normals->GetComponent(i, 1));
-      s_triangle_normals.push_back(normals->GetComponent(i, 2));
-    }
-
-    for (int i=0; i<poly->GetNumberOfCells(); i++) {
-      vtkSmartPointer<vtkIdList> list = vtkSmartPointer<vtkIdList>::New();
-      poly->GetCellPoints(i, list);
-      s_triangle_indices.push_back(list->GetId(0));
-      s_triangle_indices.push_back(list->GetId(1));
-      s_triangle_indices.push_back(list->GetId(2));
-    }
-  }
-  
-  surface->SetValue(0, isovalue1);
-  surface->Update();
-  
-  {
-    vtkPolyData* poly = surface->GetOutput();
 
-    s_triangle_vertices1.clear(); 
-    s_triangle_normals1.clear();
-    s_triangle_indices1.clear();
+  GLHeader h;
+  float *rho, *phi, *re, *im, *J;
+  _ds->GetDataArray(h, &rho, &phi, &re, &im, &J);
+  if (rho == NULL) return;
 
-    vtkDataArray* normals = poly->GetPointData()->GetNormals();
+  ExtractIsosurface(h.dims, h.origins, h.cell_lengths, rho, isovalue, 
+      s_triangle_vertices, s_triangle_normals, s_triangle_indices);
+  ExtractIsosurface(h.dims, h.origins, h.cell_lengths, rho, isovalue1, 
+      s_triangle_vertices1, s_triangle_normals1, s_triangle_indices1);
 
-    for (int i=0; i<poly->GetNumberOfPoints(); i++) {
-      s_triangle_vertices1.push_back(poly->GetPoint(i)[0]); 
-      s_triangle_vertices1.push_back(poly->GetPoint(i)[1]); 
-      s_triangle_vertices1.push_back(poly->GetPoint(i)[2]); 
-      s_triangle_normals1.push_back(normals->GetComponent(i, 0));
-      s_triangle_normals1.push_back(normals->GetComponent(i, 1));
-      s_triangle_normals1.push_back(normals->GetComponent(i, 2));
-    }
-
-    for (int i=0; i<poly->GetNumberOfCells(); i++) {
-      vtkSmartPointer<vtkIdList> list = vtkSmartPointer<vtkIdList>::New();
-      poly->GetCellPoints(i, list);
-      s_triangle_indices1.push_back(list->GetId(0));
-      s_triangle_indices1.push_back(list->GetId(1));
-      s_triangle_indices1.push_back(list->GetId(2));
-    }
-  }
-  
-  free(rho);
   fprintf(stderr, "isosurface extracted.\n");
-#endif
 }
 
 void CGLWidget::addCurrentLineToHistory()
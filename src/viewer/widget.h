@@ -9,8 +9,10 @@
 #include <cmath>
 #include "def.h"
 #include "trackball.h"
+#include "tubeBuilder.h"
 #include "common/Inclusions.h"
 #include "common/VortexTransition.h"
+#include "common/VortexFrameStore.h"
 
 #ifdef WITH_ROCKSDB
 #include <rocksdb/db.h>
@@ -124,9 +126,11 @@ private: // vortex line rendering
   std::vector<GLsizei> v_line_vert_count; 
   std::vector<GLint> v_line_indices; 
   
-  std::vector<GLfloat> vortex_tube_vertices, vortex_tube_normals;
-  std::vector<GLubyte> vortex_tube_colors; 
-  std::vector<GLuint> vortex_tube_indices_lines, vortex_tube_indices_vertices;
+  // tubes are built in the background; the last completed set is drawn meanwhile
+  CTubeBuilder *_tube_builder;
+  std::vector<CTubeBuilder::MeshPtr> vortex_tubes;
+  int _tube_sides;
+  float _tube_radius, _tube_lod_scale;
 
 private: //HDR
   typedef struct {
@@ -179,6 +183,9 @@ private: // id rendering
   QVector<QColor> _vids_colors;
   QVector<float> _vids_speed;
 
+private: // decoded vortex lines, cached across frame changes
+  VortexFrameStore _frame_store;
+
 private: // GLGPU
   GLGPUDataset *_ds;
 #if WITH_ROCKSDB
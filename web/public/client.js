@@ -56,7 +56,7 @@ function connectToServer() {
 
   // ws = new WebSocket("ws://red.mcs.anl.gov:8080");
   ws = new WebSocket(wsUri);
-  // ws.binaryType = "arraybuffer";
+  ws.binaryType = "arraybuffer";
   ws.onopen = onOpen;
   ws.onclose = onClose;
   ws.onerror = onError;
@@ -81,6 +81,15 @@ function rgb(r, g, b) {
 
 function onMessage(evt)
 {
+  if (evt.data instanceof ArrayBuffer) {
+    var frame = decodeFrame(evt.data);
+    if (frame != null) {
+      updateVlines(frame.vlines);
+      updateDistances(frame.dist);
+    }
+    return;
+  }
+
   var msg = JSON.parse(evt.data);
   // console.log(msg);
   if (msg.type == "dbList") {
@@ -89,10 +98,38 @@ function onMessage(evt)
   else if (msg.type == "dataInfo") {
     updateDataInfo(msg.dataInfo, msg.events);
   }
-  else if (msg.type == "vlines") {
-    updateVlines(msg.data.vlines);
-    updateDistances(msg.data.dist);
+}
+
+// binary frame layout, see vf2_frame_hdr_t in vf2.h
+const VF2_FRAME_MAGIC = 0x46324656;
+
+function decodeFrame(buf) {
+  var hdr = new Uint32Array(buf, 0, 5);
+  if (hdr[0] != VF2_FRAME_MAGIC) {
+    console.log("invalid frame");
+    return null;
+  }
+  var nlines = hdr[2], nverts = hdr[3], ndist = hdr[4];
+
+  var offset = 20;
+  var offsets = new Uint32Array(buf, offset, nlines+1); offset += 4*(nlines+1);
+  var gids = new Int32Array(buf, offset, nlines); offset += 4*nlines;
+  var colors = new Uint8Array(buf, offset, 4*nlines); offset += 4*nlines;
+  var speeds = new Float32Array(buf, offset, nlines); offset += 4*nlines;
+  var verts = new Float32Array(buf, offset, 3*nverts); offset += 12*nverts;
+  var dist = new Float32Array(buf, offset, ndist);
+
+  var vlines = [];
+  for (var i=0; i<nlines; i++) {
+    vlines.push({
+      gid: gids[i],
+      verts: verts.subarray(offsets[i]*3, offsets[i+1]*3),
+      r: colors[i*4], g: colors[i*4+1], b: colors[i*4+2],
+      moving_speed: speeds[i]
+    });
   }
+
+  return {frame: new Int32Array(buf, 4, 1)[0], vlines: vlines, dist: dist};
 }
 
 function updateDBList(list) {
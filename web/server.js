@@ -17,7 +17,6 @@ server.listen(8080);
 var wss = new WebSocketServer({
   server: server,
   path: "/ws",
-  // binaryType : "arraybuffer",
   perMessageDeflate : "false"
 });
 
@@ -71,17 +70,15 @@ function sendDataInfo(ws, obj, dbname) {
 
 function sendFrame(ws, obj, frame) {
   console.log("requested frame " + frame);
-  var frameData = obj.loadFrame(frame);
- 
-  msg = {
-    type: "vlines", 
-    data: frameData
-  };
-  ws.send(JSON.stringify(msg));
 
-  // ws.send(BSON.serialize(vlines)); // I don't know why BSON doesn't work
-
-  // ws.onmessage = function(msg) {
-  //   console.log(msg.data);
-  // }
+  // read and packed off the event loop; sent as one binary message, laid out
+  // as described in vf2.h and decoded by decodeFrame() in the client
+  obj.loadFrame(frame, function(err, frameData) {
+    if (err) {
+      console.log(err.message + " " + frame);
+      return;
+    }
+    if (ws.readyState == ws.OPEN)
+      ws.send(frameData.buffer, {binary: true});
+  });
 }
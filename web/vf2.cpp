@@ -1,9 +1,75 @@
 #include "vf2.h"
 #include <string>
 #include <sstream>
+#include <cstdlib>
+#include <cstring>
 
 Persistent<Function> VF2::constructor;
 
+typedef struct {
+  uv_work_t req;
+  VF2 *obj;
+  int frame;
+  bool succ;
+  char *data;
+  size_t size;
+  Persistent<Function> callback;
+} load_frame_work_t;
+
+static void free_frame(char *data, void*) {
+  free(data);
+}
+
+// packs the lines and the distance matrix into one malloc'd buffer, laid out as
+// described at vf2_frame_hdr_t
+static void pack_frame(
+    int frame, 
+    const std::vector<VortexLine>& vlines, 
+    const std::vector<float>& dist, 
+    char **data, size_t *size)
+{
+  const size_t nlines = vlines.size();
+  size_t nfloats = 0;
+  for (size_t i=0; i<nlines; i++) 
+    nfloats += vlines[i].size();
+
+  *size = sizeof(vf2_frame_hdr_t) 
+    + sizeof(unsigned int)*(nlines+1) + sizeof(int)*nlines + 4*nlines + sizeof(float)*nlines
+    + sizeof(float)*nfloats + sizeof(float)*dist.size();
+  *data = (char*)malloc(*size);
+
+  vf2_frame_hdr_t *hdr = (vf2_frame_hdr_t*)*data;
+  hdr->magic = VF2_FRAME_MAGIC;
+  hdr->frame = frame;
+  hdr->nlines = nlines;
+  hdr->nverts = nfloats/3;
+  hdr->ndist = dist.size();
+
+  unsigned int *offsets = (unsigned int*)(hdr + 1);
+  int *gids = (int*)(offsets + nlines + 1);
+  unsigned char *colors = (unsigned char*)(gids + nlines);
+  float *speeds = (float*)(colors + 4*nlines), 
+        *verts = speeds + nlines, 
+        *dist1 = verts + nfloats;
+
+  offsets[0] = 0;
+  for (size_t i=0; i<nlines; i++) {
+    const VortexLine& vline = vlines[i];
+    offsets[i+1] = offsets[i] + vline.size()/3;
+    gids[i] = vline.gid;
+    colors[i*4] = vline.r;
+    colors[i*4+1] = vline.g;
+    colors[i*4+2] = vline.b;
+    colors[i*4+3] = 255;
+    speeds[i] = vline.moving_speed;
+    if (!vline.empty())
+      memcpy(verts + offsets[i]*3, vline.data(), sizeof(float)*vline.size());
+  }
+
+  if (!dist.empty())
+    memcpy(dist1, dist.data(), sizeof(float)*dist.size());
+}
+
 void VF2::Init(Local<Object> exports) {
   Isolate *isolate = exports->GetIsolate();
   Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
@@ -57,12 +123,15 @@ void VF2::OpenDB(const FunctionCallbackInfo<Value>& args) {
   String::Utf8Value dbname1(args[0]->ToString());
   std::string dbname(*dbname1);
 
+  std::lock_guard<std::mutex> lock(obj->mutex);
+  obj->CloseDB();
   obj->OpenDB(dbname);
 }
 
 void VF2::GetEvents(const FunctionCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
   VF2* obj = ObjectWrap::Unwrap<VF2>(args.Holder());
+  std::lock_guard<std::mutex> lock(obj->mutex);
   const VortexTransition& vt = obj->vt;
   const std::vector<VortexEvent>& events = vt.Events();
 
@@ -101,6 +170,7 @@ void VF2::GetEvents(const FunctionCallbackInfo<Value>& args) {
 void VF2::GetDataInfo(const FunctionCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
   VF2* obj = ObjectWrap::Unwrap<VF2>(args.Holder());
+  std::lock_guard<std::mutex> lock(obj->mutex);
   
   obj->LoadDataInfo();
   const vfgpu_cfg_t& cfg = obj->cfg;
@@ -178,11 +248,14 @@ void VF2::GetDataInfo(const FunctionCallbackInfo<Value>& args) {
   args.GetReturnValue().Set(jout);
 }
 
+// loadFrame(frame[, callback]): with a callback, the frame is read and packed 
+// on the libuv thread pool and passed as callback(err, frame); otherwise it is
+// returned.  The frame object holds the packed buffer and typed array views
+// into it: offsets, gids, colors, speeds, verts and dist.
 void VF2::LoadFrame(const FunctionCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
 
   VF2* obj = ObjectWrap::Unwrap<VF2>(args.Holder());
-  // const std::string& dbname = obj->dbname;
 
   if (args.Length() < 1) {
     isolate->ThrowException(Exception::TypeError(
@@ -190,7 +263,7 @@ void VF2::LoadFrame(const FunctionCallbackInfo<Value>& args) {
     return;
   }
 
-  if (!args[0]->IsNumber()) {
+  if (!args[0]->IsNumber() || (args.Length() > 1 && !args[1]->IsFunction())) {
     isolate->ThrowException(Exception::TypeError(
           String::NewFromUtf8(isolate, "Wrong arguments")));
     return;
@@ -199,61 +272,92 @@ void VF2::LoadFrame(const FunctionCallbackInfo<Value>& args) {
   // input args
   const int frame = args[0]->NumberValue();
 
-  std::vector<VortexLine> vlines;
-  std::vector<float> dist;
-  bool succ = obj->LoadFrame(frame, vlines, dist);
+  if (args.Length() < 2) {
+    char *data; 
+    size_t size;
+    if (obj->LoadPackedFrame(frame, &data, &size))
+      args.GetReturnValue().Set(FrameToJS(isolate, data, size));
+    else 
+      args.GetReturnValue().SetNull();
+    return;
+  }
 
-  // output 
-  Local<Object> jout = Object::New(isolate);
-  
-  // vlines
-  Local<Array> jvlines = Array::New(isolate);
-  for (size_t i=0; i<vlines.size(); i++) {
-    VortexLine& vline = vlines[i];
-    if (vline.is_bezier) {
-      vline.ToRegular(500);
-    } else {
-      vline.RemoveInvalidPoints();
-      vline.Simplify(0.1);
-      // vline.ToBezier(0.01);
-      // vline.ToRegular(100);
-    }
-    Local<Object> jvline = Object::New(isolate);
-
-    // gid
-    Local<Number> jgid = Number::New(isolate, vline.gid);
-    jvline->Set(String::NewFromUtf8(isolate, "gid"), jgid);
-
-    // verts
-    Local<Array> jverts = Array::New(isolate);
-    for (size_t j=0; j<vline.size(); j++)
-      jverts->Set(j, Number::New(isolate, vline[j]));
-    jvline->Set(String::NewFromUtf8(isolate, "verts"), jverts);
-   
-    // color
-    // fprintf(stderr, "rgb=%d, %d, %d\n", vline.r, vline.g, vline.b);
-    Local<Number> jr = Number::New(isolate, vline.r);
-    jvline->Set(String::NewFromUtf8(isolate, "r"), jr);
-    Local<Number> jg = Number::New(isolate, vline.g);
-    jvline->Set(String::NewFromUtf8(isolate, "g"), jg);
-    Local<Number> jb = Number::New(isolate, vline.b);
-    jvline->Set(String::NewFromUtf8(isolate, "b"), jb);
-
-    // moving_speed
-    Local<Number> jms = Number::New(isolate, vline.moving_speed);
-    jvline->Set(String::NewFromUtf8(isolate, "moving_speed"), jms);
-
-    jvlines->Set(i, jvline);
+  load_frame_work_t *work = new load_frame_work_t;
+  work->req.data = work;
+  work->obj = obj;
+  work->frame = frame;
+  work->succ = false;
+  work->data = NULL;
+  work->size = 0;
+  work->callback.Reset(isolate, Local<Function>::Cast(args[1]));
+
+  obj->Ref(); // kept alive until the callback
+  uv_queue_work(uv_default_loop(), &work->req, LoadFrameWork, LoadFrameAfterWork);
+}
+
+void VF2::LoadFrameWork(uv_work_t *req) {
+  load_frame_work_t *work = static_cast<load_frame_work_t*>(req->data);
+  work->succ = work->obj->LoadPackedFrame(work->frame, &work->data, &work->size);
+}
+
+void VF2::LoadFrameAfterWork(uv_work_t *req, int) {
+  load_frame_work_t *work = static_cast<load_frame_work_t*>(req->data);
+  Isolate *isolate = Isolate::GetCurrent();
+  HandleScope scope(isolate);
+
+  Local<Value> argv[2];
+  if (work->succ) {
+    argv[0] = Null(isolate);
+    argv[1] = FrameToJS(isolate, work->data, work->size);
+  } else {
+    argv[0] = Exception::Error(String::NewFromUtf8(isolate, "Cannot load frame"));
+    argv[1] = Null(isolate);
   }
-  jout->Set(String::NewFromUtf8(isolate, "vlines"), jvlines);
- 
-  // distance matrix
-  Local<Array> jdist = Array::New(isolate);
-  for (size_t i=0; i<dist.size(); i++) 
-    jdist->Set(i, Number::New(isolate, dist[i]));
+
+  Local<Function> callback = Local<Function>::New(isolate, work->callback);
+  callback->Call(isolate->GetCurrentContext()->Global(), 2, argv);
+
+  work->callback.Reset();
+  work->obj->Unref();
+  delete work;
+}
+
+Local<Object> VF2::FrameToJS(Isolate *isolate, char *data, size_t size) {
+  const vf2_frame_hdr_t hdr = *(const vf2_frame_hdr_t*)data;
+
+  // the buffer takes over the data
+  Local<Object> jbuf = node::Buffer::New(isolate, data, size, free_frame, NULL).ToLocalChecked();
+  Local<ArrayBuffer> ab = Local<Uint8Array>::Cast(jbuf)->Buffer();
+  size_t offset = Local<Uint8Array>::Cast(jbuf)->ByteOffset() + sizeof(vf2_frame_hdr_t);
+
+  Local<Object> jout = Object::New(isolate);
+  jout->Set(String::NewFromUtf8(isolate, "buffer"), jbuf);
+  jout->Set(String::NewFromUtf8(isolate, "frame"), Number::New(isolate, hdr.frame));
+
+  Local<Uint32Array> joffsets = Uint32Array::New(ab, offset, hdr.nlines+1);
+  offset += sizeof(unsigned int)*(hdr.nlines+1);
+  jout->Set(String::NewFromUtf8(isolate, "offsets"), joffsets);
+
+  Local<Int32Array> jgids = Int32Array::New(ab, offset, hdr.nlines);
+  offset += sizeof(int)*hdr.nlines;
+  jout->Set(String::NewFromUtf8(isolate, "gids"), jgids);
+
+  Local<Uint8Array> jcolors = Uint8Array::New(ab, offset, 4*hdr.nlines);
+  offset += 4*hdr.nlines;
+  jout->Set(String::NewFromUtf8(isolate, "colors"), jcolors);
+
+  Local<Float32Array> jspeeds = Float32Array::New(ab, offset, hdr.nlines);
+  offset += sizeof(float)*hdr.nlines;
+  jout->Set(String::NewFromUtf8(isolate, "speeds"), jspeeds);
+
+  Local<Float32Array> jverts = Float32Array::New(ab, offset, 3*hdr.nverts);
+  offset += sizeof(float)*3*hdr.nverts;
+  jout->Set(String::NewFromUtf8(isolate, "verts"), jverts);
+
+  Local<Float32Array> jdist = Float32Array::New(ab, offset, hdr.ndist);
   jout->Set(String::NewFromUtf8(isolate, "dist"), jdist);
 
-  args.GetReturnValue().Set(jout);
+  return jout;
 }
 
 bool VF2::OpenDB(const std::string& dbname_)
@@ -267,13 +371,43 @@ bool VF2::OpenDB(const std::string& dbname_)
 
   if (s.ok()) {
     LoadDataInfo();
+    store.SetDB(db);
+    store.SetFrames(vt.Frames());
+    store.SetPostProcessor([](std::vector<VortexLine>& vlines) {
+      for (size_t i=0; i<vlines.size(); i++) {
+        VortexLine& vline = vlines[i];
+        if (vline.is_bezier) {
+          vline.ToRegular(500);
+        } else {
+          vline.RemoveInvalidPoints();
+          vline.Simplify(0.1);
+          // vline.ToBezier(0.01);
+          // vline.ToRegular(100);
+        }
+      }
+    });
     return true;
   } else return false;
 }
 
+bool VF2::LoadPackedFrame(int frame, char **data, size_t *size)
+{
+  std::vector<VortexLine> vlines;
+  std::vector<float> dist;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (db == NULL || !LoadFrame(frame, vlines, dist)) 
+      return false;
+  }
+
+  pack_frame(frame, vlines, dist, data, size);
+  return true;
+}
+
 void VF2::CloseDB()
 {
   if (db != NULL) {
+    store.SetDB(NULL);
     dbname.clear();
     delete db;
     db = NULL;
@@ -316,12 +450,9 @@ bool VF2::LoadFrame(
   std::string buf;
 
   const int timestep = vt.Frame(frame);
-  std::stringstream ss;
-  ss << "v." << timestep;
-  buf.clear();
-  s = db->Get(rocksdb::ReadOptions(), ss.str(), &buf);
-  if (buf.empty()) return false;
-  diy::unserialize(buf, vlines);
+  VortexFrameStore::FramePtr ptr = store.Get(timestep);
+  if (!ptr) return false;
+  vlines = *ptr;
 
   for (size_t i=0; i<vlines.size(); i++) {
     vlines[i].gid = vt.lvid2gvid(frame, vlines[i].id); // sorry, this is confusing
@@ -329,7 +460,7 @@ bool VF2::LoadFrame(
   }
 
   // distance matrix
-  ss.clear();
+  std::stringstream ss;
   ss << "d." << timestep;
   buf.clear();
   s = db->Get(rocksdb::ReadOptions(), ss.str(), &buf);
@@ -1,7 +1,11 @@
 #include <node.h>
 #include <node_object_wrap.h>
+#include <node_buffer.h>
+#include <uv.h>
+#include <mutex>
 #include <rocksdb/db.h>
 #include "common/VortexLine.h"
+#include "common/VortexFrameStore.h"
 #include "common/VortexTransition.h"
 #include "common/Inclusions.h"
   
@@ -28,6 +32,18 @@ typedef struct {
   float zaniso;
 } vfgpu_cfg_t;
 
+// binary frame sent to the client; the header is followed by, in order and
+// each 4-byte aligned: vertex offsets of the lines (uint32, nlines+1), gids
+// (int32, nlines), colors (uint8 rgba, nlines), moving speeds (float32,
+// nlines), vertices (float32, 3*nverts), and the distance matrix (float32, ndist)
+#define VF2_FRAME_MAGIC 0x46324656 // "VF2F"
+
+typedef struct {
+  unsigned int magic;
+  int frame;
+  unsigned int nlines, nverts, ndist;
+} vf2_frame_hdr_t;
+
 class VF2 : public node::ObjectWrap {
 public:
   static void Init(Local<Object> exports);
@@ -42,6 +58,10 @@ private:
   static void GetEvents(const FunctionCallbackInfo<Value>& args);
   static void LoadFrame(const FunctionCallbackInfo<Value>& args);
 
+  static void LoadFrameWork(uv_work_t *req); // on the libuv thread pool
+  static void LoadFrameAfterWork(uv_work_t *req, int status);
+  static Local<Object> FrameToJS(Isolate *isolate, char *data, size_t size);
+
   static Persistent<Function> constructor;
 
 private:
@@ -51,8 +71,11 @@ private:
   bool LoadFrame(int frame,
       std::vector<VortexLine>& vlines,
       std::vector<float>& dist);
+  bool LoadPackedFrame(int frame, char **data, size_t *size);
 
 private:
+  std::mutex mutex; // guards the DB and the data below against frame loading in workers
+
   std::string dbname;
   rocksdb::DB* db;
 
@@ -60,4 +83,5 @@ private:
   std::vector<vfgpu_hdr_t> hdrs;
   Inclusions incs;
   VortexTransition vt;
+  VortexFrameStore store;
 };